@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include "extra/json.hpp"
+#include "search/PedigreeSearch.h"
+#include "search/PedigreeTool.h"
+
+// 計算結果を捨てられないようにするための出力先
+static volatile int sink = 0;
+
+// operator newを置き換えてヒープ確保の回数を数える
+static std::atomic<uint64_t> numAllocations(0);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(size_t size) {
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// std::pmr::new_delete_resource()は整列を指定する版を使う
+void* operator new(size_t size, std::align_val_t alignment) {
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = std::max(sizeof(void*), (size_t)alignment);
+    void* p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+#pragma GCC diagnostic pop
+
+namespace {
+
+using json = nlohmann::json;
+using pedsearch::search::PedigreeTool;
+
+const uint64_t SEED = 20230109;
+
+struct Measurement {
+    uint64_t pairs;
+    double seconds;
+    uint64_t allocations;
+};
+
+// repeat回実行して最速の結果を採用する
+Measurement measure(unsigned int repeat, const std::function<uint64_t()>& workload) {
+    Measurement best = {0, 0.0, 0};
+    for (unsigned int i = 0; i < repeat; i++) {
+        uint64_t allocations = numAllocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t pairs = workload();
+        auto stop = std::chrono::steady_clock::now();
+        Measurement m = {
+            pairs,
+            std::chrono::duration<double>(stop - start).count(),
+            numAllocations.load(std::memory_order_relaxed) - allocations
+        };
+        if (i == 0 || m.seconds < best.seconds) {
+            best = m;
+        }
+    }
+    return best;
+}
+
+json report(std::string_view name, const Measurement& m) {
+    json j;
+    j["bench"] = name;
+    j["pairs"] = m.pairs;
+    j["seconds"] = m.seconds;
+    j["ns_per_pair"] = m.pairs == 0 ? 0.0 : m.seconds * 1e9 / m.pairs;
+    j["pairs_per_s"] = m.seconds == 0.0 ? 0.0 : m.pairs / m.seconds;
+    j["allocs_per_pair"] = m.pairs == 0 ? 0.0 : (double)m.allocations / m.pairs;
+    return j;
+}
+
+PedigreeTool loadTool(std::string_view path) {
+    return PedigreeTool(
+        path,
+        "database/default_stallions.json",
+        "database/default_broodmares.json",
+        "database/stallions.json",
+        "database/elaborated.json"
+    );
+}
+
+// 乱数で選んだn代配合の繁殖牝馬を作っておく(計測対象外)
+std::vector<std::pair<size_t, pedsearch::base::DefaultBroodmare> > sampleBroodmares(
+    const PedigreeTool& tool, unsigned int generation, uint64_t samples
+) {
+    std::mt19937_64 rng(SEED + generation);
+    std::uniform_int_distribution<size_t> stallionDist(0, tool.getNumDefaultStallions() - 1);
+    std::uniform_int_distribution<size_t> broodmareDist(0, tool.getNumDefaultBroodmares() - 1);
+
+    std::vector<std::pair<size_t, pedsearch::base::DefaultBroodmare> > pairs;
+    pairs.reserve(samples);
+    for (uint64_t i = 0; i < samples; i++) {
+        size_t stallion = stallionDist(rng);
+        std::optional<pedsearch::base::DefaultBroodmare> broodmare(
+            tool.getDefaultBroodmare(broodmareDist(rng))
+        );
+        for (unsigned int g = 1; g < generation; g++) {
+            std::string_view sire = tool.getDefaultStallionName(stallionDist(rng));
+            broodmare.emplace(tool.makeDefaultBroodmare(sire, *broodmare));
+        }
+        pairs.push_back(std::make_pair(stallion, *broodmare));
+    }
+    return pairs;
+}
+
+void printComparison(const std::vector<json>& results, std::string_view baselinePath) {
+    std::ifstream istream(baselinePath.data());
+    if (!istream) {
+        throw std::runtime_error("pedbench: cannot open " + std::string(baselinePath) + ".");
+    }
+    std::map<std::string, double> baseline;
+    std::string line;
+    while (std::getline(istream, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        json j = json::parse(line);
+        baseline[j["bench"].get<std::string>()] = j["ns_per_pair"].get<double>();
+    }
+
+    std::cerr << "bench\tbaseline ns/pair\tcurrent ns/pair\tspeedup" << std::endl;
+    for (const json& j: results) {
+        std::string name = j["bench"].get<std::string>();
+        auto it = baseline.find(name);
+        if (it == baseline.end() || j["ns_per_pair"].get<double>() == 0.0) {
+            continue;
+        }
+        std::cerr << name << "\t" << (*it).second << "\t" << j["ns_per_pair"].get<double>() << "\t"
+            << (*it).second / j["ns_per_pair"].get<double>() << "x" << std::endl;
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int repeat = 3;
+    uint64_t samples = 20000;
+    std::string only;
+    std::string baselinePath;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc) {
+            repeat = (unsigned int)std::stoul(argv[++i]);
+        } else if (arg == "--samples" && i + 1 < argc) {
+            samples = std::stoull(argv[++i]);
+        } else if (arg == "--only" && i + 1 < argc) {
+            only = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else {
+            std::cerr << "Usage: pedbench [--repeat N] [--samples N] [--only NAME] [--baseline FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        std::vector<json> results;
+        auto run = [&](std::string_view name, const std::function<uint64_t()>& workload) {
+            if (!only.empty() && only != name) {
+                return;
+            }
+            results.push_back(report(name, measure(repeat, workload)));
+            std::cout << results.back().dump() << std::endl;
+        };
+
+        // JSONの読み込みと索引の構築
+        run("load", [&]() {
+            PedigreeTool tool = loadTool(argv[0]);
+            return (uint64_t)1;
+        });
+
+        PedigreeTool tool = loadTool(argv[0]);
+
+        size_t deep = 0;
+        size_t mikokoro = 0;
+        tool.findDefaultStallion("ﾃﾞｨｰﾌﾟｲﾝﾊﾟｸﾄ", deep);
+        tool.findDefaultBroodmare("ﾐｺｺﾛﾉﾏﾏﾆ", mikokoro);
+        run("analyze_single", [&]() {
+            const uint64_t n = 100000;
+            for (uint64_t i = 0; i < n; i++) {
+                pedsearch::search::PedigreeAnalysis result = tool.analyze(
+                    tool.getDefaultStallion(deep), tool.getDefaultBroodmare(mikokoro)
+                );
+                sink = sink + result.getNitro().getPowerNitro();
+            }
+            return n;
+        });
+
+        run("analyze_gen1_all", [&]() {
+            uint64_t n = 0;
+            for (size_t s = 0; s < tool.getNumDefaultStallions(); s++) {
+                for (size_t b = 0; b < tool.getNumDefaultBroodmares(); b++) {
+                    pedsearch::search::PedigreeAnalysis result = tool.analyze(
+                        tool.getDefaultStallion(s), tool.getDefaultBroodmare(b)
+                    );
+                    sink = sink + result.getNitro().getPowerNitro();
+                    n++;
+                }
+            }
+            return n;
+        });
+
+        // 分析の組み合わせごとの特殊化の速度. 1代の全組合せで計測する.
+        struct Variant {
+            const char* name;
+            bool interesting, wonderful, elaborated, cross, nitro;
+        };
+        const Variant variants[] = {
+            {"flags", true, true, true, false, false},
+            {"nitro", false, false, false, false, true},
+            {"cross", false, false, false, true, false},
+            {"cross_nitro", false, false, false, true, true},
+            {"all", true, true, true, true, true}
+        };
+        for (const Variant& variant: variants) {
+            run(std::string("variant_") + variant.name + "_gen1", [&]() {
+                uint64_t n = 0;
+                for (size_t s = 0; s < tool.getNumDefaultStallions(); s++) {
+                    for (size_t b = 0; b < tool.getNumDefaultBroodmares(); b++) {
+                        pedsearch::search::PedigreeAnalysis result = tool.analyze(
+                            tool.getDefaultStallion(s), tool.getDefaultBroodmare(b), variant.interesting,
+                            variant.wonderful, variant.elaborated, variant.cross, variant.nitro
+                        );
+                        sink = sink + (variant.nitro ? result.getNitro().getPowerNitro() : 0)
+                            + (variant.elaborated && result.isElaborated() ? 1 : 0);
+                        n++;
+                    }
+                }
+                return n;
+            });
+        }
+
+        for (unsigned int generation = 2; generation <= 3; generation++) {
+            std::string name = "analyze_gen" + std::to_string(generation) + "_sampled";
+            if (!only.empty() && only != name) {
+                continue;
+            }
+            auto pairs = sampleBroodmares(tool, generation, samples);
+            run(name, [&]() {
+                for (auto it = pairs.begin(); it != pairs.end(); ++it) {
+                    pedsearch::search::PedigreeAnalysis result = tool.analyze(
+                        tool.getDefaultStallion((*it).first), (*it).second
+                    );
+                    sink = sink + result.getNitro().getPowerNitro();
+                }
+                return (uint64_t)pairs.size();
+            });
+        }
+
+        // 繁殖牝馬の生成と結果の集計を含む探索全体. 分析の一時的な構造は領域から確保するので,
+        // 1度回して領域が十分な大きさになった後はallocs_per_pairが0になる.
+        pedsearch::search::SearchEngine gen3(
+            tool, tool.resolve(pedsearch::search::SearchQuery({"all", "all", "all", "all"}))
+        );
+        auto searchSampled = [&]() {
+            std::mt19937_64 rng(SEED);
+            std::uniform_int_distribution<uint64_t> rowDist(0, gen3.getSpace().size() - 1);
+            pedsearch::search::SearchResult result;
+            for (uint64_t i = 0; i < samples; i++) {
+                gen3.evaluate(rowDist(rng), result);
+                sink = sink + result.getPowerNitro();
+            }
+            return samples;
+        };
+        if (only.empty() || only == "search_gen3_sampled") {
+            searchSampled();
+        }
+        run("search_gen3_sampled", searchSampled);
+
+        // 探索の範囲と同じくBATCH_SIZE行ずつ評価する. 領域はまとめて空にする.
+        pedsearch::search::SearchEngine gen1(
+            tool, tool.resolve(pedsearch::search::SearchQuery({"all", "all"}))
+        );
+        std::vector<pedsearch::search::SearchResult> batch;
+        batch.reserve(pedsearch::search::SearchRange::BATCH_SIZE);
+        auto searchBatched = [&]() {
+            const uint64_t rows = gen1.getSpace().size();
+            for (uint64_t begin = 0; begin < rows; begin += pedsearch::search::SearchRange::BATCH_SIZE) {
+                gen1.evaluate(begin, std::min(begin + pedsearch::search::SearchRange::BATCH_SIZE, rows), batch);
+                sink = sink + (int)batch.size();
+            }
+            return rows;
+        };
+        if (only.empty() || only == "search_gen1_batched") {
+            searchBatched();
+        }
+        run("search_gen1_batched", searchBatched);
+
+        run("has_pair", [&]() {
+            std::mt19937_64 rng(SEED);
+            std::uniform_int_distribution<size_t> stallionDist(0, tool.getNumDefaultStallions() - 1);
+            std::uniform_int_distribution<unsigned int> slotDist(1, 15);
+            const uint64_t n = 1000000;
+            uint64_t hits = 0;
+            for (uint64_t i = 0; i < n; i++) {
+                size_t s = tool.getDefaultStallion(stallionDist(rng)).getAncestorIndex(slotDist(rng));
+                size_t b = tool.getDefaultStallion(stallionDist(rng)).getAncestorIndex(slotDist(rng));
+                hits += tool.getElaboratedPairs().hasPair(s, b) ? 1 : 0;
+            }
+            sink = sink + (int)hits;
+            return n;
+        });
+
+        if (!baselinePath.empty()) {
+            printComparison(results, baselinePath);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
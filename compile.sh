@@ -1,4 +1,20 @@
 #!/bin/bash
 
+# PEDSEARCH_PROFILE=1 ./compile.sh で段階ごとの計測を有効にする
+FLAGS="-Isrc -I. -std=c++17 -O3 -Wall -Wextra -DNDEBUG -pthread"
+if [ -n "$PEDSEARCH_PROFILE" ]; then
+    FLAGS="$FLAGS -DPEDSEARCH_PROFILE"
+fi
+
 g++ src/search/PedigreeTool.cpp test/main.cpp\
-    -o pedtool -Isrc -I. -std=c++17 -O3 -Wall -Wextra -DNDEBUG
+    -o pedtool $FLAGS
+
+g++ src/search/PedigreeTool.cpp src/capi/pedsearch.cpp\
+    -o libpedsearch.so -shared -fPIC -fvisibility=hidden $FLAGS
+
+g++ src/search/PedigreeTool.cpp bench/main.cpp\
+    -o pedbench $FLAGS
+
+# 差分テストは最適化したままPEDSEARCH_ASSERTの検査を残す
+g++ src/search/PedigreeTool.cpp test/differential.cpp\
+    -o peddiff $FLAGS -DPEDSEARCH_CHECKED
@@ -3,19 +3,32 @@
 
 #include <cstdlib>
 #include <stdio.h>
+#include <string>
 
-#ifdef NDEBUG
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-    inline void assertPrint(bool x, std::string y) {}
-#pragma GCC diagnostic pop
+// PEDSEARCH_ASSERT(x, message): xがfalseならmessageを表示して終了する.
+// NDEBUGを定義したビルドではxもmessageも評価されない. PEDSEARCH_CHECKEDを定義すると
+// NDEBUGでも検査を残す(差分テストなど, 最適化したまま検査したい場合に使う).
+
+namespace pedsearch {
+namespace base {
+
+[[noreturn]] inline void assertFail(const char* file, int line, const std::string& message) {
+    printf("assert: %s (%s:%d)\n", message.data(), file, line);
+    exit(1);
+}
+
+}
+}
+
+#if !defined(NDEBUG) || defined(PEDSEARCH_CHECKED)
+#define PEDSEARCH_ASSERT(x, message) \
+    do { \
+        if (!(x)) { \
+            pedsearch::base::assertFail(__FILE__, __LINE__, std::string(message)); \
+        } \
+    } while (0)
 #else
-    inline void assertPrint(bool x, std::string y) {
-        if (!x) {
-            printf("assert: %s\n", y.data());
-            exit(1);
-        }
-    }
+#define PEDSEARCH_ASSERT(x, message) ((void)sizeof(!(x)))
 #endif
 
 #endif // BASE_DEBUG_H
@@ -1,6 +1,7 @@
 #ifndef BASE_DEFAULTSTALLION_H
 #define BASE_DEFAULTSTALLION_H
 
+#include <array>
 #include <set>
 #include <string>
 #include <vector>
@@ -15,7 +16,7 @@ private:
     unsigned int index_;
 public:
     Index(unsigned int index) : index_(index) {
-        assertPrint(
+        PEDSEARCH_ASSERT(
             index <= 15,
             "Index::Index: index must be lower than 16, but got " + std::to_string(index));
     }
@@ -100,23 +101,27 @@ public:
         return ancestors_[index];
     }
 
-    void appendInterestingIndices(std::set<unsigned int>& indices) const {
+    // SetはstdまたはpmrのSet<unsigned int>
+    template <class Set> void appendInterestingIndices(Set& indices) const {
         indices.insert(indices_[0]);
         indices.insert(indices_[2]);
         indices.insert(indices_[4]);
         indices.insert(indices_[6]);
     }
 
-    void appendWonderfulIndices(std::set<unsigned int>& indices) const {
+    template <class Set> void appendWonderfulIndices(Set& indices) const {
         indices.insert(indices_[1]);
         indices.insert(indices_[3]);
         indices.insert(indices_[5]);
         indices.insert(indices_[7]);
     }
 
-    std::vector<unsigned int> getInterestingIndices() const {
-        std::vector<unsigned int> indices = {indices_[0], indices_[2], indices_[4], indices_[6]};
-        return indices;
+    std::array<unsigned int, 4> getInterestingIndices() const {
+        return {indices_[0], indices_[2], indices_[4], indices_[6]};
+    }
+
+    std::array<unsigned int, 4> getWonderfulIndices() const {
+        return {indices_[1], indices_[3], indices_[5], indices_[7]};
     }
 
     unsigned int getFee() const { return fee_; }
@@ -170,20 +175,19 @@ public:
         fee_(fee), speed_(speed), stamina_(stamina), power_(power), dirt_(dirt) {}
 
     size_t getAncestorIndex(Index index) const {
-        assertPrint(index != Index(0), "DefaultStallion::getAncestorIndex: 0 is invalid for index.");
+        PEDSEARCH_ASSERT(index != Index(0), "DefaultStallion::getAncestorIndex: 0 is invalid for index.");
         return ancestors_[index];
     }
 
-    void appendInterestingIndices(std::set<unsigned int>& indices) const {
+    template <class Set> void appendInterestingIndices(Set& indices) const {
         indices.insert(indices_[0]);
         indices.insert(indices_[1]);
         indices.insert(indices_[2]);
         indices.insert(indices_[3]);
     }
 
-    std::vector<unsigned int> getInterestingIndices() const {
-        std::vector<unsigned int> indices = {indices_[0], indices_[1], indices_[2], indices_[3]};
-        return indices;
+    std::array<unsigned int, 4> getInterestingIndices() const {
+        return {indices_[0], indices_[1], indices_[2], indices_[3]};
     }
 
     unsigned int getFee() const { return fee_; }
@@ -19,7 +19,7 @@ public:
     ) : sire_{std::string(sire1), std::string(sire2),std::string(sire3), std::string(sire4)} {}
 
     std::string_view get(unsigned int generation) const {
-        assertPrint(
+        PEDSEARCH_ASSERT(
             generation <= 3,
             "Pedigree::get: generation must be lower than 4 but got " + std::to_string(generation)
         );
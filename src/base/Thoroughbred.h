@@ -22,7 +22,7 @@ public:
     }
 
     std::string_view getSireName(unsigned int generation) const {
-        assertPrint(
+        PEDSEARCH_ASSERT(
             pedigree_.get(generation) != "",
             "Thoroughbred::getSireName: " + name_ + "'s " + std::to_string(generation) + "th sire name is empty"
         );
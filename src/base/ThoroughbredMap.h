@@ -19,14 +19,14 @@ private:
 
 public:
     ThoroughbredMap() {
-        assertPrint(
+        PEDSEARCH_ASSERT(
             (bool)(std::is_base_of<Thoroughbred, T>::value),
             "ThoroughbredMap::ThoroughbredMap: not derived from Thoroughbred."
         );
     }
 
     const T& at(std::string_view name) const {
-        assertPrint(
+        PEDSEARCH_ASSERT(
             map_.find(name.data()) != map_.end(),
             "ThoroughbredMap::at: " + std::string(name) + " does not exist."
         );
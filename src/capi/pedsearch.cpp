@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+#include "capi/pedsearch.h"
+#include "search/PedigreeSearch.h"
+#include "search/PedigreeTool.h"
+
+static_assert(sizeof(pedsearch_result) == 32, "pedsearch_result must be 32 bytes.");
+
+struct pedsearch_tool {
+    pedsearch::search::PedigreeTool tool;
+
+    pedsearch_tool(const std::string& path) :
+        tool(
+            path,
+            "database/default_stallions.json",
+            "database/default_broodmares.json",
+            "database/stallions.json",
+            "database/elaborated.json"
+        ) {}
+};
+
+namespace {
+
+thread_local std::string lastError;
+
+int fail(int status, const std::string& message) {
+    lastError = message;
+    return status;
+}
+
+void convert(const pedsearch::search::SearchResult& result, pedsearch_result& out) {
+    std::memset(&out, 0, sizeof(out));
+    out.elaborated = result.isElaborated() ? 1 : 0;
+    out.interesting = result.isInteresting() ? 1 : 0;
+    out.wonderful = result.isWonderful() ? 1 : 0;
+    out.danger = result.isDanger() ? 1 : 0;
+    out.num_crosses = (uint8_t)result.getNumCrosses();
+    for (unsigned int i = 0; i < 11; i++) {
+        out.effects[i] = (uint8_t)result.getEffect(i);
+    }
+    out.speed_nitro = (int8_t)result.getSpeedNitro();
+    out.stamina_nitro = (int8_t)result.getStaminaNitro();
+    out.power_nitro = (int8_t)result.getPowerNitro();
+}
+
+}
+
+uint32_t pedsearch_abi_version(void) {
+    return PEDSEARCH_ABI_VERSION;
+}
+
+const char* pedsearch_last_error(void) {
+    return lastError.c_str();
+}
+
+int pedsearch_open(const char* root_dir, pedsearch_tool** tool) {
+    if (root_dir == nullptr || tool == nullptr) {
+        return fail(PEDSEARCH_ERROR_INVALID_ARGUMENT, "pedsearch_open: null argument.");
+    }
+    try {
+        // PedigreeToolは実行ファイルのパスを受け取りその親ディレクトリからデータベースを読む
+        *tool = new pedsearch_tool(std::string(root_dir) + "/pedsearch");
+        return PEDSEARCH_OK;
+    } catch (const std::exception& e) {
+        *tool = nullptr;
+        return fail(PEDSEARCH_ERROR_DATABASE, e.what());
+    }
+}
+
+void pedsearch_close(pedsearch_tool* tool) {
+    delete tool;
+}
+
+int pedsearch_load_roster(pedsearch_tool* tool, const char* path) {
+    if (tool == nullptr || path == nullptr) {
+        return fail(PEDSEARCH_ERROR_INVALID_ARGUMENT, "pedsearch_load_roster: null argument.");
+    }
+    try {
+        tool->tool.loadRoster(path);
+        return PEDSEARCH_OK;
+    } catch (const std::exception& e) {
+        return fail(PEDSEARCH_ERROR_DATABASE, e.what());
+    }
+}
+
+size_t pedsearch_num_stallions(const pedsearch_tool* tool) {
+    return tool == nullptr ? 0 : tool->tool.getNumDefaultStallions();
+}
+
+size_t pedsearch_num_broodmares(const pedsearch_tool* tool) {
+    return tool == nullptr ? 0 : tool->tool.getNumDefaultBroodmares();
+}
+
+const char* pedsearch_stallion_name(const pedsearch_tool* tool, uint32_t id) {
+    if (tool == nullptr || id >= tool->tool.getNumDefaultStallions()) {
+        return nullptr;
+    }
+    return tool->tool.getDefaultStallionName(id).data();
+}
+
+const char* pedsearch_broodmare_name(const pedsearch_tool* tool, uint32_t id) {
+    if (tool == nullptr || id >= tool->tool.getNumDefaultBroodmares()) {
+        return nullptr;
+    }
+    return tool->tool.getDefaultBroodmareName(id).data();
+}
+
+int pedsearch_find_stallion(const pedsearch_tool* tool, const char* name, uint32_t* id) {
+    if (tool == nullptr || name == nullptr || id == nullptr) {
+        return fail(PEDSEARCH_ERROR_INVALID_ARGUMENT, "pedsearch_find_stallion: null argument.");
+    }
+    size_t found;
+    if (!tool->tool.findDefaultStallion(name, found)) {
+        return fail(
+            PEDSEARCH_ERROR_INVALID_ARGUMENT,
+            "pedsearch_find_stallion: The stallion \"" + std::string(name) + "\" is unknown."
+        );
+    }
+    *id = (uint32_t)found;
+    return PEDSEARCH_OK;
+}
+
+int pedsearch_find_broodmare(const pedsearch_tool* tool, const char* name, uint32_t* id) {
+    if (tool == nullptr || name == nullptr || id == nullptr) {
+        return fail(PEDSEARCH_ERROR_INVALID_ARGUMENT, "pedsearch_find_broodmare: null argument.");
+    }
+    size_t found;
+    if (!tool->tool.findDefaultBroodmare(name, found)) {
+        return fail(
+            PEDSEARCH_ERROR_INVALID_ARGUMENT,
+            "pedsearch_find_broodmare: The broodmare \"" + std::string(name) + "\" is unknown."
+        );
+    }
+    *id = (uint32_t)found;
+    return PEDSEARCH_OK;
+}
+
+int pedsearch_analyze_batch(
+    const pedsearch_tool* tool, const uint32_t* stallion_ids, size_t n,
+    const uint32_t* broodmare_ids, size_t m, pedsearch_result* out
+) {
+    if (tool == nullptr || (n > 0 && stallion_ids == nullptr) || (m > 0 && broodmare_ids == nullptr)
+        || (n > 0 && m > 0 && out == nullptr)) {
+        return fail(PEDSEARCH_ERROR_INVALID_ARGUMENT, "pedsearch_analyze_batch: null argument.");
+    }
+    if (n == 0 || m == 0) {
+        return PEDSEARCH_OK;
+    }
+
+    try {
+        std::vector<std::vector<size_t> > candidates(2);
+        candidates[0].assign(stallion_ids, stallion_ids + n);
+        candidates[1].assign(broodmare_ids, broodmare_ids + m);
+        for (size_t id: candidates[0]) {
+            if (id >= tool->tool.getNumDefaultStallions()) {
+                return fail(
+                    PEDSEARCH_ERROR_INVALID_ARGUMENT,
+                    "pedsearch_analyze_batch: invalid stallion id " + std::to_string(id) + "."
+                );
+            }
+        }
+        for (size_t id: candidates[1]) {
+            if (id >= tool->tool.getNumDefaultBroodmares()) {
+                return fail(
+                    PEDSEARCH_ERROR_INVALID_ARGUMENT,
+                    "pedsearch_analyze_batch: invalid broodmare id " + std::to_string(id) + "."
+                );
+            }
+        }
+
+        // 行番号はi * m + jになるのでそのままoutの添字に使える
+        pedsearch::search::SearchEngine engine(tool->tool, pedsearch::search::SearchSpace(std::move(candidates)));
+        std::vector<pedsearch::search::SearchResult> batch;
+        batch.reserve(pedsearch::search::SearchRange::BATCH_SIZE);
+        uint64_t size = engine.getSpace().size();
+        for (uint64_t begin = 0; begin < size; begin += pedsearch::search::SearchRange::BATCH_SIZE) {
+            engine.evaluate(begin, std::min(begin + pedsearch::search::SearchRange::BATCH_SIZE, size), batch);
+            for (const pedsearch::search::SearchResult& result: batch) {
+                convert(result, out[result.getRow()]);
+            }
+        }
+        return PEDSEARCH_OK;
+    } catch (const std::exception& e) {
+        return fail(PEDSEARCH_ERROR_INTERNAL, e.what());
+    }
+}
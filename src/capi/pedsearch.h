@@ -0,0 +1,84 @@
+#ifndef CAPI_PEDSEARCH_H
+#define CAPI_PEDSEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define PEDSEARCH_API __declspec(dllexport)
+#else
+#define PEDSEARCH_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 構造体の配置や関数の意味を変更した場合に上げる */
+#define PEDSEARCH_ABI_VERSION 1
+
+#define PEDSEARCH_OK 0
+#define PEDSEARCH_ERROR_INVALID_ARGUMENT (-1)
+#define PEDSEARCH_ERROR_DATABASE (-2)
+#define PEDSEARCH_ERROR_INTERNAL (-3)
+
+typedef struct pedsearch_tool pedsearch_tool;
+
+/* 1配合分の分析結果. 大きさは32バイトで固定. */
+typedef struct pedsearch_result {
+    uint8_t elaborated;  /* 凝った配合 */
+    uint8_t interesting; /* 面白い配合 */
+    uint8_t wonderful;   /* 見事な配合 */
+    uint8_t danger;      /* 血量50%以上のクロス */
+    uint8_t num_crosses;
+    /* クロスの因子数: 短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワー */
+    uint8_t effects[11];
+    int8_t speed_nitro;
+    int8_t stamina_nitro;
+    int8_t power_nitro;
+    uint8_t reserved[13];
+} pedsearch_result;
+
+PEDSEARCH_API uint32_t pedsearch_abi_version(void);
+
+/* 直前に失敗した呼び出しのエラーメッセージ(スレッドごと). */
+PEDSEARCH_API const char* pedsearch_last_error(void);
+
+/* root_dirはdatabase/を含むディレクトリ. */
+PEDSEARCH_API int pedsearch_open(const char* root_dir, pedsearch_tool** tool);
+
+PEDSEARCH_API void pedsearch_close(pedsearch_tool* tool);
+
+/*
+ * 自分の馬の一覧(ロスター)を読み, idの後ろに追加する. 前に読んだロスターは置き換える.
+ * 他のスレッドがtoolを使っている間に呼んではいけない. 以前に得た名前の文字列は無効になる.
+ */
+PEDSEARCH_API int pedsearch_load_roster(pedsearch_tool* tool, const char* path);
+
+PEDSEARCH_API size_t pedsearch_num_stallions(const pedsearch_tool* tool);
+
+PEDSEARCH_API size_t pedsearch_num_broodmares(const pedsearch_tool* tool);
+
+/* idが範囲外の場合はNULL. 文字列はtoolを閉じるかロスターを読むまで有効. */
+PEDSEARCH_API const char* pedsearch_stallion_name(const pedsearch_tool* tool, uint32_t id);
+
+PEDSEARCH_API const char* pedsearch_broodmare_name(const pedsearch_tool* tool, uint32_t id);
+
+PEDSEARCH_API int pedsearch_find_stallion(const pedsearch_tool* tool, const char* name, uint32_t* id);
+
+PEDSEARCH_API int pedsearch_find_broodmare(const pedsearch_tool* tool, const char* name, uint32_t* id);
+
+/*
+ * stallion_ids[i] x broodmare_ids[j]の結果をout[i * m + j]に書き込む.
+ * outは呼び出し側がn * m要素分確保する.
+ */
+PEDSEARCH_API int pedsearch_analyze_batch(
+    const pedsearch_tool* tool, const uint32_t* stallion_ids, size_t n,
+    const uint32_t* broodmare_ids, size_t m, pedsearch_result* out
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAPI_PEDSEARCH_H */
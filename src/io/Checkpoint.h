@@ -0,0 +1,170 @@
+#ifndef IO_CHECKPOINT_H
+#define IO_CHECKPOINT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "extra/json.hpp"
+
+namespace pedsearch {
+namespace io {
+
+// 64bit FNV-1a
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+inline uint64_t fnv1a(uint64_t hash, const char* data, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// 書き込んだバイト数とFNV-1aを数えながら別のstreambufへ渡す.
+// getBytes, getChecksumはflushした後に呼ぶこと.
+class ChecksumBuffer : public std::streambuf {
+private:
+    std::streambuf* target_;
+    std::vector<char> buffer_;
+    uint64_t bytes_;
+    uint64_t checksum_;
+
+    bool drain() {
+        std::streamsize n = pptr() - pbase();
+        checksum_ = fnv1a(checksum_, pbase(), (size_t)n);
+        if (target_->sputn(pbase(), n) != n) {
+            return false;
+        }
+        bytes_ += (uint64_t)n;
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+        return true;
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!drain()) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        return (drain() && target_->pubsync() == 0) ? 0 : -1;
+    }
+
+public:
+    // 既にbytesバイト書かれたファイルに追記する場合はその分のchecksumを渡す
+    ChecksumBuffer(std::streambuf* target, uint64_t bytes=0, uint64_t checksum=FNV_OFFSET) :
+        target_(target), buffer_(1 << 16), bytes_(bytes), checksum_(checksum) {
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    ~ChecksumBuffer() {
+        sync();
+    }
+
+    uint64_t getBytes() const {
+        return bytes_;
+    }
+
+    uint64_t getChecksum() const {
+        return checksum_;
+    }
+};
+
+// 長い探索の途中経過. 行は順に出力されるので, 終わった範囲は常に先頭からの行数で表せる.
+// 出力ファイルの先頭outputBytesバイトがchecksumと一致すれば, そこで切り詰めてcompletedRows行目から再開できる.
+struct Checkpoint {
+    std::vector<std::string> names;
+    std::string filter;
+    std::string format;
+    std::string shard;
+    uint64_t totalRows = 0;
+    uint64_t completedRows = 0;
+    uint64_t outputBytes = 0;
+    uint64_t checksum = FNV_OFFSET;
+    bool finished = false;
+
+    // 同じ探索の途中経過か
+    bool isSameSearch(const Checkpoint& checkpoint) const {
+        return names == checkpoint.names && filter == checkpoint.filter
+            && format == checkpoint.format && shard == checkpoint.shard && totalRows == checkpoint.totalRows;
+    }
+
+    // 一時ファイルに書いてから置き換えるので, 途中で止まっても前の途中経過が残る
+    void save(const std::string& path) const {
+        std::ostringstream hex;
+        hex << std::hex << std::setw(16) << std::setfill('0') << checksum;
+        nlohmann::json json = {
+            {"query", names},
+            {"filter", filter},
+            {"format", format},
+            {"shard", shard},
+            {"total_rows", totalRows},
+            {"completed_rows", completedRows},
+            {"output_bytes", outputBytes},
+            {"checksum", hex.str()},
+            {"finished", finished}
+        };
+
+        std::string temporary = path + ".tmp";
+        std::ofstream file(temporary, std::ios::trunc);
+        file << json.dump() << std::endl;
+        file.close();
+        if (!file || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Checkpoint::save: cannot write " + path + ".");
+        }
+    }
+
+    static Checkpoint load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            throw std::runtime_error("Checkpoint::load: cannot open " + path + ".");
+        }
+        Checkpoint checkpoint;
+        try {
+            nlohmann::json json = nlohmann::json::parse(file);
+            checkpoint.names = json.at("query").get<std::vector<std::string> >();
+            checkpoint.filter = json.at("filter").get<std::string>();
+            checkpoint.format = json.at("format").get<std::string>();
+            checkpoint.shard = json.value("shard", "");
+            checkpoint.totalRows = json.at("total_rows").get<uint64_t>();
+            checkpoint.completedRows = json.at("completed_rows").get<uint64_t>();
+            checkpoint.outputBytes = json.at("output_bytes").get<uint64_t>();
+            checkpoint.checksum = std::stoull(json.at("checksum").get<std::string>(), nullptr, 16);
+            checkpoint.finished = json.at("finished").get<bool>();
+        } catch (std::exception&) {
+            throw std::runtime_error("Checkpoint::load: invalid checkpoint " + path + ".");
+        }
+        return checkpoint;
+    }
+
+    // 出力ファイルの先頭outputBytesバイトが途中経過を書いたときのままか
+    bool verify(const std::string& path) const {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<char> buffer(1 << 16);
+        uint64_t hash = FNV_OFFSET;
+        uint64_t rest = outputBytes;
+        while (rest > 0 && file) {
+            file.read(buffer.data(), (std::streamsize)std::min<uint64_t>(rest, buffer.size()));
+            hash = fnv1a(hash, buffer.data(), (size_t)file.gcount());
+            rest -= (uint64_t)file.gcount();
+        }
+        return rest == 0 && hash == checksum;
+    }
+};
+
+}
+}
+
+#endif // IO_CHECKPOINT_H
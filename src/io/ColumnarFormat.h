@@ -0,0 +1,501 @@
+#ifndef IO_COLUMNARFORMAT_H
+#define IO_COLUMNARFORMAT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "io/ResultWriter.h"
+#include "search/PedigreeTool.h"
+#include "search/Profiler.h"
+#include "search/SearchQuery.h"
+#include "search/SearchResult.h"
+
+// 探索結果の列指向バイナリ形式(リトルエンディアン).
+//
+// ファイルヘッダ:
+//   "PEDCOL\0\0", uint32 version, uint32 generation, uint32 rowGroupSize, uint32 0
+//   位置0..generationごとに uint32 件数, 件数 x (uint16 長さ, 名前, uint64 内容のハッシュ) の辞書. 8バイト境界まで0埋め.
+//   内容のハッシュはPedigreeTool::getDefaultStallionHash/getDefaultBroodmareHash. version 1には無い.
+// 行グループ(ファイル末尾まで繰り返す):
+//   "RGRP", uint32 行数n, uint64 データ部のバイト数
+//   列ごとに int32 min, int32 max (列の並びはColumnを参照)
+//   データ部: フラグ4列のビットマップ(各ceil(n/64)*8バイト), 位置ごとの辞書番号(uint16 x n),
+//             クロス数(uint8 x n), 因子11列(uint8 x n), ニトロ3列(int8 x n), 8バイト境界まで0埋め
+
+namespace pedsearch {
+namespace io {
+
+class ColumnarFormat {
+public:
+    static constexpr char MAGIC[8] = {'P', 'E', 'D', 'C', 'O', 'L', '\0', '\0'};
+    static constexpr char ROW_GROUP_MAGIC[4] = {'R', 'G', 'R', 'P'};
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint32_t ROW_GROUP_SIZE = 65536;
+
+    // 統計の列番号. 位置ごとの辞書番号の列はCHAIN + 位置
+    enum Column {
+        ELABORATED = 0, INTERESTING = 1, WONDERFUL = 2, DANGER = 3, NUM_FLAGS = 4,
+        CROSSES = 4, EFFECTS = 5, SPEED_NITRO = 16, STAMINA_NITRO = 17, POWER_NITRO = 18, CHAIN = 19
+    };
+
+    static unsigned int getNumColumns(unsigned int generation) {
+        return CHAIN + generation + 1;
+    }
+
+    static size_t getBitmapBytes(size_t numRows) {
+        return (numRows + 63) / 64 * 8;
+    }
+
+    static size_t getDataBytes(size_t numRows, unsigned int generation) {
+        size_t bytes = NUM_FLAGS * getBitmapBytes(numRows) + (generation + 1) * numRows * sizeof(uint16_t)
+            + numRows * (1 + 11 + 3);
+        return (bytes + 7) / 8 * 8;
+    }
+};
+
+class ColumnarWriter : public ResultWriter {
+private:
+    std::ostream& ostream_;
+    const unsigned int generation_;
+    // デフォルト種牡馬/繁殖牝馬のidから位置ごとの辞書番号への変換
+    std::vector<std::vector<uint16_t> > dictionaryIndex_;
+
+    size_t numRows_;
+    std::vector<uint64_t> flags_[ColumnarFormat::NUM_FLAGS];
+    std::vector<std::vector<uint16_t> > chain_;
+    std::vector<uint8_t> crosses_;
+    std::vector<uint8_t> effects_[11];
+    std::vector<int8_t> nitro_[3];
+    std::vector<int32_t> min_;
+    std::vector<int32_t> max_;
+
+    template <class T> void put(const T& value) {
+        ostream_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class T> void putArray(const T* values, size_t n) {
+        ostream_.write(reinterpret_cast<const char*>(values), sizeof(T) * n);
+    }
+
+    void pad(size_t bytes) {
+        static const char zeros[8] = {};
+        if (bytes % 8 != 0) {
+            ostream_.write(zeros, 8 - bytes % 8);
+        }
+    }
+
+    void update(unsigned int column, int32_t value) {
+        min_[column] = std::min(min_[column], value);
+        max_[column] = std::max(max_[column], value);
+    }
+
+    void writeRowGroup() {
+        if (numRows_ == 0) {
+            return;
+        }
+        size_t words = (numRows_ + 63) / 64;
+        put(ColumnarFormat::ROW_GROUP_MAGIC);
+        put((uint32_t)numRows_);
+        put((uint64_t)ColumnarFormat::getDataBytes(numRows_, generation_));
+        for (unsigned int i = 0; i < ColumnarFormat::getNumColumns(generation_); i++) {
+            put(min_[i]);
+            put(max_[i]);
+        }
+
+        size_t bytes = 0;
+        for (unsigned int i = 0; i < ColumnarFormat::NUM_FLAGS; i++) {
+            putArray(flags_[i].data(), words);
+            bytes += words * sizeof(uint64_t);
+        }
+        for (unsigned int i = 0; i <= generation_; i++) {
+            putArray(chain_[i].data(), numRows_);
+            bytes += numRows_ * sizeof(uint16_t);
+        }
+        putArray(crosses_.data(), numRows_);
+        for (unsigned int i = 0; i < 11; i++) {
+            putArray(effects_[i].data(), numRows_);
+        }
+        for (unsigned int i = 0; i < 3; i++) {
+            putArray(nitro_[i].data(), numRows_);
+        }
+        bytes += numRows_ * (1 + 11 + 3);
+        pad(bytes);
+
+        reset();
+    }
+
+    void reset() {
+        numRows_ = 0;
+        for (unsigned int i = 0; i < ColumnarFormat::NUM_FLAGS; i++) {
+            std::fill(flags_[i].begin(), flags_[i].end(), 0);
+        }
+        std::fill(min_.begin(), min_.end(), INT32_MAX);
+        std::fill(max_.begin(), max_.end(), INT32_MIN);
+    }
+
+public:
+    // headerがfalseなら見出しと辞書を書かない. 途中まで書いたファイルに行グループを追記するときに使う.
+    ColumnarWriter(
+        std::ostream& ostream, const search::PedigreeTool& tool, const search::SearchSpace& space, bool header=true
+    ) : ostream_(ostream), generation_(space.getGeneration()), numRows_(0) {
+        const uint32_t rowGroupSize = ColumnarFormat::ROW_GROUP_SIZE;
+        if (header) {
+            put(ColumnarFormat::MAGIC);
+            put(ColumnarFormat::VERSION);
+            put((uint32_t)generation_);
+            put(rowGroupSize);
+            put((uint32_t)0);
+        }
+
+        size_t bytes = 0;
+        dictionaryIndex_.resize(generation_ + 1);
+        for (unsigned int i = 0; i <= generation_; i++) {
+            const std::vector<size_t>& candidates = space.getCandidates(i);
+            if (candidates.size() > UINT16_MAX) {
+                throw std::runtime_error("ColumnarWriter::ColumnarWriter: too many candidates.");
+            }
+            if (header) {
+                put((uint32_t)candidates.size());
+            }
+            bytes += sizeof(uint32_t);
+            for (size_t j = 0; j < candidates.size(); j++) {
+                std::string_view name = (i < generation_) ?
+                    tool.getDefaultStallionName(candidates[j]) : tool.getDefaultBroodmareName(candidates[j]);
+                uint64_t hash = (i < generation_) ?
+                    tool.getDefaultStallionHash(candidates[j]) : tool.getDefaultBroodmareHash(candidates[j]);
+                if (header) {
+                    put((uint16_t)name.size());
+                    ostream_.write(name.data(), name.size());
+                    put(hash);
+                }
+                bytes += sizeof(uint16_t) + name.size() + sizeof(uint64_t);
+
+                if (dictionaryIndex_[i].size() <= candidates[j]) {
+                    dictionaryIndex_[i].resize(candidates[j] + 1, 0);
+                }
+                dictionaryIndex_[i][candidates[j]] = (uint16_t)j;
+            }
+        }
+        if (header) {
+            pad(bytes);
+        }
+
+        for (unsigned int i = 0; i < ColumnarFormat::NUM_FLAGS; i++) {
+            flags_[i].resize(rowGroupSize / 64, 0);
+        }
+        chain_.resize(generation_ + 1);
+        for (unsigned int i = 0; i <= generation_; i++) {
+            chain_[i].resize(rowGroupSize);
+        }
+        crosses_.resize(rowGroupSize);
+        for (unsigned int i = 0; i < 11; i++) {
+            effects_[i].resize(rowGroupSize);
+        }
+        for (unsigned int i = 0; i < 3; i++) {
+            nitro_[i].resize(rowGroupSize);
+        }
+        min_.resize(ColumnarFormat::getNumColumns(generation_));
+        max_.resize(ColumnarFormat::getNumColumns(generation_));
+        reset();
+    }
+
+    void write(const search::SearchResult& result) override {
+        PEDSEARCH_PROFILE_STAGE(OUTPUT);
+        const size_t n = numRows_;
+        const bool flags[ColumnarFormat::NUM_FLAGS] = {
+            result.isElaborated(), result.isInteresting(), result.isWonderful(), result.isDanger()
+        };
+        for (unsigned int i = 0; i < ColumnarFormat::NUM_FLAGS; i++) {
+            if (flags[i]) {
+                flags_[i][n / 64] |= (uint64_t)1 << (n % 64);
+            }
+            update(i, flags[i] ? 1 : 0);
+        }
+        for (unsigned int i = 0; i <= generation_; i++) {
+            chain_[i][n] = dictionaryIndex_[i][result.getChain(i)];
+            update(ColumnarFormat::CHAIN + i, chain_[i][n]);
+        }
+        crosses_[n] = (uint8_t)result.getNumCrosses();
+        update(ColumnarFormat::CROSSES, crosses_[n]);
+        for (unsigned int i = 0; i < 11; i++) {
+            effects_[i][n] = (uint8_t)result.getEffect(i);
+            update(ColumnarFormat::EFFECTS + i, effects_[i][n]);
+        }
+        nitro_[0][n] = (int8_t)result.getSpeedNitro();
+        nitro_[1][n] = (int8_t)result.getStaminaNitro();
+        nitro_[2][n] = (int8_t)result.getPowerNitro();
+        for (unsigned int i = 0; i < 3; i++) {
+            update(ColumnarFormat::SPEED_NITRO + i, nitro_[i][n]);
+        }
+
+        numRows_++;
+        if (numRows_ == ColumnarFormat::ROW_GROUP_SIZE) {
+            writeRowGroup();
+        }
+    }
+
+    void writeBatch(const std::vector<search::SearchResult>& batch) override {
+        for (const search::SearchResult& result: batch) {
+            ColumnarWriter::write(result);
+        }
+    }
+
+    // 書きかけの行を行数の少ない行グループとして書き出す
+    void flush() override {
+        writeRowGroup();
+        ostream_.flush();
+    }
+
+    void finish() override {
+        flush();
+    }
+};
+
+// 行グループ内の列への参照
+class RowGroup {
+private:
+    friend class ColumnarReader;
+    size_t numRows_;
+    unsigned int generation_;
+    const int32_t* stats_;
+    const uint64_t* flags_[ColumnarFormat::NUM_FLAGS];
+    const uint16_t* chain_[search::SearchQuery::MAX_GENERATION + 1];
+    const uint8_t* crosses_;
+    const uint8_t* effects_[11];
+    const int8_t* nitro_[3];
+
+public:
+    size_t getNumRows() const { return numRows_; }
+    size_t getNumWords() const { return (numRows_ + 63) / 64; }
+    int32_t getMin(unsigned int column) const { return stats_[2 * column]; }
+    int32_t getMax(unsigned int column) const { return stats_[2 * column + 1]; }
+    const uint64_t* getFlags(unsigned int flag) const { return flags_[flag]; }
+
+    bool getFlag(unsigned int flag, size_t row) const {
+        return (flags_[flag][row / 64] >> (row % 64)) & 1;
+    }
+
+    size_t getChain(unsigned int position, size_t row) const { return chain_[position][row]; }
+    unsigned int getNumCrosses(size_t row) const { return crosses_[row]; }
+    unsigned int getEffect(unsigned int effect, size_t row) const { return effects_[effect][row]; }
+    int getNitro(unsigned int nitro, size_t row) const { return nitro_[nitro][row]; }
+};
+
+// RowGroupの1行. SearchResultと同じ名前で値を返す.
+class ColumnarRow {
+private:
+    const RowGroup& group_;
+    size_t row_;
+
+public:
+    ColumnarRow(const RowGroup& group, size_t row) : group_(group), row_(row) {}
+
+    size_t getChain(unsigned int position) const { return group_.getChain(position, row_); }
+    bool isElaborated() const { return group_.getFlag(ColumnarFormat::ELABORATED, row_); }
+    bool isInteresting() const { return group_.getFlag(ColumnarFormat::INTERESTING, row_); }
+    bool isWonderful() const { return group_.getFlag(ColumnarFormat::WONDERFUL, row_); }
+    bool isDanger() const { return group_.getFlag(ColumnarFormat::DANGER, row_); }
+    unsigned int getNumCrosses() const { return group_.getNumCrosses(row_); }
+    unsigned int getEffect(unsigned int effect) const { return group_.getEffect(effect, row_); }
+    int getSpeedNitro() const { return group_.getNitro(0, row_); }
+    int getStaminaNitro() const { return group_.getNitro(1, row_); }
+    int getPowerNitro() const { return group_.getNitro(2, row_); }
+};
+
+// ファイルをmmapして行グループを順に読む
+class ColumnarReader {
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t offset_;
+    size_t firstRowGroup_;
+    uint32_t version_;
+    unsigned int generation_;
+    uint32_t rowGroupSize_;
+    std::vector<std::vector<std::string> > dictionaries_;
+    std::vector<std::vector<uint64_t> > hashes_;
+
+    template <class T> T get() {
+        if (offset_ + sizeof(T) > size_) {
+            throw std::runtime_error("ColumnarReader: unexpected end of file.");
+        }
+        T value;
+        std::memcpy(&value, data_ + offset_, sizeof(T));
+        offset_ += sizeof(T);
+        return value;
+    }
+
+public:
+    ColumnarReader(std::string_view path) : data_(nullptr), size_(0), offset_(0) {
+        int fd = open(std::string(path).c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("ColumnarReader: cannot open " + std::string(path) + ".");
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("ColumnarReader: cannot stat " + std::string(path) + ".");
+        }
+        size_ = (size_t)st.st_size;
+        if (size_ > 0) {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("ColumnarReader: cannot map " + std::string(path) + ".");
+            }
+            data_ = static_cast<const uint8_t*>(p);
+            madvise(p, size_, MADV_SEQUENTIAL);
+        }
+        close(fd);
+
+        try {
+            if (size_ < sizeof(ColumnarFormat::MAGIC)
+                || std::memcmp(data_, ColumnarFormat::MAGIC, sizeof(ColumnarFormat::MAGIC)) != 0) {
+                throw std::runtime_error("ColumnarReader: " + std::string(path) + " is not a result file.");
+            }
+            offset_ = sizeof(ColumnarFormat::MAGIC);
+            version_ = get<uint32_t>();
+            if (version_ == 0 || version_ > ColumnarFormat::VERSION) {
+                throw std::runtime_error("ColumnarReader: unsupported version " + std::to_string(version_) + ".");
+            }
+            generation_ = get<uint32_t>();
+            if (generation_ == 0 || generation_ > search::SearchQuery::MAX_GENERATION) {
+                throw std::runtime_error("ColumnarReader: invalid generation " + std::to_string(generation_) + ".");
+            }
+            rowGroupSize_ = get<uint32_t>();
+            get<uint32_t>();
+
+            size_t start = offset_;
+            dictionaries_.resize(generation_ + 1);
+            hashes_.resize(generation_ + 1);
+            for (unsigned int i = 0; i <= generation_; i++) {
+                uint32_t count = get<uint32_t>();
+                for (uint32_t j = 0; j < count; j++) {
+                    uint16_t length = get<uint16_t>();
+                    if (offset_ + length > size_) {
+                        throw std::runtime_error("ColumnarReader: unexpected end of file.");
+                    }
+                    dictionaries_[i].push_back(std::string(reinterpret_cast<const char*>(data_ + offset_), length));
+                    offset_ += length;
+                    if (version_ >= 2) {
+                        hashes_[i].push_back(get<uint64_t>());
+                    }
+                }
+            }
+            offset_ += (8 - (offset_ - start) % 8) % 8;
+            firstRowGroup_ = offset_;
+        } catch (...) {
+            if (data_ != nullptr) {
+                munmap(const_cast<uint8_t*>(data_), size_);
+            }
+            throw;
+        }
+    }
+
+    ColumnarReader(const ColumnarReader&) = delete;
+    ColumnarReader& operator=(const ColumnarReader&) = delete;
+
+    ~ColumnarReader() {
+        if (data_ != nullptr) {
+            munmap(const_cast<uint8_t*>(data_), size_);
+        }
+    }
+
+    uint32_t getVersion() const {
+        return version_;
+    }
+
+    unsigned int getGeneration() const {
+        return generation_;
+    }
+
+    uint32_t getRowGroupSize() const {
+        return rowGroupSize_;
+    }
+
+    const std::vector<std::string>& getDictionary(unsigned int position) const {
+        return dictionaries_[position];
+    }
+
+    // 辞書の各馬の内容のハッシュ. version 1のファイルでは空.
+    const std::vector<uint64_t>& getContentHashes(unsigned int position) const {
+        return hashes_[position];
+    }
+
+    // 最初の行グループの位置. 見出しと辞書はこれより前にある.
+    size_t getFirstRowGroupOffset() const {
+        return firstRowGroup_;
+    }
+
+    void rewind() {
+        offset_ = firstRowGroup_;
+    }
+
+    // 次の行グループを読む. skipがtrueを返す行グループはデータ部を読まずに飛ばす.
+    template <class Skip> bool next(RowGroup& group, const Skip& skip) {
+        while (offset_ < size_) {
+            if (size_ - offset_ < 16
+                || std::memcmp(data_ + offset_, ColumnarFormat::ROW_GROUP_MAGIC, 4) != 0) {
+                throw std::runtime_error("ColumnarReader: broken row group.");
+            }
+            offset_ += 4;
+            uint32_t numRows = get<uint32_t>();
+            uint64_t dataBytes = get<uint64_t>();
+            size_t statsBytes = 2 * sizeof(int32_t) * ColumnarFormat::getNumColumns(generation_);
+            if (dataBytes != ColumnarFormat::getDataBytes(numRows, generation_)
+                || offset_ + statsBytes + dataBytes > size_) {
+                throw std::runtime_error("ColumnarReader: broken row group.");
+            }
+
+            group.numRows_ = numRows;
+            group.generation_ = generation_;
+            group.stats_ = reinterpret_cast<const int32_t*>(data_ + offset_);
+            offset_ += statsBytes;
+            const uint8_t* p = data_ + offset_;
+            offset_ += dataBytes;
+            if (skip(group)) {
+                continue;
+            }
+
+            size_t bitmapBytes = ColumnarFormat::getBitmapBytes(numRows);
+            for (unsigned int i = 0; i < ColumnarFormat::NUM_FLAGS; i++) {
+                group.flags_[i] = reinterpret_cast<const uint64_t*>(p);
+                p += bitmapBytes;
+            }
+            for (unsigned int i = 0; i <= generation_; i++) {
+                group.chain_[i] = reinterpret_cast<const uint16_t*>(p);
+                p += numRows * sizeof(uint16_t);
+            }
+            group.crosses_ = p;
+            p += numRows;
+            for (unsigned int i = 0; i < 11; i++) {
+                group.effects_[i] = p;
+                p += numRows;
+            }
+            for (unsigned int i = 0; i < 3; i++) {
+                group.nitro_[i] = reinterpret_cast<const int8_t*>(p);
+                p += numRows;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    bool next(RowGroup& group) {
+        return next(group, [](const RowGroup&) { return false; });
+    }
+};
+
+}
+}
+
+#endif // IO_COLUMNARFORMAT_H
@@ -0,0 +1,96 @@
+#ifndef IO_CSVWRITER_H
+#define IO_CSVWRITER_H
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "search/PedigreeSearch.h"
+#include "search/PedigreeTool.h"
+#include "search/Profiler.h"
+#include "io/ResultWriter.h"
+
+namespace pedsearch {
+namespace io {
+
+// 鎖の位置の見出し: 父,母父,母母父,...,母母...母
+inline std::string getPositionName(unsigned int generation, unsigned int position) {
+    if (position == 0) {
+        return "父";
+    }
+    std::string name;
+    for (unsigned int j = 0; j < position; j++) {
+        name += "母";
+    }
+    if (position < generation) {
+        name += "父";
+    }
+    return name;
+}
+
+// 父,母父,母母父,...,母母...母,凝った,面白,見事,危険,短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワー,SP,ST,PW
+inline void writeCsvHeader(std::ostream& ostream, unsigned int generation) {
+    for (unsigned int i = 0; i <= generation; i++) {
+        ostream << getPositionName(generation, i) << ",";
+    }
+    ostream << "凝った,面白,見事,危険,短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワー,SP,ST,PW\n";
+}
+
+// 名前の後ろに続く分析結果の列. RowはSearchResultと同じ名前の取得関数を持つ型.
+template <class Row> void writeCsvColumns(std::ostream& ostream, const Row& row) {
+    ostream << (row.isElaborated() ? "1," : "0,");
+    ostream << (row.isInteresting() ? "1," : "0,");
+    ostream << (row.isWonderful() ? "1," : "0,");
+    ostream << (row.isDanger() ? "1," : "0,");
+    for (unsigned int i = 0; i < 11; i++) {
+        ostream << row.getEffect(i) << ",";
+    }
+    ostream << row.getSpeedNitro() << ",";
+    ostream << row.getStaminaNitro() << ",";
+    ostream << row.getPowerNitro() << "\n";
+}
+
+class CsvWriter : public ResultWriter {
+private:
+    std::ostream& ostream_;
+    const search::PedigreeTool& tool_;
+    const unsigned int generation_;
+
+public:
+    // headerがfalseなら見出しを書かない(途中から追記する場合)
+    CsvWriter(
+        std::ostream& ostream, const search::PedigreeTool& tool, const search::SearchSpace& space, bool header=true
+    ) : ostream_(ostream), tool_(tool), generation_(space.getGeneration()) {
+        if (header) {
+            writeCsvHeader(ostream_, generation_);
+        }
+    }
+
+    void write(const search::SearchResult& result) override {
+        PEDSEARCH_PROFILE_STAGE(OUTPUT);
+        for (unsigned int i = 0; i < generation_; i++) {
+            ostream_ << tool_.getDefaultStallionName(result.getChain(i)) << ",";
+        }
+        ostream_ << tool_.getDefaultBroodmareName(result.getChain(generation_)) << ",";
+        writeCsvColumns(ostream_, result);
+    }
+
+    void writeBatch(const std::vector<search::SearchResult>& batch) override {
+        for (const search::SearchResult& result: batch) {
+            CsvWriter::write(result);
+        }
+    }
+
+    void flush() override {
+        ostream_.flush();
+    }
+
+    void finish() override {
+        flush();
+    }
+};
+
+}
+}
+
+#endif // IO_CSVWRITER_H
@@ -0,0 +1,120 @@
+#ifndef IO_DATABASEWATCHER_H
+#define IO_DATABASEWATCHER_H
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace pedsearch {
+namespace io {
+
+// ファイルの変更をinotifyで監視し, 別のスレッドでreloadを呼ぶ.
+// エディタは一時ファイルからの名前の変更で保存することがあるので, ファイルではなくそれを含むディレクトリを監視する.
+// 保存は複数のイベントになるので, 最後のイベントからQUIET_MS何も起きなくなってから1度だけ呼ぶ.
+class DatabaseWatcher {
+private:
+    int inotify_;
+    int wake_[2]; // デストラクタから監視のスレッドを起こすパイプ
+    std::map<int, std::set<std::string> > names_; // 監視の番号 -> そのディレクトリで監視するファイル名
+    std::function<void()> reload_;
+    std::thread thread_;
+
+    // 監視するファイルが変わったか
+    bool consume() {
+        alignas(inotify_event) char buffer[4096];
+        bool changed = false;
+        ssize_t n = 0;
+        while ((n = read(inotify_, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + n; ) {
+                const inotify_event* event = (const inotify_event*)p;
+                auto it = names_.find(event->wd);
+                if (event->len > 0 && it != names_.end() && it->second.count(event->name) > 0) {
+                    changed = true;
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        return changed;
+    }
+
+    void run() {
+        pollfd fds[2] = {{inotify_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+        bool pending = false;
+        while (true) {
+            int ready = poll(fds, 2, pending ? QUIET_MS : -1);
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready < 0 || (fds[1].revents & POLLIN)) {
+                return;
+            }
+            if (ready == 0) {
+                pending = false;
+                reload_();
+                continue;
+            }
+            if (consume()) {
+                pending = true;
+            }
+        }
+    }
+
+public:
+    static constexpr int QUIET_MS = 200;
+
+    // reloadは監視のスレッドで呼ばれるので, 例外を外に出さないこと
+    DatabaseWatcher(const std::vector<std::string>& paths, std::function<void()> reload) :
+        inotify_(-1), wake_{-1, -1}, reload_(std::move(reload)) {
+        inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_ < 0) {
+            throw std::runtime_error("DatabaseWatcher::DatabaseWatcher: " + std::string(std::strerror(errno)) + ".");
+        }
+        for (const std::string& path: paths) {
+            size_t slash = path.rfind('/');
+            std::string directory = (slash == std::string::npos) ? "." : path.substr(0, slash);
+            std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+            int wd = inotify_add_watch(
+                inotify_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE
+            );
+            if (wd < 0) {
+                std::string message = std::strerror(errno);
+                close(inotify_);
+                throw std::runtime_error("DatabaseWatcher::DatabaseWatcher: cannot watch " + directory + ": " + message + ".");
+            }
+            names_[wd].insert(name);
+        }
+        if (pipe(wake_) != 0) {
+            close(inotify_);
+            throw std::runtime_error("DatabaseWatcher::DatabaseWatcher: " + std::string(std::strerror(errno)) + ".");
+        }
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    DatabaseWatcher(const DatabaseWatcher&) = delete;
+    DatabaseWatcher& operator=(const DatabaseWatcher&) = delete;
+
+    ~DatabaseWatcher() {
+        // 空のパイプへの1バイトの書き込みは失敗しない
+        char c = 0;
+        while (write(wake_[1], &c, 1) < 0 && errno == EINTR) {
+        }
+        thread_.join();
+        close(wake_[0]);
+        close(wake_[1]);
+        close(inotify_);
+    }
+};
+
+}
+}
+
+#endif // IO_DATABASEWATCHER_H
@@ -0,0 +1,306 @@
+#ifndef IO_QUERYSERVER_H
+#define IO_QUERYSERVER_H
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "io/CsvWriter.h"
+#include "search/PedigreeSearch.h"
+#include "search/ResultCache.h"
+#include "search/ResultField.h"
+#include "search/SearchQuery.h"
+#include "search/Snapshot.h"
+#include "search/TopResults.h"
+
+namespace pedsearch {
+namespace io {
+
+// ソケットの読み書き. 相手が切断してもSIGPIPEで終了せず, 書き込みが失敗するだけにする.
+class SocketBuffer : public std::streambuf {
+private:
+    int fd_;
+    std::vector<char> input_;
+    std::vector<char> output_;
+
+    bool drain() {
+        const char* p = pbase();
+        while (p < pptr()) {
+            ssize_t n = send(fd_, p, pptr() - p, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+        }
+        setp(output_.data(), output_.data() + output_.size());
+        return true;
+    }
+
+protected:
+    int_type underflow() override {
+        ssize_t n = 0;
+        do {
+            n = recv(fd_, input_.data(), input_.size(), 0);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            return traits_type::eof();
+        }
+        setg(input_.data(), input_.data(), input_.data() + n);
+        return traits_type::to_int_type(input_[0]);
+    }
+
+    int_type overflow(int_type c) override {
+        if (!drain()) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        return drain() ? 0 : -1;
+    }
+
+public:
+    explicit SocketBuffer(int fd) : fd_(fd), input_(1 << 12), output_(1 << 16) {
+        setg(input_.data(), input_.data(), input_.data());
+        setp(output_.data(), output_.data() + output_.size());
+    }
+
+    ~SocketBuffer() {
+        sync();
+        close(fd_);
+    }
+};
+
+// 常駐して1行に1つの問い合わせに答える. 問い合わせはコマンドラインと同じ書式で,
+//   ﾃﾞｨｰﾌﾟｲﾝﾊﾟｸﾄ all all
+//   --filter="elaborated && !danger" --top=10 --sort=sp ﾃﾞｨｰﾌﾟｲﾝﾊﾟｸﾄ all all
+// のように名前と--filter, --top, --sortを空白で区切って並べる. "version"には今の版の番号を,
+// "stats"には結果のキャッシュのヒット率や使っている大きさをJSONの1行で返す.
+// 答えはcsv(誤りなら"error: "で始まる1行)の後に空行を続ける.
+// 問い合わせごとにその時点の版を取って最後まで使うので, 途中でデータベースを読み直しても結果は混ざらない.
+class QueryServer {
+private:
+    const search::SnapshotStore& store_;
+    search::ResultCache* cache_;
+
+    // 空白で区切る. ""で囲んだ部分は空白を含められる.
+    static std::vector<std::string> tokenize(const std::string& line) {
+        std::vector<std::string> tokens;
+        std::string token;
+        bool quoted = false;
+        bool empty = true;
+        for (char c: line) {
+            if (c == '"') {
+                quoted = !quoted;
+                empty = false;
+            } else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+                if (!empty) {
+                    tokens.push_back(token);
+                }
+                token.clear();
+                empty = true;
+            } else {
+                token += c;
+                empty = false;
+            }
+        }
+        if (quoted) {
+            throw std::runtime_error("QueryServer::answer: unterminated quote.");
+        }
+        if (!empty) {
+            tokens.push_back(token);
+        }
+        return tokens;
+    }
+
+    static bool getOption(const std::string& token, const std::string& name, std::string& value) {
+        if (token.size() > name.size() && token.compare(0, name.size(), name) == 0 && token[name.size()] == '=') {
+            value = token.substr(name.size() + 1);
+            return true;
+        }
+        return false;
+    }
+
+    void respond(const std::vector<std::string>& tokens, std::ostream& ostream) const {
+        std::string filter;
+        std::string top;
+        std::string sort;
+        std::vector<std::string> names;
+        for (const std::string& token: tokens) {
+            if (getOption(token, "--filter", filter) || getOption(token, "--top", top)
+                || getOption(token, "--sort", sort)) {
+                continue;
+            } else if (token.compare(0, 2, "--") == 0) {
+                throw std::runtime_error("QueryServer::answer: invalid argument \"" + token + "\".");
+            }
+            names.push_back(token);
+        }
+        if (names.size() < 2 || names.size() > 4) {
+            throw std::runtime_error("QueryServer::answer: give 1 to 3 stallion_names and a broodmare_name.");
+        }
+        search::SearchQuery query;
+        for (size_t i = 0; i + 1 < names.size(); i++) {
+            query.addStallion(names[i]);
+        }
+        query.setBroodmare(names.back());
+        if (!filter.empty()) {
+            query.setFilter(filter);
+        }
+        std::optional<search::TopResults> results;
+        if (!top.empty()) {
+            search::ResultField field;
+            if (!search::parseResultField(sort, field)) {
+                throw std::runtime_error("QueryServer::answer: --top requires a valid --sort.");
+            }
+            size_t n = 0;
+            unsigned long k = 0;
+            try {
+                k = std::stoul(top, &n);
+            } catch (std::logic_error&) {
+                n = 0;
+            }
+            if (n != top.size()) {
+                throw std::runtime_error("QueryServer::answer: invalid number of results \"" + top + "\".");
+            }
+            results.emplace(k, field);
+        }
+
+        std::shared_ptr<const search::Snapshot> snapshot = store_.get();
+        const search::PedigreeTool& tool = snapshot->tool;
+        search::SearchRange range = tool.search(query);
+        // 再読み込みの前に取った古い版の問い合わせはキャッシュを使わずに分析する
+        if (cache_ != nullptr && cache_->setVersion(snapshot->version)) {
+            range.setResultCache(cache_, snapshot->version);
+        }
+        CsvWriter writer(ostream, tool, range.getSpace());
+        while (true) {
+            const std::vector<search::SearchResult>& batch = range.nextBatch();
+            if (batch.empty()) {
+                break;
+            }
+            if (results) {
+                results->add(batch);
+                continue;
+            }
+            writer.writeBatch(batch);
+            // 相手が切断したら残りは探索しない
+            if (!ostream) {
+                return;
+            }
+        }
+        if (results) {
+            writer.writeBatch(results->take());
+        }
+        writer.finish();
+    }
+
+public:
+    // cacheがnullptrならキャッシュを使わない
+    explicit QueryServer(const search::SnapshotStore& store, search::ResultCache* cache=nullptr) :
+        store_(store), cache_(cache) {}
+
+    void writeStats(std::ostream& ostream) const {
+        if (cache_ == nullptr) {
+            ostream << "{\"cache\":false}\n";
+            return;
+        }
+        search::ResultCacheStats stats = cache_->getStats();
+        uint64_t lookups = stats.hits + stats.misses;
+        ostream << "{\"cache\":true,\"version\":" << stats.version << ",\"hits\":" << stats.hits
+            << ",\"misses\":" << stats.misses
+            << ",\"hit_ratio\":" << (lookups > 0 ? (double)stats.hits / lookups : 0.0)
+            << ",\"insertions\":" << stats.insertions << ",\"evictions\":" << stats.evictions
+            << ",\"entries\":" << stats.entries << ",\"capacity\":" << stats.capacity
+            << ",\"bytes\":" << stats.bytes << "}\n";
+    }
+
+    // 1行の問い合わせに答える
+    void answer(const std::string& line, std::ostream& ostream) const {
+        try {
+            std::vector<std::string> tokens = tokenize(line);
+            if (tokens.size() == 1 && tokens[0] == "version") {
+                ostream << store_.get()->version << "\n";
+            } else if (tokens.size() == 1 && tokens[0] == "stats") {
+                writeStats(ostream);
+            } else if (!tokens.empty()) {
+                respond(tokens, ostream);
+            }
+        } catch (const std::exception& e) {
+            // 接続ごとのスレッドから例外を出すとサーバー全体が終了するので, どの例外も誤りとして答える
+            ostream << "error: " << e.what() << "\n";
+        }
+        ostream << "\n";
+        ostream.flush();
+    }
+
+    // 入力が終わるまで1行ずつ答える
+    void serve(std::istream& istream, std::ostream& ostream) const {
+        std::string line;
+        while (ostream && std::getline(istream, line)) {
+            answer(line, ostream);
+        }
+    }
+
+    // UNIXドメインソケットpathで待ち受け, 接続ごとのスレッドでserveする. 戻らない.
+    void listen(const std::string& path) const {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("QueryServer::listen: " + path + " is too long.");
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::runtime_error("QueryServer::listen: " + std::string(std::strerror(errno)) + ".");
+        }
+        // 前回終了した時のソケットが残っていれば消す
+        unlink(path.c_str());
+        if (bind(fd, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, 16) != 0) {
+            std::string message = std::strerror(errno);
+            close(fd);
+            throw std::runtime_error("QueryServer::listen: cannot listen on " + path + ": " + message + ".");
+        }
+        while (true) {
+            int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                std::string message = std::strerror(errno);
+                close(fd);
+                throw std::runtime_error("QueryServer::listen: " + message + ".");
+            }
+            std::thread([this, client]() {
+                SocketBuffer buffer(client);
+                std::iostream stream(&buffer);
+                serve(stream, stream);
+            }).detach();
+        }
+    }
+};
+
+}
+}
+
+#endif // IO_QUERYSERVER_H
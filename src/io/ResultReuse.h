@@ -0,0 +1,124 @@
+#ifndef IO_RESULTREUSE_H
+#define IO_RESULTREUSE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "io/ColumnarFormat.h"
+#include "search/PedigreeTool.h"
+#include "search/SearchQuery.h"
+#include "search/SearchResult.h"
+#include "search/StoredResults.h"
+
+namespace pedsearch {
+namespace io {
+
+// 以前の探索結果(条件なしで全行を出力したバイナリ)のうち, データベースの変更の影響を受けない行.
+// 行の位置ごとの馬が以前のファイルに同じ名前・同じ内容のハッシュで載っていれば, その行の結果は変わらないので
+// 以前の行をそのまま使う. 追加・変更された馬や, 祖先の系統・因子・凝った配合の組が変わった馬を含む行だけ分析し直す.
+class ResultReuse : public search::StoredResults {
+private:
+    ColumnarReader reader_;
+    std::vector<RowGroup> groups_;
+    std::vector<uint64_t> starts_;         // 行グループの最初の行の以前の行番号
+    std::vector<size_t> sizes_;            // 新しい探索空間の位置ごとの候補の数
+    std::vector<std::vector<uint64_t> > offsets_; // 位置, 候補 -> 以前の行番号への寄与. 使えなければNONE
+    mutable std::atomic<uint64_t> reused_;
+    mutable std::atomic<uint64_t> recomputed_;
+
+    static constexpr uint64_t NONE = UINT64_MAX;
+
+public:
+    ResultReuse(std::string_view path, const search::PedigreeTool& tool, const search::SearchSpace& space) :
+        reader_(path), reused_(0), recomputed_(0) {
+        const unsigned int generation = space.getGeneration();
+        if (reader_.getVersion() < 2) {
+            throw std::runtime_error(
+                "ResultReuse::ResultReuse: " + std::string(path) + " has no content hashes (version 1)."
+            );
+        }
+        if (reader_.getGeneration() != generation) {
+            throw std::runtime_error(
+                "ResultReuse::ResultReuse: " + std::string(path) + " is a result of another generation."
+            );
+        }
+
+        RowGroup group;
+        uint64_t rows = 0;
+        while (reader_.next(group)) {
+            groups_.push_back(group);
+            starts_.push_back(rows);
+            rows += group.getNumRows();
+        }
+        uint64_t expected = 1;
+        for (unsigned int i = 0; i <= generation; i++) {
+            expected *= reader_.getDictionary(i).size();
+        }
+        if (rows != expected) {
+            throw std::runtime_error(
+                "ResultReuse::ResultReuse: " + std::string(path) + " is not a complete search without --filter."
+            );
+        }
+
+        // 以前の行番号は位置ごとの辞書番号を, 母を最下位の桁とする混合基数で並べたもの
+        uint64_t stride = 1;
+        offsets_.resize(generation + 1);
+        sizes_.resize(generation + 1);
+        for (unsigned int i = generation + 1; i-- > 0;) {
+            const std::vector<std::string>& dictionary = reader_.getDictionary(i);
+            const std::vector<uint64_t>& hashes = reader_.getContentHashes(i);
+            std::unordered_map<std::string_view, size_t> index;
+            for (size_t j = 0; j < dictionary.size(); j++) {
+                index.emplace(dictionary[j], j);
+            }
+            const std::vector<size_t>& candidates = space.getCandidates(i);
+            sizes_[i] = candidates.size();
+            for (size_t id: candidates) {
+                std::string_view name = (i < generation) ?
+                    tool.getDefaultStallionName(id) : tool.getDefaultBroodmareName(id);
+                uint64_t hash = (i < generation) ? tool.getDefaultStallionHash(id) : tool.getDefaultBroodmareHash(id);
+                auto it = index.find(name);
+                bool same = it != index.end() && hashes[(*it).second] == hash;
+                offsets_[i].push_back(same ? (*it).second * stride : NONE);
+            }
+            stride *= dictionary.size();
+        }
+    }
+
+    bool load(uint64_t row, search::SearchResult& result) const override {
+        uint64_t old = 0;
+        for (size_t i = sizes_.size(); i-- > 0;) {
+            uint64_t offset = offsets_[i][row % sizes_[i]];
+            if (offset == NONE) {
+                recomputed_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            old += offset;
+            row /= sizes_[i];
+        }
+        size_t g = std::upper_bound(starts_.begin(), starts_.end(), old) - starts_.begin() - 1;
+        copy(ColumnarRow(groups_[g], old - starts_[g]), result);
+        reused_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 以前の結果を使った行の数
+    uint64_t getNumReused() const {
+        return reused_.load();
+    }
+
+    // 影響を受けて分析し直した行の数
+    uint64_t getNumRecomputed() const {
+        return recomputed_.load();
+    }
+};
+
+}
+}
+
+#endif // IO_RESULTREUSE_H
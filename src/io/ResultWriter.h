@@ -0,0 +1,33 @@
+#ifndef IO_RESULTWRITER_H
+#define IO_RESULTWRITER_H
+
+#include <vector>
+#include "search/SearchResult.h"
+
+namespace pedsearch {
+namespace io {
+
+// 探索結果を行の順に受け取る出力先
+class ResultWriter {
+public:
+    virtual ~ResultWriter() {}
+
+    virtual void write(const search::SearchResult& result) = 0;
+
+    // SearchRange::nextBatchのまとまりを行の順に書く
+    virtual void writeBatch(const std::vector<search::SearchResult>& batch) {
+        for (const search::SearchResult& result: batch) {
+            write(result);
+        }
+    }
+
+    // ここまでに受け取った行をすべて出力先に書き出す
+    virtual void flush() = 0;
+
+    virtual void finish() = 0;
+};
+
+}
+}
+
+#endif // IO_RESULTWRITER_H
@@ -0,0 +1,338 @@
+#ifndef SEARCH_AGGREGATION_H
+#define SEARCH_AGGREGATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "search/Filter.h"
+#include "search/PedigreeSearch.h"
+#include "search/PedigreeTool.h"
+#include "search/Progress.h"
+#include "search/ResultField.h"
+#include "search/SearchQuery.h"
+#include "search/SearchResult.h"
+
+namespace pedsearch {
+namespace search {
+
+// 集計関数1つ分. count, count(条件), min(列), max(列), sum(列)のいずれか. 条件はFilterと同じ書式.
+class Aggregate {
+public:
+    enum Op { COUNT, MIN, MAX, SUM };
+
+private:
+    std::string expression_;
+    Op op_;
+    ResultField field_;
+    std::optional<Filter> condition_;
+
+public:
+    Aggregate(std::string_view expression) : expression_(expression), op_(COUNT), field_(ResultField::ELABORATED) {
+        size_t open = expression.find('(');
+        std::string_view name = expression.substr(0, open);
+        std::string_view argument;
+        if (open != std::string_view::npos) {
+            if (expression.back() != ')') {
+                throw std::runtime_error("Aggregate::Aggregate: invalid aggregate \"" + expression_ + "\".");
+            }
+            argument = expression.substr(open + 1, expression.size() - open - 2);
+        }
+
+        bool ok = true;
+        if (name == "count") {
+            if (!argument.empty()) {
+                condition_.emplace(argument);
+            }
+        } else {
+            op_ = (name == "min") ? MIN : (name == "max") ? MAX : SUM;
+            ok = (name == "min" || name == "max" || name == "sum") && parseResultField(argument, field_);
+        }
+        if (!ok) {
+            throw std::runtime_error("Aggregate::Aggregate: invalid aggregate \"" + expression_ + "\".");
+        }
+    }
+
+    const std::string& getExpression() const {
+        return expression_;
+    }
+
+    // 集計に必要な分析(Filter::Facetの論理和). 条件の無いcountは分析を使わない.
+    unsigned int getFacets() const {
+        if (op_ == COUNT) {
+            return condition_ ? condition_->getFacets() : 0u;
+        }
+        return Filter::getFacet(field_);
+    }
+
+    int64_t getInitialValue() const {
+        switch (op_) {
+        case MIN:
+            return std::numeric_limits<int64_t>::max();
+        case MAX:
+            return std::numeric_limits<int64_t>::min();
+        default:
+            return 0;
+        }
+    }
+
+    void add(int64_t& value, const SearchResult& result) const {
+        if (op_ == COUNT) {
+            value += (!condition_ || condition_->matches(result)) ? 1 : 0;
+            return;
+        }
+        merge(value, getResultField(result, field_));
+    }
+
+    void merge(int64_t& value, int64_t other) const {
+        switch (op_) {
+        case MIN:
+            value = std::min(value, other);
+            break;
+        case MAX:
+            value = std::max(value, other);
+            break;
+        default:
+            value += other;
+            break;
+        }
+    }
+};
+
+// 集計条件: グループ化する位置(0..generation)と集計関数の並び
+class AggregateQuery {
+private:
+    std::vector<unsigned int> groupBy_;
+    std::vector<Aggregate> aggregates_;
+
+public:
+    void addGroupKey(unsigned int position) {
+        if (position > SearchQuery::MAX_GENERATION) {
+            throw std::runtime_error(
+                "AggregateQuery::addGroupKey: invalid position " + std::to_string(position) + "."
+            );
+        }
+        groupBy_.push_back(position);
+    }
+
+    void addAggregate(std::string_view expression) {
+        aggregates_.push_back(Aggregate(expression));
+    }
+
+    const std::vector<unsigned int>& getGroupKeys() const {
+        return groupBy_;
+    }
+
+    const std::vector<Aggregate>& getAggregates() const {
+        return aggregates_;
+    }
+};
+
+// 集計結果1グループ分. keysはグループ化した位置のid(位置0..generation-1は種牡馬, generationは繁殖牝馬).
+struct AggregateRow {
+    std::vector<size_t> keys;
+    std::vector<int64_t> values;
+};
+
+// グループのキーから集計値への表. スレッドごとに持ち, 最後に併合する.
+class AggregateTable {
+private:
+    const AggregateQuery& query_;
+    std::unordered_map<uint64_t, std::vector<int64_t> > groups_;
+
+public:
+    AggregateTable(const AggregateQuery& query) : query_(query) {}
+
+    std::vector<int64_t>& get(uint64_t key) {
+        auto it = groups_.find(key);
+        if (it == groups_.end()) {
+            std::vector<int64_t> values;
+            for (const Aggregate& aggregate: query_.getAggregates()) {
+                values.push_back(aggregate.getInitialValue());
+            }
+            it = groups_.emplace(key, std::move(values)).first;
+        }
+        return it->second;
+    }
+
+    void add(uint64_t key, const SearchResult& result) {
+        std::vector<int64_t>& values = get(key);
+        const std::vector<Aggregate>& aggregates = query_.getAggregates();
+        for (size_t i = 0; i < aggregates.size(); i++) {
+            aggregates[i].add(values[i], result);
+        }
+    }
+
+    void merge(const AggregateTable& table) {
+        const std::vector<Aggregate>& aggregates = query_.getAggregates();
+        for (auto it = table.groups_.begin(); it != table.groups_.end(); ++it) {
+            std::vector<int64_t>& values = get(it->first);
+            for (size_t i = 0; i < aggregates.size(); i++) {
+                aggregates[i].merge(values[i], it->second[i]);
+            }
+        }
+    }
+
+    const std::unordered_map<uint64_t, std::vector<int64_t> >& getGroups() const {
+        return groups_;
+    }
+};
+
+// 探索空間全体を評価しながら集計する. 行は出力せず, スレッドごとの表を最後に併合する.
+// filterを与えると条件を満たす行だけを集計する. 分析は集計関数と条件が使う段階だけを行う.
+class Aggregator {
+private:
+    SearchEngine engine_;
+    const AggregateQuery query_;
+    std::vector<uint64_t> strides_; // 位置ごとの行番号の重み
+    uint64_t begin_;
+    uint64_t end_;
+    unsigned int facets_; // 集計関数と条件が使う分析(Filter::Facetの論理和)
+
+    // 行番号からグループのキーを作る. キーはグループ化した位置の候補番号の混合基数表現.
+    uint64_t makeKey(uint64_t row) const {
+        uint64_t key = 0;
+        for (unsigned int position: query_.getGroupKeys()) {
+            uint64_t size = engine_.getSpace().getCandidates(position).size();
+            key = key * size + (row / strides_[position]) % size;
+        }
+        return key;
+    }
+
+    template <unsigned int FACETS> void work(
+        std::atomic<uint64_t>& next, AggregateTable& table, Progress* progress, unsigned int thread
+    ) const {
+        std::vector<SearchResult> batch;
+        batch.reserve(BATCH_SIZE);
+        while (true) {
+            uint64_t begin = next.fetch_add(BATCH_SIZE);
+            if (begin >= end_) {
+                break;
+            }
+            uint64_t end = std::min(begin + BATCH_SIZE, end_);
+            engine_.evaluatePartial<FACETS>(begin, end, batch);
+            if (progress != nullptr) {
+                progress->add(thread, end - begin);
+            }
+            for (const SearchResult& result: batch) {
+                table.add(makeKey(result.getRow()), result);
+            }
+        }
+    }
+
+    using WorkFunction = void (Aggregator::*)(std::atomic<uint64_t>&, AggregateTable&, Progress*, unsigned int) const;
+
+    template <size_t... FACETS> static const WorkFunction* makeWorkTable(std::index_sequence<FACETS...>) {
+        static const WorkFunction table[] = {&Aggregator::work<(unsigned int)FACETS>...};
+        return table;
+    }
+
+public:
+    static constexpr uint64_t BATCH_SIZE = 1024;
+
+    Aggregator(
+        const PedigreeTool& tool, SearchSpace space, AggregateQuery query, std::optional<Filter> filter=std::nullopt
+    ) : engine_(tool, std::move(space), std::move(filter)), query_(std::move(query)), begin_(0), facets_(0) {
+        const SearchSpace& s = engine_.getSpace();
+        end_ = s.size();
+        if (engine_.getFilter()) {
+            facets_ |= engine_.getFilter()->getFacets();
+        }
+        for (const Aggregate& aggregate: query_.getAggregates()) {
+            facets_ |= aggregate.getFacets();
+        }
+        for (unsigned int position: query_.getGroupKeys()) {
+            if (position > s.getGeneration()) {
+                throw std::runtime_error(
+                    "Aggregator::Aggregator: position " + std::to_string(position) + " is out of the chain."
+                );
+            }
+        }
+        strides_.resize(s.getGeneration() + 1);
+        uint64_t stride = 1;
+        for (size_t i = strides_.size(); i-- > 0;) {
+            strides_[i] = stride;
+            stride *= s.getCandidates(i).size();
+        }
+    }
+
+    const SearchSpace& getSpace() const {
+        return engine_.getSpace();
+    }
+
+    const AggregateQuery& getQuery() const {
+        return query_;
+    }
+
+    uint64_t getBegin() const {
+        return begin_;
+    }
+
+    uint64_t getEnd() const {
+        return end_;
+    }
+
+    // 行番号[begin, end)だけを集計する
+    void setRange(uint64_t begin, uint64_t end) {
+        end_ = std::min(end, engine_.getSpace().size());
+        begin_ = std::min(begin, end_);
+    }
+
+    // threadsが0ならハードウェアのスレッド数を使う. 結果はキーの順(各位置の候補の順)に並ぶ.
+    // progressを与えると各スレッドが評価した組の数を足していく.
+    std::vector<AggregateRow> run(unsigned int threads=0, Progress* progress=nullptr) const {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        std::atomic<uint64_t> next(begin_);
+        std::vector<AggregateTable> tables(threads, AggregateTable(query_));
+        const WorkFunction work = makeWorkTable(std::make_index_sequence<Filter::ALL + 1>())[facets_];
+        std::vector<std::thread> workers;
+        for (unsigned int i = 1; i < threads; i++) {
+            workers.emplace_back([this, work, &next, &tables, progress, i]() {
+                (this->*work)(next, tables[i], progress, i);
+            });
+        }
+        (this->*work)(next, tables[0], progress, 0);
+        for (std::thread& worker: workers) {
+            worker.join();
+        }
+        for (unsigned int i = 1; i < threads; i++) {
+            tables[0].merge(tables[i]);
+        }
+
+        std::vector<std::pair<uint64_t, const std::vector<int64_t>*> > groups;
+        for (auto it = tables[0].getGroups().begin(); it != tables[0].getGroups().end(); ++it) {
+            groups.push_back(std::make_pair(it->first, &it->second));
+        }
+        std::sort(groups.begin(), groups.end());
+
+        const std::vector<unsigned int>& positions = query_.getGroupKeys();
+        std::vector<AggregateRow> rows(groups.size());
+        for (size_t i = 0; i < groups.size(); i++) {
+            rows[i].keys.resize(positions.size());
+            uint64_t key = groups[i].first;
+            for (size_t j = positions.size(); j-- > 0;) {
+                const std::vector<size_t>& candidates = engine_.getSpace().getCandidates(positions[j]);
+                rows[i].keys[j] = candidates[key % candidates.size()];
+                key /= candidates.size();
+            }
+            rows[i].values = *groups[i].second;
+        }
+        return rows;
+    }
+};
+
+}
+}
+
+#endif // SEARCH_AGGREGATION_H
@@ -0,0 +1,116 @@
+#ifndef SEARCH_ARENA_H
+#define SEARCH_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+namespace pedsearch {
+namespace search {
+
+// 分析の一時的な構造(集合, クロスの表など)の確保先. スレッドごとに1つの領域から前へ詰めて確保し, 解放は何もしない.
+// ArenaScopeの外ではヒープから確保するので, 探索の外で作った分析の結果はいつまで持っていてもよい.
+// 領域が足りなくなった分はヒープから確保し, 次のreset()でその分だけ領域を広げるので, 何度か回した後はmallocを呼ばない.
+class AnalysisArena {
+private:
+    // 領域を使い切ったときの確保先. 確保した量を数える.
+    class Overflow : public std::pmr::memory_resource {
+    public:
+        size_t bytes = 0;
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            this->bytes += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& resource) const noexcept override {
+            return this == &resource;
+        }
+    };
+
+    std::unique_ptr<std::byte[]> buffer_;
+    size_t capacity_;
+    Overflow overflow_;
+    std::optional<std::pmr::monotonic_buffer_resource> resource_;
+    unsigned int depth_; // 入れ子になったArenaScopeの数
+
+    AnalysisArena() : buffer_(new std::byte[INITIAL_CAPACITY]), capacity_(INITIAL_CAPACITY), depth_(0) {
+        resource_.emplace(buffer_.get(), capacity_, &overflow_);
+    }
+
+    friend class ArenaScope;
+
+    // 確保したものをすべて捨てる. 前回溢れていれば領域を広げる.
+    void reset() {
+        resource_.reset();
+        if (overflow_.bytes > 0) {
+            size_t used = capacity_ + overflow_.bytes;
+            while (capacity_ < used) {
+                capacity_ *= 2;
+            }
+            buffer_.reset(new std::byte[capacity_]);
+            overflow_.bytes = 0;
+        }
+        resource_.emplace(buffer_.get(), capacity_, &overflow_);
+    }
+
+    static std::pmr::memory_resource*& current() {
+        thread_local std::pmr::memory_resource* resource = std::pmr::new_delete_resource();
+        return resource;
+    }
+
+public:
+    static constexpr size_t INITIAL_CAPACITY = 1 << 16;
+
+    AnalysisArena(const AnalysisArena&) = delete;
+    AnalysisArena& operator=(const AnalysisArena&) = delete;
+
+    static AnalysisArena& local() {
+        thread_local AnalysisArena arena;
+        return arena;
+    }
+
+    // このスレッドで今確保に使うもの. ArenaScopeの中なら領域, 外ならヒープ.
+    static std::pmr::memory_resource* getResource() {
+        return current();
+    }
+
+    size_t getCapacity() const {
+        return capacity_;
+    }
+};
+
+// 生存している間, このスレッドの分析の一時的な構造を領域から確保する. 入れ子にでき, 一番外側が終わるときに領域を空にする.
+// 中で作った分析の結果(PedigreeAnalysis)を外へ持ち出さないこと.
+class ArenaScope {
+private:
+    AnalysisArena& arena_;
+
+public:
+    ArenaScope() : arena_(AnalysisArena::local()) {
+        if (arena_.depth_++ == 0) {
+            AnalysisArena::current() = &*arena_.resource_;
+        }
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    ~ArenaScope() {
+        if (--arena_.depth_ == 0) {
+            AnalysisArena::current() = std::pmr::new_delete_resource();
+            arena_.reset();
+        }
+    }
+};
+
+}
+}
+
+#endif // SEARCH_ARENA_H
@@ -0,0 +1,323 @@
+#ifndef SEARCH_ATTRIBUTEINDEX_H
+#define SEARCH_ATTRIBUTEINDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "search/ResultField.h"
+
+namespace pedsearch {
+namespace search {
+
+// id(0..size-1)の集合
+class Bitmap {
+private:
+    std::vector<uint64_t> words_;
+    size_t size_;
+
+public:
+    Bitmap(size_t size=0, bool value=false) : words_((size + 63) / 64, value ? ~(uint64_t)0 : 0), size_(size) {
+        if (value && size % 64 != 0) {
+            words_.back() = ((uint64_t)1 << (size % 64)) - 1;
+        }
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    void set(size_t id) {
+        words_[id / 64] |= (uint64_t)1 << (id % 64);
+    }
+
+    bool test(size_t id) const {
+        return (words_[id / 64] >> (id % 64)) & 1;
+    }
+
+    size_t count() const {
+        size_t n = 0;
+        for (uint64_t word: words_) {
+            n += __builtin_popcountll(word);
+        }
+        return n;
+    }
+
+    Bitmap& operator&=(const Bitmap& bitmap) {
+        for (size_t i = 0; i < words_.size(); i++) {
+            words_[i] &= bitmap.words_[i];
+        }
+        return *this;
+    }
+
+    Bitmap& operator|=(const Bitmap& bitmap) {
+        for (size_t i = 0; i < words_.size(); i++) {
+            words_[i] |= bitmap.words_[i];
+        }
+        return *this;
+    }
+
+    // 補集合
+    Bitmap operator~() const {
+        Bitmap bitmap(size_, true);
+        for (size_t i = 0; i < words_.size(); i++) {
+            bitmap.words_[i] &= ~words_[i];
+        }
+        return bitmap;
+    }
+};
+
+// 種牡馬/繁殖牝馬の属性の列ごとの索引. 条件"fee<=3000,distance=2400,dirt=◎"を満たすidの集合を,
+// 行を1つずつ調べずに索引の組み合わせで求める.
+//   数値の列: 値で並べた(値, id)の配列を二分探索する
+//   区間の列: 区間の端点で区切った区間ごとに, それを含むidの集合を持つ. "distance=2400"は2400を含む区間
+//   列挙の列: 値ごとのidの集合. "dirt=◎|○"のように|で複数の値を指定できる
+class AttributeIndex {
+private:
+    size_t size_;
+    std::map<std::string, std::vector<std::pair<unsigned int, size_t> >, std::less<> > numeric_;
+    std::map<std::string, std::pair<std::vector<unsigned int>, std::vector<Bitmap> >, std::less<> > intervals_;
+    std::map<std::string, std::map<std::string, Bitmap, std::less<> >, std::less<> > categories_;
+
+    [[noreturn]] static void fail(std::string_view constraints, const std::string& message) {
+        throw std::runtime_error(
+            "AttributeIndex::select: " + message + " in \"" + std::string(constraints) + "\"."
+        );
+    }
+
+    Bitmap selectNumeric(
+        const std::vector<std::pair<unsigned int, size_t> >& column, Comparison comparison, unsigned int value
+    ) const {
+        // [lower, upper)が値がvalueに等しい範囲
+        auto lower = std::lower_bound(column.begin(), column.end(), std::make_pair(value, (size_t)0));
+        auto upper = std::upper_bound(column.begin(), column.end(), std::make_pair(value, SIZE_MAX));
+        std::pair<size_t, size_t> ranges[2] = {{0, 0}, {0, 0}};
+        size_t l = lower - column.begin();
+        size_t u = upper - column.begin();
+        switch (comparison) {
+        case Comparison::EQ:
+            ranges[0] = {l, u};
+            break;
+        case Comparison::NE:
+            ranges[0] = {0, l};
+            ranges[1] = {u, column.size()};
+            break;
+        case Comparison::LT:
+            ranges[0] = {0, l};
+            break;
+        case Comparison::LE:
+            ranges[0] = {0, u};
+            break;
+        case Comparison::GT:
+            ranges[0] = {u, column.size()};
+            break;
+        default:
+            ranges[0] = {l, column.size()};
+            break;
+        }
+        Bitmap bitmap(size_);
+        for (const std::pair<size_t, size_t>& range: ranges) {
+            for (size_t i = range.first; i < range.second; i++) {
+                bitmap.set(column[i].second);
+            }
+        }
+        return bitmap;
+    }
+
+    Bitmap selectInterval(
+        const std::pair<std::vector<unsigned int>, std::vector<Bitmap> >& index, unsigned int value
+    ) const {
+        const std::vector<unsigned int>& points = index.first;
+        size_t segment = std::upper_bound(points.begin(), points.end(), value) - points.begin();
+        return index.second[segment];
+    }
+
+    Bitmap selectCategory(
+        std::string_view constraints, const std::map<std::string, Bitmap, std::less<> >& column, std::string_view values
+    ) const {
+        Bitmap bitmap(size_);
+        while (true) {
+            size_t bar = values.find('|');
+            auto it = column.find(values.substr(0, bar));
+            if (it == column.end()) {
+                fail(constraints, "unknown value \"" + std::string(values.substr(0, bar)) + "\"");
+            }
+            bitmap |= it->second;
+            if (bar == std::string_view::npos) {
+                break;
+            }
+            values.remove_prefix(bar + 1);
+        }
+        return bitmap;
+    }
+
+public:
+    AttributeIndex(size_t size=0) : size_(size) {}
+
+    size_t size() const {
+        return size_;
+    }
+
+    void addNumeric(const std::string& name, const std::vector<unsigned int>& values) {
+        std::vector<std::pair<unsigned int, size_t> >& column = numeric_[name];
+        for (size_t id = 0; id < values.size(); id++) {
+            column.push_back(std::make_pair(values[id], id));
+        }
+        std::sort(column.begin(), column.end());
+    }
+
+    // 閉区間[mins[id], maxs[id]]
+    void addInterval(const std::string& name, const std::vector<unsigned int>& mins, const std::vector<unsigned int>& maxs) {
+        // points[k-1] <= x < points[k]となるxは区間kに入る. 区間の端点が変わる所で区切る.
+        std::vector<unsigned int> points;
+        for (size_t id = 0; id < mins.size(); id++) {
+            points.push_back(mins[id]);
+            points.push_back(maxs[id] + 1);
+        }
+        std::sort(points.begin(), points.end());
+        points.erase(std::unique(points.begin(), points.end()), points.end());
+
+        std::vector<Bitmap> segments(points.size() + 1, Bitmap(size_));
+        for (size_t id = 0; id < mins.size(); id++) {
+            size_t begin = std::upper_bound(points.begin(), points.end(), mins[id]) - points.begin();
+            size_t end = std::upper_bound(points.begin(), points.end(), maxs[id]) - points.begin();
+            for (size_t k = begin; k <= end; k++) {
+                segments[k].set(id);
+            }
+        }
+        intervals_[name] = std::make_pair(std::move(points), std::move(segments));
+    }
+
+    // domainはどの馬も持たなくても指定できる値
+    void addCategory(
+        const std::string& name, const std::vector<std::string>& values, const std::vector<std::string>& domain={}
+    ) {
+        std::map<std::string, Bitmap, std::less<> >& column = categories_[name];
+        for (const std::string& value: domain) {
+            column.emplace(value, Bitmap(size_));
+        }
+        for (size_t id = 0; id < values.size(); id++) {
+            auto it = column.find(values[id]);
+            if (it == column.end()) {
+                it = column.emplace(values[id], Bitmap(size_)).first;
+            }
+            it->second.set(id);
+        }
+    }
+
+    // カンマ区切りの条件をすべて満たすidの集合
+    Bitmap select(std::string_view constraints) const {
+        Bitmap bitmap(size_, true);
+        std::string_view rest = constraints;
+        while (!rest.empty()) {
+            size_t comma = rest.find(',');
+            std::string_view constraint = rest.substr(0, comma);
+            rest = (comma == std::string_view::npos) ? std::string_view() : rest.substr(comma + 1);
+
+            size_t op = constraint.find_first_of("=!<>");
+            if (op == std::string_view::npos || op == 0) {
+                fail(constraints, "invalid constraint \"" + std::string(constraint) + "\"");
+            }
+            std::string_view name = constraint.substr(0, op);
+            size_t end = op + 1;
+            while (end < constraint.size() && constraint[end] == '=') {
+                end++;
+            }
+            std::string_view symbol = constraint.substr(op, end - op);
+            std::string_view value = constraint.substr(end);
+
+            static const std::pair<const char*, Comparison> ops[] = {
+                {"==", Comparison::EQ}, {"=", Comparison::EQ}, {"!=", Comparison::NE}, {"<", Comparison::LT},
+                {"<=", Comparison::LE}, {">", Comparison::GT}, {">=", Comparison::GE}
+            };
+            auto it = std::find_if(std::begin(ops), std::end(ops), [symbol](const auto& o) { return symbol == o.first; });
+            if (it == std::end(ops) || value.empty()) {
+                fail(constraints, "invalid constraint \"" + std::string(constraint) + "\"");
+            }
+            Comparison comparison = it->second;
+
+            auto category = categories_.find(name);
+            if (category != categories_.end()) {
+                if (comparison != Comparison::EQ && comparison != Comparison::NE) {
+                    fail(constraints, "\"" + std::string(name) + "\" can only be compared with = or !=");
+                }
+                Bitmap selected = selectCategory(constraints, category->second, value);
+                bitmap &= (comparison == Comparison::EQ) ? selected : ~selected;
+                continue;
+            }
+
+            auto interval = intervals_.find(name);
+            auto column = numeric_.find(name);
+            if (interval == intervals_.end() && column == numeric_.end()) {
+                fail(constraints, "unknown attribute \"" + std::string(name) + "\"");
+            }
+
+            unsigned int number = 0;
+            try {
+                size_t n = 0;
+                number = (unsigned int)std::stoul(std::string(value), &n);
+                if (n != value.size()) {
+                    throw std::invalid_argument("");
+                }
+            } catch (std::logic_error&) {
+                fail(constraints, "a number is expected for \"" + std::string(name) + "\"");
+            }
+
+            if (interval != intervals_.end()) {
+                if (comparison != Comparison::EQ) {
+                    fail(constraints, "\"" + std::string(name) + "\" can only be compared with =");
+                }
+                bitmap &= selectInterval(interval->second, number);
+                continue;
+            }
+            bitmap &= selectNumeric(column->second, comparison, number);
+        }
+        return bitmap;
+    }
+};
+
+// 血統表の位置ごとの祖先の索引. 位置slotの祖先が種牡馬(stallions.jsonのid)ancestorであるidの集合を引く.
+class AncestorIndex {
+private:
+    static constexpr unsigned int SLOTS = 16;
+
+    size_t size_;
+    std::vector<std::unordered_map<size_t, Bitmap> > slots_;
+
+public:
+    AncestorIndex(size_t size=0) : size_(size), slots_(SLOTS) {}
+
+    size_t size() const {
+        return size_;
+    }
+
+    void add(size_t id, unsigned int slot, size_t ancestor) {
+        auto it = slots_[slot].find(ancestor);
+        if (it == slots_[slot].end()) {
+            it = slots_[slot].emplace(ancestor, Bitmap(size_)).first;
+        }
+        it->second.set(id);
+    }
+
+    // 位置slotsのどれかの祖先がancestorであるidの集合
+    Bitmap select(size_t ancestor, const std::vector<unsigned int>& slots) const {
+        Bitmap bitmap(size_);
+        for (unsigned int slot: slots) {
+            auto it = slots_[slot].find(ancestor);
+            if (it != slots_[slot].end()) {
+                bitmap |= it->second;
+            }
+        }
+        return bitmap;
+    }
+};
+
+}
+}
+
+#endif // SEARCH_ATTRIBUTEINDEX_H
@@ -0,0 +1,251 @@
+#ifndef SEARCH_BREEDINGPLAN_H
+#define SEARCH_BREEDINGPLAN_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "base/DefaultStallion.h"
+#include "search/PedigreeSearch.h"
+#include "search/PedigreeTool.h"
+#include "search/ResultField.h"
+#include "search/SearchQuery.h"
+#include "search/SearchResult.h"
+
+namespace pedsearch {
+namespace search {
+
+// 1年ごとの配合の評価値. "sp+st+pw-2*danger"のように列(英語名かcsvの見出し)に整数の係数を付けた和.
+class PlanObjective {
+private:
+    std::vector<std::pair<int, ResultField> > terms_;
+
+public:
+    PlanObjective(std::string_view expression="sp+st+pw") {
+        std::string_view rest = expression;
+        while (!rest.empty()) {
+            int sign = 1;
+            if (rest[0] == '+' || rest[0] == '-') {
+                sign = (rest[0] == '-') ? -1 : 1;
+                rest.remove_prefix(1);
+            } else if (!terms_.empty()) {
+                break;
+            }
+            size_t end = rest.find_first_of("+-");
+            std::string_view term = rest.substr(0, end);
+            rest = (end == std::string_view::npos) ? std::string_view() : rest.substr(end);
+
+            int weight = 1;
+            size_t star = term.find('*');
+            if (star != std::string_view::npos) {
+                try {
+                    size_t n = 0;
+                    weight = std::stoi(std::string(term.substr(0, star)), &n);
+                    if (n != star) {
+                        throw std::invalid_argument("");
+                    }
+                } catch (std::logic_error&) {
+                    throw std::runtime_error(
+                        "PlanObjective::PlanObjective: invalid weight in \"" + std::string(expression) + "\"."
+                    );
+                }
+                term.remove_prefix(star + 1);
+            }
+            ResultField field;
+            if (!parseResultField(term, field)) {
+                throw std::runtime_error(
+                    "PlanObjective::PlanObjective: unknown field \"" + std::string(term) + "\" in \""
+                    + std::string(expression) + "\"."
+                );
+            }
+            terms_.push_back(std::make_pair(sign * weight, field));
+        }
+        if (terms_.empty() || !rest.empty()) {
+            throw std::runtime_error(
+                "PlanObjective::PlanObjective: invalid objective \"" + std::string(expression) + "\"."
+            );
+        }
+    }
+
+    // RowはSearchResultと同じ名前の取得関数を持つ型
+    template <class Row> int evaluate(const Row& row) const {
+        int value = 0;
+        for (const std::pair<int, ResultField>& term: terms_) {
+            value += term.first * getResultField(row, term.second);
+        }
+        return value;
+    }
+};
+
+// 計画の1年分. 年yearの母はyear-1年目の配合で生まれた娘(1年目は基礎の母).
+struct PlanStep {
+    unsigned int year;
+    size_t stallion;
+    SearchResult result;
+    int value;
+    int64_t total;
+};
+
+// 基礎の母から始めて, 毎年の仔(娘)を翌年の母にしながらseasons年分の種牡馬を選び, 評価値の合計を最大にする.
+// 娘は血統表(祖先と面白の位置)だけで決まるので, 同じ血統表の娘は1つの状態にまとめ,
+// (状態, 残りの年数)ごとの最善の値を1度だけ求める動的計画法で解く.
+// 候補の種牡馬がS頭なら状態は高々S^(seasons-1)個で, 評価する配合は状態の数×S組.
+class BreedingPlanner {
+private:
+    // 位置1..15の祖先と面白の位置4つ
+    using StateKey = std::array<size_t, 19>;
+
+    struct StateKeyHash {
+        size_t operator()(const StateKey& key) const {
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t value: key) {
+                hash = (hash ^ value) * 1099511628211ull;
+            }
+            return (size_t)hash;
+        }
+    };
+
+    // 残りの年数に対する最善の値と, その1年目に選ぶ候補の番号(未計算なら-1)
+    struct Memo {
+        int64_t total = 0;
+        int candidate = -1;
+    };
+
+    const PedigreeTool& tool_;
+    SearchEngine engine_;
+    const unsigned int seasons_;
+    const PlanObjective objective_;
+    std::deque<base::DefaultBroodmare> states_; // 状態のidで引く. 追加しても要素の参照は変わらない.
+    std::unordered_map<StateKey, size_t, StateKeyHash> ids_;
+    std::vector<std::vector<Memo> > memo_; // memo_[残りの年数][状態]
+    uint64_t evaluations_;
+    size_t foundation_;
+
+    size_t intern(const base::DefaultBroodmare& broodmare) {
+        StateKey key;
+        for (unsigned int i = 1; i < 16; i++) {
+            key[i - 1] = broodmare.getAncestorIndex(base::Index(i));
+        }
+        std::array<unsigned int, 4> indices = broodmare.getInterestingIndices();
+        for (unsigned int i = 0; i < 4; i++) {
+            key[15 + i] = indices[i];
+        }
+        auto it = ids_.find(key);
+        if (it != ids_.end()) {
+            return (*it).second;
+        }
+        states_.push_back(broodmare);
+        ids_.emplace(key, states_.size() - 1);
+        return states_.size() - 1;
+    }
+
+    int score(size_t stallion, const base::DefaultBroodmare& broodmare) {
+        evaluations_++;
+        return engine_.visit(stallion, broodmare, [this](const auto& row) { return objective_.evaluate(row); });
+    }
+
+    // 状態stateの母から残りseasons年で得られる評価値の合計の最大
+    const Memo& solve(size_t state, unsigned int seasons) {
+        if (state < memo_[seasons].size() && memo_[seasons][state].candidate >= 0) {
+            return memo_[seasons][state];
+        }
+
+        const std::vector<size_t>& stallions = engine_.getSpace().getCandidates(0);
+        Memo best;
+        for (size_t i = 0; i < stallions.size(); i++) {
+            int64_t total = score(stallions[i], states_[state]);
+            if (seasons > 1) {
+                size_t daughter = intern(tool_.makeDefaultBroodmare(stallions[i], states_[state]));
+                total += solve(daughter, seasons - 1).total;
+            }
+            if (best.candidate < 0 || total > best.total) {
+                best.total = total;
+                best.candidate = (int)i;
+            }
+        }
+        if (memo_[seasons].size() <= state) {
+            memo_[seasons].resize(states_.size());
+        }
+        memo_[seasons][state] = best;
+        return memo_[seasons][state];
+    }
+
+public:
+    // spaceは1代の探索空間(種牡馬の候補, 基礎の母の候補). 母が複数なら最も良い母を選ぶ.
+    BreedingPlanner(
+        const PedigreeTool& tool, SearchSpace space, unsigned int seasons, PlanObjective objective=PlanObjective()
+    ) : tool_(tool), engine_(tool, std::move(space)), seasons_(seasons), objective_(std::move(objective)),
+        memo_(seasons + 1), evaluations_(0), foundation_(0) {
+        if (engine_.getSpace().getGeneration() != 1) {
+            throw std::runtime_error("BreedingPlanner::BreedingPlanner: give one stallion and one broodmare.");
+        }
+        if (seasons_ == 0) {
+            throw std::runtime_error("BreedingPlanner::BreedingPlanner: the number of seasons must be positive.");
+        }
+    }
+
+    const SearchSpace& getSpace() const {
+        return engine_.getSpace();
+    }
+
+    // 最善の計画を1年目から順に返す. 評価値が同じなら候補の順(名前順)で先の種牡馬, 先の母を選ぶ.
+    std::vector<PlanStep> plan() {
+        const std::vector<size_t>& broodmares = engine_.getSpace().getCandidates(1);
+        const std::vector<size_t>& stallions = engine_.getSpace().getCandidates(0);
+        size_t state = 0;
+        int64_t best = 0;
+        for (size_t i = 0; i < broodmares.size(); i++) {
+            size_t s = intern(tool_.getDefaultBroodmare(broodmares[i]));
+            int64_t total = solve(s, seasons_).total;
+            if (i == 0 || total > best) {
+                state = s;
+                best = total;
+                foundation_ = broodmares[i];
+            }
+        }
+
+        std::vector<PlanStep> steps;
+        int64_t total = 0;
+        for (unsigned int year = 1; year <= seasons_; year++) {
+            const Memo& memo = solve(state, seasons_ - year + 1);
+            size_t stallion = stallions[memo.candidate];
+            PlanStep step;
+            step.year = year;
+            step.stallion = stallion;
+            engine_.evaluate(stallion, states_[state], step.result);
+            step.value = objective_.evaluate(step.result);
+            total += step.value;
+            step.total = total;
+            steps.push_back(step);
+            if (year < seasons_) {
+                state = intern(tool_.makeDefaultBroodmare(stallion, states_[state]));
+            }
+        }
+        return steps;
+    }
+
+    // 直前のplan()で選んだ基礎の母のid
+    size_t getFoundation() const {
+        return foundation_;
+    }
+
+    // 区別できた娘(と基礎の母)の数
+    size_t getNumStates() const {
+        return states_.size();
+    }
+
+    // 評価値を求めた配合の数
+    uint64_t getNumEvaluations() const {
+        return evaluations_;
+    }
+};
+
+}
+}
+
+#endif // SEARCH_BREEDINGPLAN_H
@@ -0,0 +1,247 @@
+#ifndef SEARCH_FILTER_H
+#define SEARCH_FILTER_H
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "search/ResultField.h"
+
+namespace pedsearch {
+namespace search {
+
+// 探索結果の絞り込み条件. 例: "elaborated && !danger && sp >= 3"
+// 演算子は || && ! ( ) と比較(== != < <= > >= =)で, 比較の無い列は0でないことを表す.
+// 列は求めるのに必要な分析(Facet)ごとに分類し, &&と||は安い分析で求まる項から順に短絡評価する.
+// 遅延評価する行に対して使えば, 真偽が決まった時点で残りの分析を省ける.
+class Filter {
+public:
+    // 分析の段階. 値が小さいほど安い.
+    enum Facet : unsigned int {
+        FLAGS = 1, // 凝った/面白/見事
+        NITRO = 2, // SP/ST/PW
+        CROSS = 4, // 危険/因子/クロスの数
+        ALL = FLAGS | NITRO | CROSS
+    };
+
+private:
+    struct Node {
+        enum Kind { AND, OR, NOT, COMPARE } kind;
+        ResultField field;
+        Comparison comparison;
+        int value;
+        std::vector<size_t> children;
+        unsigned int facets; // 部分木が必要とする分析
+    };
+
+    std::string expression_;
+    std::vector<Node> nodes_;
+    size_t root_;
+
+    // 構文解析
+    std::string_view rest_;
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::runtime_error("Filter::Filter: " + message + " in \"" + expression_ + "\".");
+    }
+
+    void skipSpaces() {
+        while (!rest_.empty() && std::isspace((unsigned char)rest_[0])) {
+            rest_.remove_prefix(1);
+        }
+    }
+
+    bool accept(std::string_view token) {
+        skipSpaces();
+        if (rest_.substr(0, token.size()) == token) {
+            rest_.remove_prefix(token.size());
+            return true;
+        }
+        return false;
+    }
+
+    // 英数字, '_', UTF-8の多バイト文字からなる列名
+    std::string_view parseName() {
+        skipSpaces();
+        size_t n = 0;
+        while (n < rest_.size() && (std::isalnum((unsigned char)rest_[n]) || rest_[n] == '_' || (unsigned char)rest_[n] >= 0x80)) {
+            n++;
+        }
+        if (n == 0) {
+            fail("a field name is expected");
+        }
+        std::string_view name = rest_.substr(0, n);
+        rest_.remove_prefix(n);
+        return name;
+    }
+
+    int parseNumber() {
+        skipSpaces();
+        size_t n = (!rest_.empty() && rest_[0] == '-') ? 1 : 0;
+        size_t begin = n;
+        while (n < rest_.size() && std::isdigit((unsigned char)rest_[n])) {
+            n++;
+        }
+        if (n == begin) {
+            fail("a number is expected");
+        }
+        int value = 0;
+        try {
+            value = std::stoi(std::string(rest_.substr(0, n)));
+        } catch (const std::out_of_range&) {
+            fail("the number \"" + std::string(rest_.substr(0, n)) + "\" is out of range");
+        }
+        rest_.remove_prefix(n);
+        return value;
+    }
+
+    size_t addNode(Node node) {
+        node.facets = 0;
+        for (size_t child: node.children) {
+            node.facets |= nodes_[child].facets;
+        }
+        if (node.kind == Node::COMPARE) {
+            node.facets = getFacet(node.field);
+        }
+        nodes_.push_back(std::move(node));
+        return nodes_.size() - 1;
+    }
+
+    size_t parseOr() {
+        Node node{Node::OR, ResultField::ELABORATED, Comparison::NE, 0, {parseAnd()}, 0};
+        while (accept("||")) {
+            node.children.push_back(parseAnd());
+        }
+        return node.children.size() == 1 ? node.children[0] : addNode(std::move(node));
+    }
+
+    size_t parseAnd() {
+        Node node{Node::AND, ResultField::ELABORATED, Comparison::NE, 0, {parseUnary()}, 0};
+        while (accept("&&")) {
+            node.children.push_back(parseUnary());
+        }
+        return node.children.size() == 1 ? node.children[0] : addNode(std::move(node));
+    }
+
+    size_t parseUnary() {
+        if (accept("!")) {
+            return addNode(Node{Node::NOT, ResultField::ELABORATED, Comparison::NE, 0, {parseUnary()}, 0});
+        }
+        if (accept("(")) {
+            size_t node = parseOr();
+            if (!accept(")")) {
+                fail("')' is expected");
+            }
+            return node;
+        }
+
+        std::string_view name = parseName();
+        Node node{Node::COMPARE, ResultField::ELABORATED, Comparison::NE, 0, {}, 0};
+        if (!parseResultField(name, node.field)) {
+            fail("unknown field \"" + std::string(name) + "\"");
+        }
+        // 長い演算子から順に試す
+        static const std::pair<const char*, Comparison> ops[] = {
+            {"==", Comparison::EQ}, {"!=", Comparison::NE}, {"<=", Comparison::LE}, {">=", Comparison::GE},
+            {"<", Comparison::LT}, {">", Comparison::GT}, {"=", Comparison::EQ}
+        };
+        for (const auto& op: ops) {
+            if (accept(op.first)) {
+                node.comparison = op.second;
+                node.value = parseNumber();
+                break;
+            }
+        }
+        return addNode(std::move(node));
+    }
+
+    // 安い分析で決まる子を先に評価するよう並べ替える
+    void reorder(size_t index) {
+        Node& node = nodes_[index];
+        std::stable_sort(node.children.begin(), node.children.end(), [this](size_t a, size_t b) {
+            return nodes_[a].facets < nodes_[b].facets;
+        });
+        for (size_t child: nodes_[index].children) {
+            reorder(child);
+        }
+    }
+
+    template <class Row> bool evaluate(size_t index, const Row& row) const {
+        const Node& node = nodes_[index];
+        switch (node.kind) {
+        case Node::COMPARE:
+            return compare(getResultField(row, node.field), node.comparison, node.value);
+        case Node::NOT:
+            return !evaluate(node.children[0], row);
+        case Node::AND:
+            for (size_t child: node.children) {
+                if (!evaluate(child, row)) {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            for (size_t child: node.children) {
+                if (evaluate(child, row)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+public:
+    Filter(std::string_view expression) : expression_(expression), rest_(expression_) {
+        root_ = parseOr();
+        skipSpaces();
+        if (!rest_.empty()) {
+            fail("unexpected \"" + std::string(rest_) + "\"");
+        }
+        reorder(root_);
+    }
+
+    Filter(const Filter& filter) : expression_(filter.expression_), nodes_(filter.nodes_), root_(filter.root_) {}
+
+    Filter& operator=(const Filter& filter) {
+        expression_ = filter.expression_;
+        nodes_ = filter.nodes_;
+        root_ = filter.root_;
+        return *this;
+    }
+
+    const std::string& getExpression() const {
+        return expression_;
+    }
+
+    // 列fieldを求めるのに必要な分析
+    static unsigned int getFacet(ResultField field) {
+        switch (field) {
+        case ResultField::ELABORATED:
+        case ResultField::INTERESTING:
+        case ResultField::WONDERFUL:
+            return FLAGS;
+        case ResultField::SPEED_NITRO:
+        case ResultField::STAMINA_NITRO:
+        case ResultField::POWER_NITRO:
+            return NITRO;
+        default:
+            return CROSS;
+        }
+    }
+
+    // 条件の評価に必要な分析
+    unsigned int getFacets() const {
+        return nodes_[root_].facets;
+    }
+
+    template <class Row> bool matches(const Row& row) const {
+        return evaluate(root_, row);
+    }
+};
+
+}
+}
+
+#endif // SEARCH_FILTER_H
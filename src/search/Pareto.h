@@ -0,0 +1,201 @@
+#ifndef SEARCH_PARETO_H
+#define SEARCH_PARETO_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "search/Arena.h"
+#include "search/Filter.h"
+#include "search/PedigreeAnalyzer.h"
+#include "search/PedigreeSearch.h"
+#include "search/PedigreeTool.h"
+#include "search/Progress.h"
+#include "search/SearchQuery.h"
+#include "search/SearchResult.h"
+
+namespace pedsearch {
+namespace search {
+
+// SP, ST, PW, 凝った, 面白, 見事の組. どれも大きいほど良い.
+struct Objectives {
+    static constexpr unsigned int SIZE = 6;
+    int values[SIZE];
+
+    // すべての値がo以上で, 少なくとも1つがoより大きい
+    bool dominates(const Objectives& o) const {
+        bool greater = false;
+        for (unsigned int i = 0; i < SIZE; i++) {
+            if (values[i] < o.values[i]) {
+                return false;
+            }
+            greater = greater || values[i] > o.values[i];
+        }
+        return greater;
+    }
+};
+
+// 他のどの行にも支配されない行の集合. 行を1つずつ加えながら保つ.
+// 値が同じ行はどちらも支配されないので両方残る.
+class ParetoFront {
+public:
+    struct Entry {
+        uint64_t row;
+        Objectives objectives;
+    };
+
+private:
+    std::vector<Entry> entries_;
+
+public:
+    // objectivesを支配する行があるか. 上界を渡せば, それ以下の値を持つ行が加わらないことが分かる.
+    bool isDominated(const Objectives& objectives) const {
+        for (const Entry& entry: entries_) {
+            if (entry.objectives.dominates(objectives)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 支配されていなければ加え, 新しい行に支配される行を除く
+    bool add(uint64_t row, const Objectives& objectives) {
+        if (isDominated(objectives)) {
+            return false;
+        }
+        entries_.erase(
+            std::remove_if(entries_.begin(), entries_.end(), [&objectives](const Entry& entry) {
+                return objectives.dominates(entry.objectives);
+            }),
+            entries_.end()
+        );
+        entries_.push_back(Entry{row, objectives});
+        return true;
+    }
+
+    void merge(const ParetoFront& front) {
+        for (const Entry& entry: front.entries_) {
+            add(entry.row, entry.objectives);
+        }
+    }
+
+    const std::vector<Entry>& getEntries() const {
+        return entries_;
+    }
+};
+
+// 探索空間全体のパレートフロントを求める. 分析は遅延させ, ニトロだけで求めた上界(フラグはすべて1とする)が
+// フロントに支配される行は凝った/面白/見事の判定を省き, フロントに残った行だけ最後にクロスまで評価する.
+class ParetoSearch {
+private:
+    SearchEngine engine_;
+    uint64_t begin_;
+    uint64_t end_;
+
+    void work(std::atomic<uint64_t>& next, ParetoFront& front, Progress* progress, unsigned int thread) const {
+        std::vector<SearchResult> batch;
+        SearchResult result;
+        while (true) {
+            uint64_t begin = next.fetch_add(BATCH_SIZE);
+            if (begin >= end_) {
+                break;
+            }
+            uint64_t end = std::min(begin + BATCH_SIZE, end_);
+            if (engine_.getFilter()) {
+                // 条件の評価に必要な分析は条件が決めるので, 条件を満たした行の値だけを使う
+                engine_.evaluate(begin, end, batch);
+                for (const SearchResult& r: batch) {
+                    front.add(r.getRow(), Objectives{{
+                        r.getSpeedNitro(), r.getStaminaNitro(), r.getPowerNitro(),
+                        r.isElaborated(), r.isInteresting(), r.isWonderful()
+                    }});
+                }
+            } else {
+                ArenaScope scope;
+                for (uint64_t row = begin; row < end; row++) {
+                    engine_.analyze<PedigreeAnalysis::NITRO>(row, result, [&](const PedigreeAnalysis& analysis) {
+                        const Nitro& nitro = analysis.getNitro();
+                        Objectives objectives{{
+                            nitro.getSpeedNitro(), nitro.getStaminaNitro(), nitro.getPowerNitro(), 1, 1, 1
+                        }};
+                        if (front.isDominated(objectives)) {
+                            return;
+                        }
+                        objectives.values[3] = analysis.isElaborated();
+                        objectives.values[4] = analysis.isInteresting();
+                        objectives.values[5] = analysis.isWonderful();
+                        front.add(row, objectives);
+                    });
+                }
+            }
+            if (progress != nullptr) {
+                progress->add(thread, end - begin);
+            }
+        }
+    }
+
+public:
+    static constexpr uint64_t BATCH_SIZE = 1024;
+
+    ParetoSearch(const PedigreeTool& tool, SearchSpace space, std::optional<Filter> filter=std::nullopt) :
+        engine_(tool, std::move(space), std::move(filter)), begin_(0) {
+        end_ = engine_.getSpace().size();
+    }
+
+    const SearchSpace& getSpace() const {
+        return engine_.getSpace();
+    }
+
+    // 行番号[begin, end)だけを探索する
+    void setRange(uint64_t begin, uint64_t end) {
+        end_ = std::min(end, engine_.getSpace().size());
+        begin_ = std::min(begin, end_);
+    }
+
+    uint64_t getBegin() const {
+        return begin_;
+    }
+
+    uint64_t getEnd() const {
+        return end_;
+    }
+
+    // threadsが0ならハードウェアのスレッド数を使う. スレッドごとのフロントを併合し, 行番号の順に返す.
+    std::vector<SearchResult> run(unsigned int threads=0, Progress* progress=nullptr) const {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        std::atomic<uint64_t> next(begin_);
+        std::vector<ParetoFront> fronts(threads);
+        std::vector<std::thread> workers;
+        for (unsigned int i = 1; i < threads; i++) {
+            workers.emplace_back([this, &next, &fronts, progress, i]() { work(next, fronts[i], progress, i); });
+        }
+        work(next, fronts[0], progress, 0);
+        for (std::thread& worker: workers) {
+            worker.join();
+        }
+        for (unsigned int i = 1; i < threads; i++) {
+            fronts[0].merge(fronts[i]);
+        }
+
+        std::vector<uint64_t> rows;
+        for (const ParetoFront::Entry& entry: fronts[0].getEntries()) {
+            rows.push_back(entry.row);
+        }
+        std::sort(rows.begin(), rows.end());
+        std::vector<SearchResult> results(rows.size());
+        for (size_t i = 0; i < rows.size(); i++) {
+            engine_.evaluate(rows[i], results[i]);
+        }
+        return results;
+    }
+};
+
+}
+}
+
+#endif // SEARCH_PARETO_H
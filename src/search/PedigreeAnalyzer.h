@@ -5,6 +5,7 @@
 #include <array>
 #include <cmath>
 #include <initializer_list>
+#include <memory_resource>
 #include <set>
 #include <unordered_map>
 #include <utility>
@@ -15,24 +16,24 @@
 #include "base/ElaboratedPairs.h"
 #include "base/Stallion.h"
 #include "base/ThoroughbredMap.h"
+#include "search/Arena.h"
+#include "search/Profiler.h"
 
 namespace pedsearch {
 namespace search {
 
+// 種牡馬のid -> その種牡馬が現れる世代. 作った時点のAnalysisArena::getResource()から確保する.
 class Cross {
 private:
     friend class PedigreeAnalyzer;
     friend class PedigreeAnalysis;
-    std::unordered_map<size_t, std::vector<unsigned int> > crosses_;
+    std::pmr::unordered_map<size_t, std::pmr::vector<unsigned int> > crosses_;
 
-    Cross() {}
+    Cross() : crosses_(AnalysisArena::getResource()) {}
 
     void append(size_t id, unsigned int generation) {
-        if (crosses_.find(id) == crosses_.end()) {
-            crosses_.emplace(id, std::vector<unsigned int>(1, generation));
-        } else {
-            crosses_[id].push_back(generation);
-        }
+        // 世代の列は表と同じ確保先から作られる
+        crosses_[id].push_back(generation);
     }
 
 public:
@@ -40,15 +41,16 @@ public:
         return (unsigned int)crosses_.size();
     }
 
-    void getCrossIndices(std::set<size_t>& crossIndices) const {
+    // SetはstdまたはpmrのSet<size_t>
+    template <class Set> void getCrossIndices(Set& crossIndices) const {
         crossIndices.clear();
         for (auto it = crosses_.begin(); it != crosses_.end(); ++it) {
             crossIndices.insert((*it).first);
         }
     }
 
-    std::vector<unsigned int> getGenerations(size_t id) const {
-        assertPrint(
+    const std::pmr::vector<unsigned int>& getGenerations(size_t id) const {
+        PEDSEARCH_ASSERT(
             crosses_.find(id) != crosses_.end(),
             "Cross::getGenerations: no cross of " + std::to_string(id)
         );
@@ -56,11 +58,11 @@ public:
     }
 
     double getBloodVolume(size_t id) const {
-        assertPrint(
+        PEDSEARCH_ASSERT(
             crosses_.find(id) != crosses_.end(),
             "Cross::getBloodVolume: no cross of " + std::to_string(id)
         );
-        std::vector<unsigned int> gens = crosses_.at(id);
+        const std::pmr::vector<unsigned int>& gens = crosses_.at(id);
         double sum = 0;
         for (auto it = gens.begin(); it != gens.end(); ++it) {
             sum += 50.0 / (*it);
@@ -68,7 +70,7 @@ public:
         return sum;
     }
 
-    bool hasCross(size_t id) {
+    bool hasCross(size_t id) const {
         if (crosses_.find(id) == crosses_.end()) {
             return false;
         } else {
@@ -103,41 +105,74 @@ public:
     }
 };
 
+// 分析結果. 各分析(面白/見事/凝った/クロス/ニトロ)は最初に参照されたときに行い, 結果を保持する.
+// 配合する馬, 種牡馬の一覧と凝った配合の組は複製せずに参照するので, どれも分析より長く生存させること.
 class PedigreeAnalysis {
+public:
+    // 分析の種類. PedigreeAnalyzer::analyzeのテンプレート引数にはこれらの論理和を渡す.
+    enum Facet : unsigned int {
+        INTERESTING = 1, WONDERFUL = 2, ELABORATED = 4, CROSS = 8, NITRO = 16, ALL = 31
+    };
+
 private:
     friend class PedigreeAnalyzer;
-    bool isInteresting_;
-    bool isWonderful_;
-    bool isElaborated_;
-    Cross cross_;
-    Nitro nitro_;
 
-    PedigreeAnalysis() : isInteresting_(false), isWonderful_(false), isElaborated_(false) {}
+    const base::DefaultStallion* stallion_;
+    const base::DefaultBroodmare* broodmare_;
+    const std::vector<base::Stallion>* stallionVector_;
+    const base::ElaboratedPairs* pairs_;
+    size_t ignoreIndex_;
+
+    mutable unsigned int computed_;
+    mutable bool isInteresting_;
+    mutable bool isWonderful_;
+    mutable bool isElaborated_;
+    mutable Cross cross_;
+    mutable Nitro nitro_;
+
+    PedigreeAnalysis(
+        const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare,
+        const std::vector<base::Stallion>& stallionVector, const base::ElaboratedPairs& pairs, size_t ignoreIndex
+    ) : stallion_(&stallion), broodmare_(&broodmare), stallionVector_(&stallionVector), pairs_(&pairs),
+        ignoreIndex_(ignoreIndex), computed_(0), isInteresting_(false), isWonderful_(false), isElaborated_(false) {}
+
+    void compute(unsigned int facet) const;
 
 public:
     bool isInteresting() const {
+        compute(INTERESTING);
         return isInteresting_;
     }
 
     bool isWonderful() const {
+        compute(WONDERFUL);
         return isWonderful_;
     }
 
     bool isElaborated() const {
+        compute(ELABORATED);
         return isElaborated_;
     }
 
     const Cross& getCross() const {
+        compute(CROSS);
         return cross_;
     }
 
     const Nitro& getNitro() const {
+        compute(NITRO);
         return nitro_;
     }
+
+    // 残りの分析をまとめて行う
+    void computeAll() const {
+        compute(ALL);
+    }
 };
 
 class PedigreeAnalyzer {
-private:
+public:
+    // 仔から見た血統表の位置の世代. 種牡馬自身(位置0)が1代目.
     static inline unsigned int indexToGeneration(base::Index index) {
         switch (index) {
             case 0:
@@ -165,6 +200,9 @@ private:
         return 0;
     }
 
+private:
+    friend class PedigreeAnalysis;
+
     static inline base::Index indexSkipForCrossSearch(base::Index index) {
         switch (index) {
             case 0:
@@ -201,15 +239,15 @@ private:
 
     static inline void appendInvalidIndexPairs(
         base::Index index1, base::Index index2,
-        std::set<std::pair<base::Index, base::Index> >& pairs
+        std::pmr::set<std::pair<base::Index, base::Index> >& pairs
     ) {
-        assertPrint(
+        PEDSEARCH_ASSERT(
             index2 >= base::Index(1),
             "PedigreeAnalyzer::appendInvalidIndexPairs: index2 must be larger than 1 but got " + std::to_string((unsigned int)index2)
         );
         
         unsigned int gen = indexToGeneration(index1);
-        std::vector<unsigned int> indices1;
+        std::pmr::vector<unsigned int> indices1(AnalysisArena::getResource());
         if (gen == 1) {
             indices1 = {1,2,3,9,4,7,10,13,4,5,7,8,11,12,14,15};
         } else if (gen == 2) {
@@ -221,7 +259,7 @@ private:
         }
 
         gen = indexToGeneration(index2);
-        std::vector<unsigned int> indices2;
+        std::pmr::vector<unsigned int> indices2(AnalysisArena::getResource());
         if (gen == 2) {
             indices2 = {2,3,6,4,5,7,8};
         } else if (gen == 3) {
@@ -235,182 +273,206 @@ private:
         }
     }
 
-public:
-    static inline PedigreeAnalysis analyze(
-        const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare,
-        const std::vector<base::Stallion>& stallionVector, const base::ElaboratedPairs& pairs,
-        size_t ignoreIndex, bool interesting=true, bool wonderful=true, bool elaborated=true,
-        bool cross=true, bool nitro=true
-    ) {
-        PedigreeAnalysis result;
-
-        // 面白い配合の判定
-        if (interesting) {
-            std::set<unsigned int> indices;
-            stallion.appendInterestingIndices(indices);
-            broodmare.appendInterestingIndices(indices);
-            if (indices.size() >= 7) {
-                result.isInteresting_ = true;
-            }
+    // 面白い配合の判定
+    static inline void computeInteresting(const PedigreeAnalysis& result) {
+        PEDSEARCH_PROFILE_STAGE(INTERESTING);
+        std::pmr::set<unsigned int> indices(AnalysisArena::getResource());
+        result.stallion_->appendInterestingIndices(indices);
+        result.broodmare_->appendInterestingIndices(indices);
+        if (indices.size() >= 7) {
+            result.isInteresting_ = true;
         }
+    }
 
-        // 見事な配合の判定
-        if (wonderful) {
-            std::set<unsigned int> sireIndices;
-            std::set<unsigned int> broodmareIndices;
-            stallion.appendWonderfulIndices(sireIndices);
-            broodmare.appendInterestingIndices(broodmareIndices);
-            if (sireIndices == broodmareIndices) {
-                result.isWonderful_ = true;
-            }
+    // 見事な配合の判定
+    static inline void computeWonderful(const PedigreeAnalysis& result) {
+        PEDSEARCH_PROFILE_STAGE(WONDERFUL);
+        std::pmr::set<unsigned int> sireIndices(AnalysisArena::getResource());
+        std::pmr::set<unsigned int> broodmareIndices(AnalysisArena::getResource());
+        result.stallion_->appendWonderfulIndices(sireIndices);
+        result.broodmare_->appendInterestingIndices(broodmareIndices);
+        if (sireIndices == broodmareIndices) {
+            result.isWonderful_ = true;
         }
+    }
 
-        // 凝った配合の判定
-        if (elaborated) {
-            std::set<std::string_view> stallionAncestors;
-            std::set<std::string_view> broodmareAncestors;
-            std::vector<base::Index> indices = {1,2,3,6,9,10,13};
-
-            bool finished = false;
-            for (base::Index index1: indices) {
-                for (base::Index index2: indices) {
-                    if (pairs.hasPair(stallion.getAncestorIndex(index1), broodmare.getAncestorIndex(index2))) {
-                        result.isElaborated_ = true;
-                        finished = true;
-                        break;
-                    }
-                }
-                if (finished) {
+    // 凝った配合の判定
+    static inline void computeElaborated(const PedigreeAnalysis& result) {
+        PEDSEARCH_PROFILE_STAGE(ELABORATED);
+        const base::DefaultStallion& stallion = *result.stallion_;
+        const base::DefaultBroodmare& broodmare = *result.broodmare_;
+        const base::ElaboratedPairs& pairs = *result.pairs_;
+        static const base::Index indices[] = {1,2,3,6,9,10,13};
+
+        bool finished = false;
+        for (base::Index index1: indices) {
+            for (base::Index index2: indices) {
+                if (pairs.hasPair(stallion.getAncestorIndex(index1), broodmare.getAncestorIndex(index2))) {
+                    result.isElaborated_ = true;
+                    finished = true;
                     break;
                 }
             }
+            if (finished) {
+                break;
+            }
         }
+    }
 
-        // クロスの判定とニトロの数え上げ
-        if (!cross && nitro) {
-            std::set<size_t> stallionsSet;
-            size_t id;
-            for (unsigned int i = 1; i <= 15; i++) {
-                id = stallion.getAncestorIndex(i);
-                if (id != ignoreIndex && stallionsSet.find(id) == stallionsSet.end()) {
-                    if (stallionVector[id].isSprint()) {
-                        result.nitro_.sprint_++;
-                    }
-                    if (stallionVector[id].isSpeed()) {
-                        result.nitro_.speed_++;
-                    }
-                    if (stallionVector[id].isStamina()) {
-                        result.nitro_.stamina_++;
-                    }
-                    if (stallionVector[id].isSpirit()) {
-                        result.nitro_.spirit_++;
-                    }
-                    if (stallionVector[id].isPower()) {
-                        result.nitro_.power_++;
-                    }
-                }
-                if (id != ignoreIndex) {
-                    stallionsSet.insert(id);
-                }
+    static inline void countNitro(const base::Stallion& stallion, Nitro& nitro) {
+        if (stallion.isSprint()) {
+            nitro.sprint_++;
+        }
+        if (stallion.isSpeed()) {
+            nitro.speed_++;
+        }
+        if (stallion.isStamina()) {
+            nitro.stamina_++;
+        }
+        if (stallion.isSpirit()) {
+            nitro.spirit_++;
+        }
+        if (stallion.isPower()) {
+            nitro.power_++;
+        }
+    }
+
+    // ニトロの数え上げ. 祖先の重複は1度だけ数える.
+    static inline void computeNitro(const PedigreeAnalysis& result) {
+        PEDSEARCH_PROFILE_STAGE(NITRO);
+        const base::DefaultStallion& stallion = *result.stallion_;
+        const base::DefaultBroodmare& broodmare = *result.broodmare_;
+        const std::vector<base::Stallion>& stallionVector = *result.stallionVector_;
+        size_t ignoreIndex = result.ignoreIndex_;
+        std::pmr::set<size_t> stallionsSet(AnalysisArena::getResource());
+        size_t id;
+        for (unsigned int i = 1; i <= 15; i++) {
+            id = stallion.getAncestorIndex(i);
+            if (id != ignoreIndex && stallionsSet.find(id) == stallionsSet.end()) {
+                countNitro(stallionVector[id], result.nitro_);
             }
+            if (id != ignoreIndex) {
+                stallionsSet.insert(id);
+            }
+        }
 
-            for (unsigned int i = 1; i <= 15; i++) {
-                id = broodmare.getAncestorIndex(i);
-                if (id != ignoreIndex && stallionsSet.find(id) == stallionsSet.end()) {
-                    if (stallionVector[id].isSprint()) {
-                        result.nitro_.sprint_++;
-                    }
-                    if (stallionVector[id].isSpeed()) {
-                        result.nitro_.speed_++;
-                    }
-                    if (stallionVector[id].isStamina()) {
-                        result.nitro_.stamina_++;
-                    }
-                    if (stallionVector[id].isSpirit()) {
-                        result.nitro_.spirit_++;
-                    }
-                    if (stallionVector[id].isPower()) {
-                        result.nitro_.power_++;
-                    }
-                }
-                if (id != ignoreIndex) {
-                    stallionsSet.insert(id);
-                }
+        for (unsigned int i = 1; i <= 15; i++) {
+            id = broodmare.getAncestorIndex(i);
+            if (id != ignoreIndex && stallionsSet.find(id) == stallionsSet.end()) {
+                countNitro(stallionVector[id], result.nitro_);
             }
-        } else if (cross) {
-            std::set<size_t> stallionsSet;
-            size_t id1, id2;
-            std::vector<unsigned int> generation;
-            std::set<std::pair<base::Index, base::Index> > invalidPairs;
-            for (unsigned int i = 0; i <= 15; i++) {
-                id1 = stallion.getAncestorIndex(i);
-                bool hasCross = false;
-
-                if (id1 != ignoreIndex && nitro && i != 0 && stallionsSet.find(id1) == stallionsSet.end()) {
-                    stallionsSet.insert(id1);
-                    if (stallionVector[id1].isSprint()) {
-                        result.nitro_.sprint_++;
-                    }
-                    if (stallionVector[id1].isSpeed()) {
-                        result.nitro_.speed_++;
-                    }
-                    if (stallionVector[id1].isStamina()) {
-                        result.nitro_.stamina_++;
-                    }
-                    if (stallionVector[id1].isSpirit()) {
-                        result.nitro_.spirit_++;
-                    }
-                    if (stallionVector[id1].isPower()) {
-                        result.nitro_.power_++;
+            if (id != ignoreIndex) {
+                stallionsSet.insert(id);
+            }
+        }
+    }
+
+    // クロスの判定
+    static inline void computeCross(const PedigreeAnalysis& result) {
+        PEDSEARCH_PROFILE_STAGE(CROSS);
+        const base::DefaultStallion& stallion = *result.stallion_;
+        const base::DefaultBroodmare& broodmare = *result.broodmare_;
+        size_t ignoreIndex = result.ignoreIndex_;
+        size_t id1, id2;
+        std::pmr::set<std::pair<base::Index, base::Index> > invalidPairs(AnalysisArena::getResource());
+        for (unsigned int i = 0; i <= 15; i++) {
+            id1 = stallion.getAncestorIndex(i);
+            bool hasCross = false;
+
+            if (result.cross_.hasCross(id1)) {
+                result.cross_.append(id1, indexToGeneration(i));
+            } else {
+                for (unsigned int j = 1; j <= 15; j++) {
+                    id2 = broodmare.getAncestorIndex(j);
+                    if (id1 != ignoreIndex && id1 == id2 && invalidPairs.find(std::make_pair(i,j)) == invalidPairs.end()) {
+                        hasCross = true;
+                        result.cross_.append(id1, indexToGeneration(j));
+                        appendInvalidIndexPairs(i, j, invalidPairs);
+                        j = indexSkipForCrossSearch(j);
                     }
                 }
 
-                if (result.cross_.hasCross(id1)) {
+                if (hasCross) {
                     result.cross_.append(id1, indexToGeneration(i));
-                } else {
-                    for (unsigned int j = 1; j <= 15; j++) {
-                        id2 = broodmare.getAncestorIndex(j);
-                        if (id2 != ignoreIndex && nitro && i == 0 && stallionsSet.find(id2) == stallionsSet.end()) {
-                            stallionsSet.insert(id2);
-                            if (stallionVector[id2].isSprint()) {
-                                result.nitro_.sprint_++;
-                            }
-                            if (stallionVector[id2].isSpeed()) {
-                                result.nitro_.speed_++;
-                            }
-                            if (stallionVector[id2].isStamina()) {
-                                result.nitro_.stamina_++;
-                            }
-                            if (stallionVector[id2].isSpirit()) {
-                                result.nitro_.spirit_++;
-                            }
-                            if (stallionVector[id2].isPower()) {
-                                result.nitro_.power_++;
-                            }
-                        }
-
-                        if (id1 != ignoreIndex && id1 == id2 && invalidPairs.find(std::make_pair(i,j)) == invalidPairs.end()) {
-                            hasCross = true;
-                            result.cross_.append(id1, indexToGeneration(j));
-                            appendInvalidIndexPairs(i, j, invalidPairs);
-                            if (i != 0 || !nitro) {
-                                // ニトロを数え上げる場合はi==0のときスキップできない
-                                j = indexSkipForCrossSearch(j);
-                            }
-                        }
-                    }
-
-                    if (hasCross) {
-                        result.cross_.append(id1, indexToGeneration(i));
-                    }
                 }
             }
         }
+    }
 
+    // FACETSの分析を行う. 分岐はコンパイル時に決まる.
+    template <unsigned int FACETS> static void computeFacets(const PedigreeAnalysis& result) {
+        if constexpr ((FACETS & PedigreeAnalysis::INTERESTING) != 0) {
+            computeInteresting(result);
+        }
+        if constexpr ((FACETS & PedigreeAnalysis::WONDERFUL) != 0) {
+            computeWonderful(result);
+        }
+        if constexpr ((FACETS & PedigreeAnalysis::ELABORATED) != 0) {
+            computeElaborated(result);
+        }
+        if constexpr ((FACETS & PedigreeAnalysis::CROSS) != 0) {
+            computeCross(result);
+        }
+        if constexpr ((FACETS & PedigreeAnalysis::NITRO) != 0) {
+            computeNitro(result);
+        }
+        result.computed_ |= FACETS;
+    }
+
+    using ComputeFunction = void (*)(const PedigreeAnalysis&);
+
+    template <size_t... FACETS> static const ComputeFunction* makeComputeTable(std::index_sequence<FACETS...>) {
+        static const ComputeFunction table[] = {&computeFacets<(unsigned int)FACETS>...};
+        return table;
+    }
+
+    // 実行時の分析の組み合わせから特殊化を選ぶ
+    static inline ComputeFunction getComputeFunction(unsigned int facets) {
+        static const ComputeFunction* table = makeComputeTable(std::make_index_sequence<PedigreeAnalysis::ALL + 1>());
+        return table[facets];
+    }
+
+    // 分析が済んでいなければ行う
+    static inline void compute(const PedigreeAnalysis& result, unsigned int facets) {
+        getComputeFunction(facets & ~result.computed_)(result);
+    }
+
+public:
+    // フラグがtrueの分析はこの場で行い, falseの分析は最初に参照されたときに行う
+    static inline PedigreeAnalysis analyze(
+        const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare,
+        const std::vector<base::Stallion>& stallionVector, const base::ElaboratedPairs& pairs,
+        size_t ignoreIndex, bool interesting=true, bool wonderful=true, bool elaborated=true,
+        bool cross=true, bool nitro=true
+    ) {
+        PedigreeAnalysis result(stallion, broodmare, stallionVector, pairs, ignoreIndex);
+        unsigned int facets = 0;
+        facets |= interesting ? PedigreeAnalysis::INTERESTING : 0u;
+        facets |= wonderful ? PedigreeAnalysis::WONDERFUL : 0u;
+        facets |= elaborated ? PedigreeAnalysis::ELABORATED : 0u;
+        facets |= cross ? PedigreeAnalysis::CROSS : 0u;
+        facets |= nitro ? PedigreeAnalysis::NITRO : 0u;
+        getComputeFunction(facets)(result);
+        return result;
+    }
+
+    // FACETSの分析をこの場で行う. 探索のように組み合わせが先に決まる場合はこちらを使う.
+    template <unsigned int FACETS> static inline PedigreeAnalysis analyze(
+        const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare,
+        const std::vector<base::Stallion>& stallionVector, const base::ElaboratedPairs& pairs, size_t ignoreIndex
+    ) {
+        PedigreeAnalysis result(stallion, broodmare, stallionVector, pairs, ignoreIndex);
+        computeFacets<FACETS>(result);
         return result;
     }
 };
 
+inline void PedigreeAnalysis::compute(unsigned int facets) const {
+    if ((facets & ~computed_) != 0) {
+        PedigreeAnalyzer::compute(*this, facets);
+    }
+}
+
 }
 }
 
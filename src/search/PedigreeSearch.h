@@ -0,0 +1,490 @@
+#ifndef SEARCH_PEDIGREESEARCH_H
+#define SEARCH_PEDIGREESEARCH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
+#include <set>
+#include <vector>
+#include "search/Arena.h"
+#include "search/Filter.h"
+#include "search/PedigreeAnalyzer.h"
+#include "search/PedigreeTool.h"
+#include "search/Profiler.h"
+#include "search/Progress.h"
+#include "search/ResultCache.h"
+#include "search/SearchQuery.h"
+#include "search/SearchResult.h"
+#include "search/StoredResults.h"
+
+namespace pedsearch {
+namespace search {
+
+class SearchEngine {
+private:
+    const PedigreeTool& tool_;
+    const SearchSpace space_;
+    const std::optional<Filter> filter_;
+    const StoredResults* stored_ = nullptr;
+    ResultCache* cache_ = nullptr;
+    uint64_t cacheVersion_ = 0;
+
+    void setChain(uint64_t row, size_t* chain, SearchResult& result) const {
+        space_.decode(row, chain);
+        result.row_ = row;
+        for (unsigned int i = 0; i <= space_.getGeneration(); i++) {
+            result.chain_[i] = (uint16_t)chain[i];
+        }
+    }
+
+    // 位置1..generation-1の種牡馬を母側から順に配合して繁殖牝馬を作る
+    base::DefaultBroodmare makeBroodmare(const size_t* chain) const {
+        unsigned int generation = space_.getGeneration();
+        std::optional<base::DefaultBroodmare> broodmare(tool_.defaultBroodmares_[chain[generation]]);
+        for (unsigned int i = generation - 1; i >= 1; i--) {
+            broodmare.emplace(tool_.deriveBroodmare(tool_.defaultStallions_[chain[i]], *broodmare));
+        }
+        return *broodmare;
+    }
+
+    void restore(const CompactResult& cached, SearchResult& result) const {
+        result.setFlag(SearchResult::ELABORATED, cached.isElaborated());
+        result.setFlag(SearchResult::INTERESTING, cached.isInteresting());
+        result.setFlag(SearchResult::WONDERFUL, cached.isWonderful());
+        result.setFlag(SearchResult::DANGER, cached.isDanger());
+        result.setNumCrosses(cached.getNumCrosses());
+        result.setEffects(cached.effects);
+        result.speedNitro_ = cached.nitros[0];
+        result.staminaNitro_ = cached.nitros[1];
+        result.powerNitro_ = cached.nitros[2];
+    }
+
+    // キャッシュを使う場合. 血統表の指紋で引き, 無ければすべて分析して加える.
+    // 条件があっても全体を分析するので, 除かれた行も次の問い合わせで使える.
+    bool evaluateCached(uint64_t row, SearchResult& result) const {
+        size_t chain[SearchQuery::MAX_GENERATION + 1] = {};
+        setChain(row, chain, result);
+        const base::DefaultStallion& stallion = tool_.defaultStallions_[chain[0]];
+        std::optional<base::DefaultBroodmare> derived;
+        const base::DefaultBroodmare& broodmare = (space_.getGeneration() == 1) ?
+            tool_.defaultBroodmares_[chain[1]] : derived.emplace(makeBroodmare(chain));
+
+        PedigreeKey key = PedigreeKey::of(stallion, broodmare);
+        CompactResult cached;
+        if (cache_->load(cacheVersion_, key, cached)) {
+            restore(cached, result);
+        } else {
+            PedigreeAnalysis analysis = PedigreeAnalyzer::analyze<PedigreeAnalysis::ALL>(
+                stallion, broodmare, tool_.stallions_, tool_.elaboratedPairs_, tool_.ignoreStallionIndex_
+            );
+            summarize(analysis, result, true);
+            cache_->store(cacheVersion_, key, CompactResult::of(result));
+        }
+        return !filter_ || filter_->matches(result);
+    }
+
+    void summarizeFlags(const PedigreeAnalysis& analysis, SearchResult& result) const {
+        result.setFlag(SearchResult::ELABORATED, analysis.isElaborated());
+        result.setFlag(SearchResult::INTERESTING, analysis.isInteresting());
+        result.setFlag(SearchResult::WONDERFUL, analysis.isWonderful());
+    }
+
+    void summarizeCross(const PedigreeAnalysis& analysis, SearchResult& result) const {
+        std::pmr::set<size_t> crosses(AnalysisArena::getResource());
+        analysis.getCross().getCrossIndices(crosses);
+        result.setNumCrosses((unsigned int)crosses.size());
+        bool danger = false;
+        unsigned int effects[11] = {};
+        for (auto it = crosses.begin(); it != crosses.end(); ++it) {
+            if (analysis.getCross().getBloodVolume(*it) >= 50.0) {
+                danger = true;
+            }
+
+            const base::Stallion& stallion = tool_.stallions_[*it];
+            effects[0] += stallion.isSprint() ? 1 : 0;
+            effects[1] += stallion.isSpeed() ? 1 : 0;
+            effects[2] += stallion.isStamina() ? 1 : 0;
+            effects[3] += stallion.isSpirit() ? 1 : 0;
+            effects[4] += stallion.isStable() ? 1 : 0;
+            effects[5] += stallion.isTemper() ? 1 : 0;
+            effects[6] += stallion.isPrecocious() ? 1 : 0;
+            effects[7] += stallion.isAltrical() ? 1 : 0;
+            effects[8] += stallion.isTough() ? 1 : 0;
+            effects[9] += stallion.isDirt() ? 1 : 0;
+            effects[10] += stallion.isPower() ? 1 : 0;
+        }
+        result.setFlag(SearchResult::DANGER, danger);
+        result.setEffects(effects);
+    }
+
+    void summarizeNitro(const PedigreeAnalysis& analysis, SearchResult& result) const {
+        result.speedNitro_ = (int8_t)analysis.getNitro().getSpeedNitro();
+        result.staminaNitro_ = (int8_t)analysis.getNitro().getStaminaNitro();
+        result.powerNitro_ = (int8_t)analysis.getNitro().getPowerNitro();
+    }
+
+    void summarize(const PedigreeAnalysis& analysis, SearchResult& result, bool cross) const {
+        PEDSEARCH_PROFILE_STAGE(SUMMARIZE);
+        summarizeFlags(analysis, result);
+        if (cross) {
+            summarizeCross(analysis, result);
+        }
+        summarizeNitro(analysis, result);
+    }
+
+    // 条件の評価に使う行. 参照された列に必要な分析だけを行う.
+    class LazyRow {
+    private:
+        const SearchEngine& engine_;
+        const PedigreeAnalysis& analysis_;
+        SearchResult& result_;
+        mutable bool summarized_;
+
+        const SearchResult& cross() const {
+            if (!summarized_) {
+                engine_.summarizeCross(analysis_, result_);
+                summarized_ = true;
+            }
+            return result_;
+        }
+
+    public:
+        LazyRow(const SearchEngine& engine, const PedigreeAnalysis& analysis, SearchResult& result) :
+            engine_(engine), analysis_(analysis), result_(result), summarized_(false) {}
+
+        // 危険/因子/クロスの数をresultに書き込み済みか
+        bool isSummarized() const {
+            return summarized_;
+        }
+
+        bool isElaborated() const { return analysis_.isElaborated(); }
+        bool isInteresting() const { return analysis_.isInteresting(); }
+        bool isWonderful() const { return analysis_.isWonderful(); }
+        bool isDanger() const { return cross().isDanger(); }
+        unsigned int getNumCrosses() const { return cross().getNumCrosses(); }
+        unsigned int getEffect(unsigned int effect) const { return cross().getEffect(effect); }
+        int getSpeedNitro() const { return analysis_.getNitro().getSpeedNitro(); }
+        int getStaminaNitro() const { return analysis_.getNitro().getStaminaNitro(); }
+        int getPowerNitro() const { return analysis_.getNitro().getPowerNitro(); }
+    };
+
+    // 分析をまだ行っていない部分も含めて条件で絞り, 満たせば残りの分析を行ってresultに書く.
+    // 各分析は参照されたときに行われるので, 条件で除かれた行は残りの分析を省ける.
+    bool complete(const PedigreeAnalysis& analysis, SearchResult& result) const {
+        if (!filter_) {
+            analysis.computeAll();
+            summarize(analysis, result, true);
+            return true;
+        }
+        LazyRow lazy(*this, analysis, result);
+        if (!filter_->matches(lazy)) {
+            return false;
+        }
+        analysis.computeAll();
+        summarize(analysis, result, !lazy.isSummarized());
+        return true;
+    }
+
+public:
+    SearchEngine(const PedigreeTool& tool, SearchSpace space, std::optional<Filter> filter=std::nullopt) :
+        tool_(tool), space_(std::move(space)), filter_(std::move(filter)) {}
+
+    const SearchSpace& getSpace() const {
+        return space_;
+    }
+
+    const std::optional<Filter>& getFilter() const {
+        return filter_;
+    }
+
+    // 以前の結果を持つ行は分析せずにstoredから取り出す. nullptrなら常に分析する.
+    void setStoredResults(const StoredResults* stored) {
+        stored_ = stored;
+    }
+
+    // 分析の結果をcacheの版versionに読み書きする. nullptrなら使わない.
+    void setResultCache(ResultCache* cache, uint64_t version) {
+        cache_ = cache;
+        cacheVersion_ = version;
+    }
+
+    // 行rowの鎖をresultに書き, FACETSの分析を先に行ったPedigreeAnalysisをvisitorに渡す. 残りは参照されたときに行う.
+    // 分析は作った繁殖牝馬を参照するので, visitorの外へ持ち出さないこと.
+    // 分析を使い終えるまで呼び出し側でArenaScopeを保つこと(無ければヒープから確保する).
+    template <unsigned int FACETS, class Visitor> auto analyze(
+        uint64_t row, SearchResult& result, Visitor visitor
+    ) const {
+        size_t chain[SearchQuery::MAX_GENERATION + 1] = {};
+        setChain(row, chain, result);
+
+        const base::DefaultStallion& stallion = tool_.defaultStallions_[chain[0]];
+        std::optional<base::DefaultBroodmare> derived;
+        const base::DefaultBroodmare& broodmare = (space_.getGeneration() == 1) ?
+            tool_.defaultBroodmares_[chain[1]] : derived.emplace(makeBroodmare(chain));
+        PedigreeAnalysis analysis = PedigreeAnalyzer::analyze<FACETS>(
+            stallion, broodmare, tool_.stallions_, tool_.elaboratedPairs_, tool_.ignoreStallionIndex_
+        );
+        return visitor(analysis);
+    }
+
+    // 種牡馬stallion(id)と任意の繁殖牝馬の配合を, 参照された列に必要な分析だけを行う行としてvisitorに渡す
+    template <class Visitor> auto visit(
+        size_t stallion, const base::DefaultBroodmare& broodmare, Visitor visitor
+    ) const {
+        ArenaScope scope;
+        PedigreeAnalysis analysis = PedigreeAnalyzer::analyze<0>(
+            tool_.defaultStallions_[stallion], broodmare, tool_.stallions_, tool_.elaboratedPairs_,
+            tool_.ignoreStallionIndex_
+        );
+        SearchResult result;
+        const LazyRow lazy(*this, analysis, result);
+        return visitor(lazy);
+    }
+
+    // 種牡馬stallion(id)と任意の繁殖牝馬の配合をすべて評価する. 行番号は0, 鎖は位置0だけを設定する.
+    void evaluate(size_t stallion, const base::DefaultBroodmare& broodmare, SearchResult& result) const {
+        ArenaScope scope;
+        result = SearchResult();
+        result.chain_[0] = (uint16_t)stallion;
+        PedigreeAnalysis analysis = PedigreeAnalyzer::analyze<PedigreeAnalysis::ALL>(
+            tool_.defaultStallions_[stallion], broodmare, tool_.stallions_, tool_.elaboratedPairs_,
+            tool_.ignoreStallionIndex_
+        );
+        summarize(analysis, result, true);
+    }
+
+    // 行rowを評価する. 条件が無いか条件を満たせばtrueを返す. falseの場合resultの一部は未設定.
+    // 分析の一時的な構造はこのスレッドの領域から確保し, 外側にArenaScopeが無ければ戻る前に捨てる.
+    bool evaluate(uint64_t row, SearchResult& result) const {
+        ArenaScope scope;
+        if (stored_ != nullptr && stored_->load(row, result)) {
+            size_t chain[SearchQuery::MAX_GENERATION + 1] = {};
+            setChain(row, chain, result);
+            return !filter_ || filter_->matches(result);
+        }
+        if (cache_ != nullptr) {
+            return evaluateCached(row, result);
+        }
+
+        // 条件が無ければすべての分析を特殊化した関数で一度に行う
+        if (!filter_) {
+            analyze<PedigreeAnalysis::ALL>(row, result, [&](const PedigreeAnalysis& analysis) {
+                summarize(analysis, result, true);
+            });
+            return true;
+        }
+
+        return analyze<0>(row, result, [&](const PedigreeAnalysis& analysis) {
+            return complete(analysis, result);
+        });
+    }
+
+    // 行rowを, 呼び出し側で作っておいたその行の繁殖牝馬broodmareで評価する. 同じ母に父だけを替えて評価する場合に使う.
+    // 先に分析(各分析は参照されたときに行う)をacceptに渡し, falseなら残りを評価せずにfalseを返す.
+    template <class Accept> bool evaluate(
+        uint64_t row, const base::DefaultBroodmare& broodmare, SearchResult& result, Accept accept
+    ) const {
+        ArenaScope scope;
+        size_t chain[SearchQuery::MAX_GENERATION + 1] = {};
+        setChain(row, chain, result);
+        PedigreeAnalysis analysis = PedigreeAnalyzer::analyze<0>(
+            tool_.defaultStallions_[chain[0]], broodmare, tool_.stallions_, tool_.elaboratedPairs_,
+            tool_.ignoreStallionIndex_
+        );
+        return accept(analysis) && complete(analysis, result);
+    }
+
+    // 行番号[begin, end)のうち条件を満たす行でbatchを置き換える. 領域はまとめて最後に空にする.
+    void evaluate(uint64_t begin, uint64_t end, std::vector<SearchResult>& batch) const {
+        ArenaScope scope;
+        batch.resize(end - begin);
+        size_t n = 0;
+        for (uint64_t row = begin; row < end; row++) {
+            if (evaluate(row, batch[n])) {
+                n++;
+            }
+        }
+        batch.resize(n);
+    }
+
+    // 行番号[begin, end)のうち条件を満たす行でbatchを置き換える. 分析はFACETS(Filter::Facetの論理和)の段階だけを行い,
+    // 含まれない段階の列は0のままにする. 集計のように使う列が先に決まっている場合に使う. 条件はFACETSの列だけを参照すること.
+    template <unsigned int FACETS> void evaluatePartial(
+        uint64_t begin, uint64_t end, std::vector<SearchResult>& batch
+    ) const {
+        constexpr unsigned int ANALYSIS_FACETS =
+            (((FACETS & Filter::FLAGS) != 0) ?
+                PedigreeAnalysis::INTERESTING | PedigreeAnalysis::WONDERFUL | PedigreeAnalysis::ELABORATED : 0u)
+            | (((FACETS & Filter::NITRO) != 0) ? (unsigned int)PedigreeAnalysis::NITRO : 0u)
+            | (((FACETS & Filter::CROSS) != 0) ? (unsigned int)PedigreeAnalysis::CROSS : 0u);
+        ArenaScope scope;
+        batch.resize(end - begin);
+        size_t n = 0;
+        for (uint64_t row = begin; row < end; row++) {
+            SearchResult& result = batch[n];
+            result = SearchResult();
+            bool matched = analyze<ANALYSIS_FACETS>(row, result, [&](const PedigreeAnalysis& analysis) {
+                if constexpr ((FACETS & Filter::FLAGS) != 0) {
+                    summarizeFlags(analysis, result);
+                }
+                if constexpr ((FACETS & Filter::NITRO) != 0) {
+                    summarizeNitro(analysis, result);
+                }
+                if constexpr ((FACETS & Filter::CROSS) != 0) {
+                    summarizeCross(analysis, result);
+                }
+                return !filter_ || filter_->matches(result);
+            });
+            if (matched) {
+                n++;
+            }
+        }
+        batch.resize(n);
+    }
+};
+
+// tool.search(query)が返す遅延評価の範囲. 内部でBATCH_SIZE行ずつまとめて評価する.
+class SearchRange {
+private:
+    SearchEngine engine_;
+    std::vector<SearchResult> batch_;
+    uint64_t next_;
+    uint64_t end_;
+    size_t cursor_;
+    Progress* progress_;
+
+    // 条件で全行が除かれた場合は次の範囲を評価する
+    bool fill() {
+        cursor_ = 0;
+        do {
+            uint64_t end = std::min(next_ + BATCH_SIZE, end_);
+            if (next_ >= end) {
+                batch_.clear();
+                return false;
+            }
+            engine_.evaluate(next_, end, batch_);
+            if (progress_ != nullptr) {
+                progress_->add(0, end - next_);
+            }
+            next_ = end;
+        } while (batch_.empty());
+        return true;
+    }
+
+public:
+    static constexpr uint64_t BATCH_SIZE = 1024;
+
+    class iterator {
+    private:
+        SearchRange* range_;
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = SearchResult;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const SearchResult*;
+        using reference = const SearchResult&;
+
+        iterator(SearchRange* range=nullptr) : range_(range) {
+            if (range_ != nullptr && range_->cursor_ >= range_->batch_.size() && !range_->fill()) {
+                range_ = nullptr;
+            }
+        }
+
+        reference operator*() const {
+            return range_->batch_[range_->cursor_];
+        }
+
+        pointer operator->() const {
+            return &range_->batch_[range_->cursor_];
+        }
+
+        iterator& operator++() {
+            range_->cursor_++;
+            if (range_->cursor_ >= range_->batch_.size() && !range_->fill()) {
+                range_ = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator& it) const {
+            return range_ == it.range_;
+        }
+
+        bool operator!=(const iterator& it) const {
+            return range_ != it.range_;
+        }
+    };
+
+    SearchRange(const PedigreeTool& tool, SearchSpace space, std::optional<Filter> filter=std::nullopt) :
+        engine_(tool, std::move(space), std::move(filter)), next_(0), cursor_(0), progress_(nullptr) {
+        end_ = engine_.getSpace().size();
+        batch_.reserve(BATCH_SIZE);
+    }
+
+    const SearchSpace& getSpace() const {
+        return engine_.getSpace();
+    }
+
+    uint64_t size() const {
+        return engine_.getSpace().size();
+    }
+
+    // 行番号rowから評価し直す. 途中から再開するときにbegin()の前に呼ぶ.
+    void seek(uint64_t row) {
+        next_ = std::min(row, end_);
+        batch_.clear();
+        cursor_ = 0;
+    }
+
+    // 行番号[begin, end)だけを評価する. 探索空間を分けて複数のプロセスで探索するときに使う.
+    void setRange(uint64_t begin, uint64_t end) {
+        end_ = std::min(end, engine_.getSpace().size());
+        seek(begin);
+    }
+
+    uint64_t getEnd() const {
+        return end_;
+    }
+
+    void setStoredResults(const StoredResults* stored) {
+        engine_.setStoredResults(stored);
+    }
+
+    void setResultCache(ResultCache* cache, uint64_t version) {
+        engine_.setResultCache(cache, version);
+    }
+
+    // 評価した組の数をprogressに足していく. seekで飛ばした行は含まない.
+    void setProgress(Progress* progress) {
+        progress_ = progress;
+    }
+
+    // 条件を満たす行を1つ以上含む次のまとまりを返す. 残りが無ければ空. 返した配列は次に呼ぶまで有効.
+    // 書き出しや上位k件の選択はまとまりごとにこちらで受け取る. begin()/end()と混ぜて使わないこと.
+    const std::vector<SearchResult>& nextBatch() {
+        fill();
+        cursor_ = batch_.size();
+        return batch_;
+    }
+
+    // 行番号がこれより小さい結果はすべて返し終えている(条件で除かれた行を含む)
+    uint64_t getCompletedRows() const {
+        return cursor_ < batch_.size() ? batch_[cursor_].getRow() : next_;
+    }
+
+    iterator begin() {
+        return iterator(this);
+    }
+
+    iterator end() {
+        return iterator();
+    }
+};
+
+}
+}
+
+#endif // SEARCH_PEDIGREESEARCH_H
@@ -1,229 +1,219 @@
+#include <algorithm>
 #include <regex>
+#include "search/PedigreeSearch.h"
 #include "search/PedigreeTool.h"
 
 namespace pedsearch {
 namespace search {
 
-    void PedigreeTool::readDefaultBroodmares(std::string_view path) {
-        std::ifstream istream(path.data());
-        if (!istream) {
+    size_t PedigreeTool::findStallionIndex(std::string_view name, std::string_view context) const {
+        auto it = stallionMap_.find(std::string(name));
+        if (it == stallionMap_.end()) {
             throw std::runtime_error(
-                "PedigreeTool::readDefaultBroodmares: cannot open " + std::string(path) + "."
+                std::string(context) + ": The stallion \"" + std::string(name) + "\" is not in stallions.json."
             );
         }
-        json broodmaresList = json::parse(istream);
-        for (size_t i = 0; i < broodmaresList.size(); i++) {
-            std::string_view name = broodmaresList[i]["name"].get<std::string_view>();
-
-            size_t ancestors[16];
-            ancestors[0] = ignoreStallionIndex_;
-            ancestors[1] = stallionMap_.at(broodmaresList[i]["ancestors"][0].get<std::string>());
-            base::Stallion s = stallions_[ancestors[1]];
-            ancestors[2] = stallionMap_.at(s.getSireName(0).data());
-            ancestors[6] = stallionMap_.at(s.getSireName(1).data());
-            ancestors[8] = stallionMap_.at(s.getSireName(2).data());
-            base::Stallion ss = stallions_[ancestors[2]];
-            ancestors[3] = stallionMap_.at(ss.getSireName(0).data());
-            ancestors[5] = stallionMap_.at(ss.getSireName(1).data());
-            base::Stallion sss = stallions_[ancestors[3]];
-            ancestors[4] = stallionMap_.at(sss.getSireName(0).data());
-            base::Stallion sds = stallions_[ancestors[6]];
-            ancestors[7] = stallionMap_.at(sds.getSireName(0).data());
-            ancestors[9] = stallionMap_.at(broodmaresList[i]["ancestors"][1].get<std::string>());
-            base::Stallion ds = stallions_[ancestors[9]];
-            ancestors[10] = stallionMap_.at(ds.getSireName(0).data());
-            ancestors[12] = stallionMap_.at(ds.getSireName(1).data());
-            base::Stallion dss = stallions_[ancestors[10]];
-            ancestors[11] = stallionMap_.at(dss.getSireName(0).data());
-            ancestors[13] = stallionMap_.at(broodmaresList[i]["ancestors"][2].get<std::string>());
-            base::Stallion dds = stallions_[ancestors[13]];
-            ancestors[14] = stallionMap_.at(dds.getSireName(0).data());
-            ancestors[15] = stallionMap_.at(broodmaresList[i]["ancestors"][3].get<std::string>());
-
-            unsigned int indices[8];
-            for (size_t j = 0; j < 4; j++) {
-                indices[j] = broodmaresList[i]["indices"][j].get<unsigned int>();
-            }
+        return (*it).second;
+    }
 
-            unsigned int fee = broodmaresList[i]["fee"].get<unsigned int>();
-            unsigned int speed = broodmaresList[i]["speed"].get<unsigned int>();
-            unsigned int stamina = broodmaresList[i]["stamina"].get<unsigned int>();
-            unsigned int power = broodmaresList[i]["power"].get<unsigned int>();
-            base::Dirt dirt;
-            std::string_view d = broodmaresList[i]["dirt"].get<std::string_view>();
-            if (d == "◎") {
-                dirt = base::Dirt::GOOD;
-            } else if (d == "○") {
-                dirt = base::Dirt::NORMAL;
-            } else if (d == "?") {
-                dirt = base::Dirt::UNKNOWN;
-            } else {
-                throw std::runtime_error(
-                    "PedigreeTool::readDefaultBroodmares: unknown dirt \"" + std::string(d) + "\"."
-                );
-            }
+    void PedigreeTool::resolveAncestors(const json& names, size_t* ancestors, std::string_view context) const {
+        ancestors[1] = findStallionIndex(names.at(0).get<std::string_view>(), context);
+        const base::Stallion& s = stallions_[ancestors[1]];
+        ancestors[2] = findStallionIndex(s.getSireName(0), context);
+        ancestors[6] = findStallionIndex(s.getSireName(1), context);
+        ancestors[8] = findStallionIndex(s.getSireName(2), context);
+        const base::Stallion& ss = stallions_[ancestors[2]];
+        ancestors[3] = findStallionIndex(ss.getSireName(0), context);
+        ancestors[5] = findStallionIndex(ss.getSireName(1), context);
+        const base::Stallion& sss = stallions_[ancestors[3]];
+        ancestors[4] = findStallionIndex(sss.getSireName(0), context);
+        const base::Stallion& sds = stallions_[ancestors[6]];
+        ancestors[7] = findStallionIndex(sds.getSireName(0), context);
+        ancestors[9] = findStallionIndex(names.at(1).get<std::string_view>(), context);
+        const base::Stallion& ds = stallions_[ancestors[9]];
+        ancestors[10] = findStallionIndex(ds.getSireName(0), context);
+        ancestors[12] = findStallionIndex(ds.getSireName(1), context);
+        const base::Stallion& dss = stallions_[ancestors[10]];
+        ancestors[11] = findStallionIndex(dss.getSireName(0), context);
+        ancestors[13] = findStallionIndex(names.at(2).get<std::string_view>(), context);
+        const base::Stallion& dds = stallions_[ancestors[13]];
+        ancestors[14] = findStallionIndex(dds.getSireName(0), context);
+        ancestors[15] = findStallionIndex(names.at(3).get<std::string_view>(), context);
+    }
 
-            defaultBroodmares_.push_back(
-                base::DefaultBroodmare(ancestors, indices, fee, speed, stamina, power, dirt)
-            );
-            defaultBroodmareMap_.insert(std::make_pair(name, defaultBroodmares_.size() - 1));
+    void PedigreeTool::addDefaultBroodmare(const json& broodmare, std::string_view context) {
+        std::string name = broodmare.at("name").get<std::string>();
+        if (defaultBroodmareMap_.count(name) != 0) {
+            throw std::runtime_error(std::string(context) + ": The broodmare \"" + name + "\" is duplicated.");
         }
+
+        size_t ancestors[16];
+        ancestors[0] = ignoreStallionIndex_;
+        resolveAncestors(broodmare.at("ancestors"), ancestors, context);
+
+        unsigned int indices[8];
+        for (size_t j = 0; j < 4; j++) {
+            indices[j] = broodmare.at("indices").at(j).get<unsigned int>();
+        }
+
+        unsigned int fee = broodmare.at("fee").get<unsigned int>();
+        unsigned int speed = broodmare.at("speed").get<unsigned int>();
+        unsigned int stamina = broodmare.at("stamina").get<unsigned int>();
+        unsigned int power = broodmare.at("power").get<unsigned int>();
+        base::Dirt dirt;
+        std::string_view d = broodmare.at("dirt").get<std::string_view>();
+        if (d == "◎") {
+            dirt = base::Dirt::GOOD;
+        } else if (d == "○") {
+            dirt = base::Dirt::NORMAL;
+        } else if (d == "?") {
+            dirt = base::Dirt::UNKNOWN;
+        } else {
+            throw std::runtime_error(std::string(context) + ": unknown dirt \"" + std::string(d) + "\".");
+        }
+
+        defaultBroodmares_.push_back(
+            base::DefaultBroodmare(ancestors, indices, fee, speed, stamina, power, dirt)
+        );
+        defaultBroodmareMap_.insert(std::make_pair(name, defaultBroodmares_.size() - 1));
+        defaultBroodmareNames_.push_back(name);
     }
 
-    void PedigreeTool::readDefaultStallions(std::string_view path) {
-        std::ifstream istream(path.data());
-        if (!istream) {
-            throw std::runtime_error(
-                "PedigreeTool::readDefaultStallions: cannot open " + std::string(path) + "."
-            );
+    void PedigreeTool::addDefaultStallion(const json& stallion, std::string_view context) {
+        std::string name = stallion.at("name").get<std::string>();
+        if (defaultStallionMap_.count(name) != 0) {
+            throw std::runtime_error(std::string(context) + ": The stallion \"" + name + "\" is duplicated.");
         }
-        json stallionsList = json::parse(istream);
-        for (size_t i = 0; i < stallionsList.size(); i++) {
-            std::string_view name = stallionsList[i]["name"].get<std::string_view>();
-
-            size_t ancestors[16];
-            ancestors[0] = stallionMap_.at(name.data());
-            ancestors[1] = stallionMap_.at(stallionsList[i]["ancestors"][0].get<std::string>());
-            base::Stallion s = stallions_[ancestors[1]];
-            ancestors[2] = stallionMap_.at(s.getSireName(0).data());
-            ancestors[6] = stallionMap_.at(s.getSireName(1).data());
-            ancestors[8] = stallionMap_.at(s.getSireName(2).data());
-            base::Stallion ss = stallions_[ancestors[2]];
-            ancestors[3] = stallionMap_.at(ss.getSireName(0).data());
-            ancestors[5] = stallionMap_.at(ss.getSireName(1).data());
-            base::Stallion sss = stallions_[ancestors[3]];
-            ancestors[4] = stallionMap_.at(sss.getSireName(0).data());
-            base::Stallion sds = stallions_[ancestors[6]];
-            ancestors[7] = stallionMap_.at(sds.getSireName(0).data());
-            ancestors[9] = stallionMap_.at(stallionsList[i]["ancestors"][1].get<std::string>());
-            base::Stallion ds = stallions_[ancestors[9]];
-            ancestors[10] = stallionMap_.at(ds.getSireName(0).data());
-            ancestors[12] = stallionMap_.at(ds.getSireName(1).data());
-            base::Stallion dss = stallions_[ancestors[10]];
-            ancestors[11] = stallionMap_.at(dss.getSireName(0).data());
-            ancestors[13] = stallionMap_.at(stallionsList[i]["ancestors"][2].get<std::string>());
-            base::Stallion dds = stallions_[ancestors[13]];
-            ancestors[14] = stallionMap_.at(dds.getSireName(0).data());
-            ancestors[15] = stallionMap_.at(stallionsList[i]["ancestors"][3].get<std::string>());
-
-            unsigned int indices[8];
-            for (size_t j = 0; j < 8; j++) {
-                indices[j] = stallionsList[i]["indices"][j].get<unsigned int>();
-            }
 
-            unsigned int fee = stallionsList[i]["fee"].get<unsigned int>();
-            base::Distance dist(
-                stallionsList[i]["min"].get<unsigned int>(),
-                stallionsList[i]["max"].get<unsigned int>()
-            );
+        size_t ancestors[16];
+        ancestors[0] = findStallionIndex(name, context);
+        resolveAncestors(stallion.at("ancestors"), ancestors, context);
 
-            base::Growth growth;
-            std::string_view tmp = stallionsList[i]["growth"].get<std::string_view>();
-            if (tmp == "早熟") {
-                growth = base::Growth::PRECOCIOUS;
-            } else if (tmp == "普通") {
-                growth = base::Growth::NORMAL;
-            } else if (tmp == "持続") {
-                growth = base::Growth::PERSISTENT;
-            } else if (tmp == "晩成") {
-                growth = base::Growth::ALTRICAL;
-            } else {
-                throw std::runtime_error(
-                    "PedigreeTool::readDefaultStallions: unknown growth \"" + std::string(tmp) + "\"."
-                );
-            }
+        unsigned int indices[8];
+        for (size_t j = 0; j < 8; j++) {
+            indices[j] = stallion.at("indices").at(j).get<unsigned int>();
+        }
 
-            base::Dirt dirt;
-            tmp = stallionsList[i]["dirt"].get<std::string_view>();
-            if (tmp == "◎") {
-                dirt = base::Dirt::GOOD;
-            } else if (tmp == "○") {
-                dirt = base::Dirt::NORMAL;
-            } else if (tmp == "△") {
-                dirt = base::Dirt::BAD;
-            } else {
-                throw std::runtime_error(
-                    "PedigreeTool::readDefaultStallions: unknown dirt \"" + std::string(tmp) + "\"."
-                );
-            }
+        unsigned int fee = stallion.at("fee").get<unsigned int>();
+        base::Distance dist(
+            stallion.at("min").get<unsigned int>(),
+            stallion.at("max").get<unsigned int>()
+        );
 
-            base::Grade health;
-            tmp = stallionsList[i]["health"].get<std::string_view>();
-            if (tmp == "A") {
-                health = base::Grade::A;
-            } else if (tmp == "B") {
-                health = base::Grade::B;
-            } else if (tmp == "C") {
-                health = base::Grade::C;
-            } else {
-                throw std::runtime_error(
-                    "PedigreeTool::readDefaultStallions: unknown grade \"" + std::string(tmp) + "\"."
-                );
-            }
+        base::Growth growth;
+        std::string_view tmp = stallion.at("growth").get<std::string_view>();
+        if (tmp == "早熟") {
+            growth = base::Growth::PRECOCIOUS;
+        } else if (tmp == "普通") {
+            growth = base::Growth::NORMAL;
+        } else if (tmp == "持続") {
+            growth = base::Growth::PERSISTENT;
+        } else if (tmp == "晩成") {
+            growth = base::Growth::ALTRICAL;
+        } else {
+            throw std::runtime_error(std::string(context) + ": unknown growth \"" + std::string(tmp) + "\".");
+        }
 
-            base::Grade temper;
-            tmp = stallionsList[i]["temper"].get<std::string_view>();
-            if (tmp == "A") {
-                temper = base::Grade::A;
-            } else if (tmp == "B") {
-                temper = base::Grade::B;
-            } else if (tmp == "C") {
-                temper = base::Grade::C;
-            } else {
-                throw std::runtime_error(
-                    "PedigreeTool::readDefaultStallions: unknown grade \"" + std::string(tmp) + "\"."
-                );
-            }
+        base::Dirt dirt;
+        tmp = stallion.at("dirt").get<std::string_view>();
+        if (tmp == "◎") {
+            dirt = base::Dirt::GOOD;
+        } else if (tmp == "○") {
+            dirt = base::Dirt::NORMAL;
+        } else if (tmp == "△") {
+            dirt = base::Dirt::BAD;
+        } else {
+            throw std::runtime_error(std::string(context) + ": unknown dirt \"" + std::string(tmp) + "\".");
+        }
 
-            base::Grade achievement;
-            tmp = stallionsList[i]["achievement"].get<std::string_view>();
+        // 健康, 気性, 実績, 底力, 安定の順
+        static const char* gradeKeys[5] = {"health", "temper", "achievement", "spirit", "stable"};
+        base::Grade grades[5];
+        for (size_t j = 0; j < 5; j++) {
+            tmp = stallion.at(gradeKeys[j]).get<std::string_view>();
             if (tmp == "A") {
-                achievement = base::Grade::A;
+                grades[j] = base::Grade::A;
             } else if (tmp == "B") {
-                achievement = base::Grade::B;
+                grades[j] = base::Grade::B;
             } else if (tmp == "C") {
-                achievement = base::Grade::C;
+                grades[j] = base::Grade::C;
             } else {
-                throw std::runtime_error(
-                    "PedigreeTool::readDefaultStallions: unknown grade \"" + std::string(tmp) + "\"."
-                );
+                throw std::runtime_error(std::string(context) + ": unknown grade \"" + std::string(tmp) + "\".");
             }
+        }
 
-            base::Grade spirit;
-            tmp = stallionsList[i]["spirit"].get<std::string_view>();
-            if (tmp == "A") {
-                spirit = base::Grade::A;
-            } else if (tmp == "B") {
-                spirit = base::Grade::B;
-            } else if (tmp == "C") {
-                spirit = base::Grade::C;
-            } else {
-                throw std::runtime_error(
-                    "PedigreeTool::readDefaultStallions: unknown grade \"" + std::string(tmp) + "\"."
-                );
-            }
+        defaultStallions_.push_back(
+            base::DefaultStallion(
+                ancestors, indices, fee, dist, growth, dirt,
+                grades[0], grades[1], grades[2], grades[3], grades[4]
+            )
+        );
+        defaultStallionMap_.insert(std::make_pair(name, defaultStallions_.size() - 1));
+        defaultStallionNames_.push_back(name);
+    }
 
-            base::Grade stable;
-            tmp = stallionsList[i]["stable"].get<std::string_view>();
-            if (tmp == "A") {
-                stable = base::Grade::A;
-            } else if (tmp == "B") {
-                stable = base::Grade::B;
-            } else if (tmp == "C") {
-                stable = base::Grade::C;
-            } else {
-                throw std::runtime_error(
-                    "PedigreeTool::readDefaultStallions: unknown grade \"" + std::string(tmp) + "\"."
-                );
+    void PedigreeTool::addStallion(const json& stallion, std::string_view context) {
+        std::string name = stallion.at("name").get<std::string>();
+        const json& ancestors = stallion.at("ancestors");
+        base::Pedigree pedigree(
+            ancestors.at(0).get<std::string_view>(),
+            ancestors.at(1).get<std::string_view>(),
+            ancestors.at(2).get<std::string_view>(),
+            ancestors.at(3).get<std::string_view>()
+        );
+
+        // 系統を省略した場合は父の系統を継ぐ
+        base::Blood blood(
+            stallion.contains("blood") ? stallion.at("blood").get<unsigned int>() :
+            stallions_[findStallionIndex(pedigree.get(0), context)].getBloodIndex()
+        );
+
+        bool effects[11] = {};
+        static const char* effectNames[11] = {
+            "短距離", "速力", "長距離", "底力", "堅実", "気性難", "早熟", "晩成", "丈夫", "ダート", "パワー"
+        };
+        if (stallion.contains("effects")) {
+            for (const json& effect: stallion.at("effects")) {
+                std::string_view e = effect.get<std::string_view>();
+                auto it = std::find(std::begin(effectNames), std::end(effectNames), e);
+                if (it == std::end(effectNames)) {
+                    throw std::runtime_error(std::string(context) + ": unknown effect \"" + std::string(e) + "\".");
+                }
+                effects[it - std::begin(effectNames)] = true;
             }
+        }
+        base::BloodEffect effect(
+            effects[0], effects[1], effects[2], effects[3], effects[4], effects[5],
+            effects[6], effects[7], effects[8], effects[9], effects[10]
+        );
+
+        stallions_.push_back(base::Stallion(name, pedigree, blood, effect));
+        stallionMap_.insert(std::make_pair(name, stallions_.size() - 1));
+    }
 
-            defaultStallions_.push_back(
-                base::DefaultStallion(
-                    ancestors, indices, fee, dist, growth, dirt,
-                    health, temper, achievement, spirit, stable
-                )
+    void PedigreeTool::readDefaultBroodmares(std::string_view path) {
+        std::ifstream istream(path.data());
+        if (!istream) {
+            throw std::runtime_error(
+                "PedigreeTool::readDefaultBroodmares: cannot open " + std::string(path) + "."
             );
-            defaultStallionMap_.insert(std::make_pair(name, defaultStallions_.size() - 1));
+        }
+        json broodmaresList = json::parse(istream);
+        for (size_t i = 0; i < broodmaresList.size(); i++) {
+            addDefaultBroodmare(broodmaresList[i], "PedigreeTool::readDefaultBroodmares");
+        }
+    }
+
+    void PedigreeTool::readDefaultStallions(std::string_view path) {
+        std::ifstream istream(path.data());
+        if (!istream) {
+            throw std::runtime_error(
+                "PedigreeTool::readDefaultStallions: cannot open " + std::string(path) + "."
+            );
+        }
+        json stallionsList = json::parse(istream);
+        for (size_t i = 0; i < stallionsList.size(); i++) {
+            addDefaultStallion(stallionsList[i], "PedigreeTool::readDefaultStallions");
         }
     }
 
@@ -242,69 +232,63 @@ namespace search {
 
         json stallionsList = json::parse(istream);
         for (size_t i = 0; i < stallionsList.size(); i++) {
-            std::string_view name = stallionsList[i]["name"].get<std::string_view>();
+            addStallion(stallionsList[i], "PedigreeTool::readStallions");
+        }
+    }
 
-            base::Pedigree pedigree(
-                stallionsList[i]["ancestors"][0].get<std::string_view>(),
-                stallionsList[i]["ancestors"][1].get<std::string_view>(),
-                stallionsList[i]["ancestors"][2].get<std::string_view>(),
-                stallionsList[i]["ancestors"][3].get<std::string_view>()
-            );
+    void PedigreeTool::unloadRoster() {
+        while (defaultBroodmares_.size() > numBaseDefaultBroodmares_) {
+            defaultBroodmareMap_.erase(defaultBroodmareNames_.back());
+            defaultBroodmareNames_.pop_back();
+            defaultBroodmares_.pop_back();
+        }
+        while (defaultStallions_.size() > numBaseDefaultStallions_) {
+            defaultStallionMap_.erase(defaultStallionNames_.back());
+            defaultStallionNames_.pop_back();
+            defaultStallions_.pop_back();
+        }
+        while (stallions_.size() > numBaseStallions_) {
+            stallionMap_.erase(std::string(stallions_.back().getName()));
+            stallions_.pop_back();
+        }
+    }
 
-            base::Blood blood(stallionsList[i]["blood"].get<unsigned int>());
-
-            bool sprint = false;
-            bool speed = false;
-            bool stamina = false;
-            bool spirit = false;
-            bool stable = false;
-            bool temper = false;
-            bool precocious = false;
-            bool altrical = false;
-            bool tough = false;
-            bool dirt = false;
-            bool power = false;
-
-            for (size_t j = 0; j < stallionsList[i]["effects"].size(); j++) {
-                std::string_view e = stallionsList[i]["effects"][j].get<std::string_view>();
-                if (e == "短距離") {
-                    sprint = true;
-                } else if (e == "速力") {
-                    speed = true;
-                } else if (e == "長距離") {
-                    stamina = true;
-                } else if (e == "底力") {
-                    spirit = true;
-                } else if (e == "堅実") {
-                    stable = true;
-                } else if (e == "気性難") {
-                    temper = true;
-                } else if (e == "早熟") {
-                    precocious = true;
-                } else if (e == "晩成") {
-                    altrical = true;
-                } else if (e == "丈夫") {
-                    tough = true;
-                } else if (e == "ダート") {
-                    dirt = true;
-                } else if (e == "パワー") {
-                    power = true;
-                } else {
-                    throw std::runtime_error(
-                        "PedigreeTool::readStallions: unknown effect \"" + std::string(e) + "\"."
-                    );
+    void PedigreeTool::loadRoster(std::string_view path) {
+        std::ifstream istream(path.data());
+        if (!istream) {
+            throw std::runtime_error("PedigreeTool::loadRoster: cannot open " + std::string(path) + ".");
+        }
+        unloadRoster();
+        try {
+            json roster = json::parse(istream);
+            // 種牡馬を先に追加するので, ロスターの繁殖牝馬やその後の種牡馬はロスターの種牡馬を祖先にできる
+            if (roster.contains("stallions")) {
+                for (const json& stallion: roster.at("stallions")) {
+                    // stallions.jsonに無い馬は血統(と系統, 因子)から作る
+                    if (stallionMap_.count(stallion.at("name").get<std::string>()) == 0) {
+                        addStallion(stallion, "PedigreeTool::loadRoster");
+                    }
+                    addDefaultStallion(stallion, "PedigreeTool::loadRoster");
                 }
             }
-            base::BloodEffect effect(
-                sprint, speed, stamina, spirit, stable, temper,
-                precocious, altrical, tough, dirt, power
-            );
-
-            stallions_.push_back(base::Stallion(name, pedigree, blood, effect));
-            stallionMap_.insert(
-                std::make_pair(stallionsList[i]["name"].get<std::string>(), stallions_.size() - 1)
-            );
+            if (roster.contains("broodmares")) {
+                for (const json& broodmare: roster.at("broodmares")) {
+                    addDefaultBroodmare(broodmare, "PedigreeTool::loadRoster");
+                }
+            }
+        } catch (json::exception& e) {
+            unloadRoster();
+            buildAttributeIndices();
+            buildContentHashes();
+            throw std::runtime_error("PedigreeTool::loadRoster: " + std::string(e.what()) + " in " + std::string(path) + ".");
+        } catch (std::runtime_error&) {
+            unloadRoster();
+            buildAttributeIndices();
+            buildContentHashes();
+            throw;
         }
+        buildAttributeIndices();
+        buildContentHashes();
     }
 
     void PedigreeTool::readElaborated(std::string_view path) {
@@ -320,6 +304,141 @@ namespace search {
                 stallionMap_.at(elaboratedList[i][0].get<std::string>()),
                 stallionMap_.at(elaboratedList[i][1].get<std::string>())
             );
+            elaboratedList_.push_back(std::make_pair(
+                stallionMap_.at(elaboratedList[i][0].get<std::string>()),
+                stallionMap_.at(elaboratedList[i][1].get<std::string>())
+            ));
+        }
+    }
+
+    void PedigreeTool::buildAttributeIndices() {
+        static const std::vector<std::string> dirts = {"◎", "○", "△", "?"};
+        static const std::vector<std::string> growths = {"早熟", "普通", "持続", "晩成", "?"};
+        static const std::vector<std::string> grades = {"A", "B", "C", "?"};
+
+        defaultStallionIndex_ = AttributeIndex(defaultStallions_.size());
+        std::vector<unsigned int> fee, min, max;
+        std::vector<std::string> growth, dirt, health, temper, achievement, spirit, stable;
+        for (const base::DefaultStallion& stallion: defaultStallions_) {
+            fee.push_back(stallion.getFee());
+            min.push_back(stallion.getMinDistance());
+            max.push_back(stallion.getMaxDistance());
+            growth.push_back(growths[(int)stallion.getGrowth()]);
+            dirt.push_back(dirts[(int)stallion.getDirt()]);
+            health.push_back(grades[(int)stallion.getHealth()]);
+            temper.push_back(grades[(int)stallion.getTemper()]);
+            achievement.push_back(grades[(int)stallion.getAchievement()]);
+            spirit.push_back(grades[(int)stallion.getSpirit()]);
+            stable.push_back(grades[(int)stallion.getStable()]);
+        }
+        defaultStallionIndex_.addNumeric("fee", fee);
+        defaultStallionIndex_.addNumeric("min", min);
+        defaultStallionIndex_.addNumeric("max", max);
+        defaultStallionIndex_.addInterval("distance", min, max);
+        defaultStallionIndex_.addCategory("growth", growth, growths);
+        defaultStallionIndex_.addCategory("dirt", dirt, dirts);
+        defaultStallionIndex_.addCategory("health", health, grades);
+        defaultStallionIndex_.addCategory("temper", temper, grades);
+        defaultStallionIndex_.addCategory("achievement", achievement, grades);
+        defaultStallionIndex_.addCategory("spirit", spirit, grades);
+        defaultStallionIndex_.addCategory("stable", stable, grades);
+
+        defaultStallionAncestors_ = AncestorIndex(defaultStallions_.size());
+        for (size_t id = 0; id < defaultStallions_.size(); id++) {
+            for (unsigned int slot = 0; slot < 16; slot++) {
+                size_t ancestor = defaultStallions_[id].getAncestorIndex(base::Index(slot));
+                if (ancestor != ignoreStallionIndex_) {
+                    defaultStallionAncestors_.add(id, slot, ancestor);
+                }
+            }
+        }
+
+        defaultBroodmareIndex_ = AttributeIndex(defaultBroodmares_.size());
+        std::vector<unsigned int> speed, stamina, power;
+        fee.clear();
+        dirt.clear();
+        for (const base::DefaultBroodmare& broodmare: defaultBroodmares_) {
+            fee.push_back(broodmare.getFee());
+            speed.push_back(broodmare.getSpeed());
+            stamina.push_back(broodmare.getStamina());
+            power.push_back(broodmare.getPower());
+            dirt.push_back(dirts[(int)broodmare.getDirt()]);
+        }
+        defaultBroodmareIndex_.addNumeric("fee", fee);
+        defaultBroodmareIndex_.addNumeric("speed", speed);
+        defaultBroodmareIndex_.addNumeric("stamina", stamina);
+        defaultBroodmareIndex_.addNumeric("power", power);
+        defaultBroodmareIndex_.addCategory("dirt", dirt, dirts);
+    }
+
+    namespace {
+
+    uint64_t mixHash(uint64_t hash, uint64_t value) {
+        hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+        return hash ^ (hash >> 31);
+    }
+
+    uint64_t hashString(std::string_view s) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c: s) {
+            hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    }
+
+    void PedigreeTool::buildContentHashes() {
+        // 祖先1頭分: 名前, 系統, 因子. 凝った配合の組は順序によらないよう和で加える.
+        std::vector<uint64_t> stallionHashes(stallions_.size());
+        for (size_t id = 0; id < stallions_.size(); id++) {
+            const base::Stallion& s = stallions_[id];
+            uint64_t hash = mixHash(hashString(s.getName()), s.getBloodIndex());
+            const bool effects[11] = {
+                s.isSprint(), s.isSpeed(), s.isStamina(), s.isSpirit(), s.isStable(), s.isTemper(),
+                s.isPrecocious(), s.isAltrical(), s.isTough(), s.isDirt(), s.isPower()
+            };
+            for (bool effect: effects) {
+                hash = mixHash(hash, effect ? 1 : 0);
+            }
+            stallionHashes[id] = hash;
+        }
+        std::vector<uint64_t> pairHashes(stallions_.size(), 0);
+        for (const std::pair<size_t, size_t>& pair: elaboratedList_) {
+            uint64_t hash = mixHash(hashString(stallions_[pair.first].getName()), hashString(stallions_[pair.second].getName()));
+            pairHashes[pair.first] += hash;
+            pairHashes[pair.second] += hash;
+        }
+        for (size_t id = 0; id < stallions_.size(); id++) {
+            stallionHashes[id] = mixHash(stallionHashes[id], pairHashes[id]);
+        }
+
+        defaultStallionHashes_.clear();
+        for (const base::DefaultStallion& stallion: defaultStallions_) {
+            uint64_t hash = stallionHashes[stallion.getAncestorIndex(base::Index(0))];
+            for (unsigned int i = 1; i < 16; i++) {
+                hash = mixHash(hash, stallionHashes[stallion.getAncestorIndex(base::Index(i))]);
+            }
+            for (unsigned int index: stallion.getInterestingIndices()) {
+                hash = mixHash(hash, index);
+            }
+            for (unsigned int index: stallion.getWonderfulIndices()) {
+                hash = mixHash(hash, index);
+            }
+            defaultStallionHashes_.push_back(hash);
+        }
+        defaultBroodmareHashes_.clear();
+        for (const base::DefaultBroodmare& broodmare: defaultBroodmares_) {
+            uint64_t hash = 0;
+            for (unsigned int i = 1; i < 16; i++) {
+                hash = mixHash(hash, stallionHashes[broodmare.getAncestorIndex(base::Index(i))]);
+            }
+            for (unsigned int index: broodmare.getInterestingIndices()) {
+                hash = mixHash(hash, index);
+            }
+            defaultBroodmareHashes_.push_back(hash);
         }
     }
 
@@ -341,6 +460,14 @@ namespace search {
             readDefaultBroodmares(dirname + "/" + defaultBroodmares.data());
             readDefaultStallions(dirname + "/" + defaultStallions.data());
             readElaborated(dirname + "/" + elaborated.data());
+            numBaseStallions_ = stallions_.size();
+            numBaseDefaultStallions_ = defaultStallions_.size();
+            numBaseDefaultBroodmares_ = defaultBroodmares_.size();
+            buildAttributeIndices();
+            buildContentHashes();
+        } catch (json::exception& e) {
+            // 書きかけのファイルを読んだ場合など. 常駐時に読み直しに失敗しても前の版を使い続けられるようにする.
+            throw std::runtime_error("PedigreeTool::PedigreeTool: " + std::string(e.what()) + ".");
         } catch (std::runtime_error e) {
             throw e;
         }
@@ -370,7 +497,7 @@ namespace search {
     }
 
     PedigreeAnalysis PedigreeTool::analyze(
-        std::string_view stallion, base::DefaultBroodmare broodmare,
+        std::string_view stallion, const base::DefaultBroodmare& broodmare,
         bool interesting, bool wonderful, bool elaborated, bool cross, bool nitro
     ) const {
         auto itS = defaultStallionMap_.find(stallion.data());
@@ -388,7 +515,7 @@ namespace search {
     }
 
     PedigreeAnalysis PedigreeTool::analyze(
-        base::DefaultStallion stallion, base::DefaultBroodmare broodmare,
+        const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare,
         bool interesting, bool wonderful, bool elaborated, bool cross, bool nitro
     ) const noexcept {
         return PedigreeAnalyzer::analyze(
@@ -429,6 +556,212 @@ namespace search {
         }
     }
 
+    size_t PedigreeTool::getNumDefaultStallions() const noexcept {
+        return defaultStallions_.size();
+    }
+
+    size_t PedigreeTool::getNumDefaultBroodmares() const noexcept {
+        return defaultBroodmares_.size();
+    }
+
+    const base::DefaultStallion& PedigreeTool::getDefaultStallion(size_t id) const {
+        PEDSEARCH_ASSERT(
+            id < defaultStallions_.size(),
+            "PedigreeTool::getDefaultStallion: invalid id " + std::to_string(id)
+        );
+        return defaultStallions_[id];
+    }
+
+    const base::DefaultBroodmare& PedigreeTool::getDefaultBroodmare(size_t id) const {
+        PEDSEARCH_ASSERT(
+            id < defaultBroodmares_.size(),
+            "PedigreeTool::getDefaultBroodmare: invalid id " + std::to_string(id)
+        );
+        return defaultBroodmares_[id];
+    }
+
+    const base::ElaboratedPairs& PedigreeTool::getElaboratedPairs() const noexcept {
+        return elaboratedPairs_;
+    }
+
+    const std::vector<base::Stallion>& PedigreeTool::getStallions() const noexcept {
+        return stallions_;
+    }
+
+    size_t PedigreeTool::getIgnoreStallionIndex() const noexcept {
+        return ignoreStallionIndex_;
+    }
+
+    std::string_view PedigreeTool::getDefaultStallionName(size_t id) const {
+        PEDSEARCH_ASSERT(
+            id < defaultStallionNames_.size(),
+            "PedigreeTool::getDefaultStallionName: invalid id " + std::to_string(id)
+        );
+        return defaultStallionNames_[id];
+    }
+
+    std::string_view PedigreeTool::getDefaultBroodmareName(size_t id) const {
+        PEDSEARCH_ASSERT(
+            id < defaultBroodmareNames_.size(),
+            "PedigreeTool::getDefaultBroodmareName: invalid id " + std::to_string(id)
+        );
+        return defaultBroodmareNames_[id];
+    }
+
+    uint64_t PedigreeTool::getDefaultStallionHash(size_t id) const {
+        PEDSEARCH_ASSERT(
+            id < defaultStallionHashes_.size(),
+            "PedigreeTool::getDefaultStallionHash: invalid id " + std::to_string(id)
+        );
+        return defaultStallionHashes_[id];
+    }
+
+    uint64_t PedigreeTool::getDefaultBroodmareHash(size_t id) const {
+        PEDSEARCH_ASSERT(
+            id < defaultBroodmareHashes_.size(),
+            "PedigreeTool::getDefaultBroodmareHash: invalid id " + std::to_string(id)
+        );
+        return defaultBroodmareHashes_[id];
+    }
+
+    const AncestorIndex& PedigreeTool::getDefaultStallionAncestorIndex() const noexcept {
+        return defaultStallionAncestors_;
+    }
+
+    bool PedigreeTool::findStallion(std::string_view name, size_t& id) const noexcept {
+        auto it = stallionMap_.find(std::string(name));
+        if (it == stallionMap_.end()) {
+            return false;
+        }
+        id = (*it).second;
+        return true;
+    }
+
+    bool PedigreeTool::findDefaultStallion(std::string_view name, size_t& id) const noexcept {
+        auto it = defaultStallionMap_.find(std::string(name));
+        if (it == defaultStallionMap_.end()) {
+            return false;
+        }
+        id = (*it).second;
+        return true;
+    }
+
+    const AttributeIndex& PedigreeTool::getDefaultStallionIndex() const noexcept {
+        return defaultStallionIndex_;
+    }
+
+    const AttributeIndex& PedigreeTool::getDefaultBroodmareIndex() const noexcept {
+        return defaultBroodmareIndex_;
+    }
+
+    bool PedigreeTool::findDefaultBroodmare(std::string_view name, size_t& id) const noexcept {
+        auto it = defaultBroodmareMap_.find(std::string(name));
+        if (it == defaultBroodmareMap_.end()) {
+            return false;
+        }
+        id = (*it).second;
+        return true;
+    }
+
+    SearchSpace PedigreeTool::resolve(const SearchQuery& query) const {
+        if (query.getGeneration() == 0) {
+            throw std::runtime_error("PedigreeTool::resolve: no stallion is specified.");
+        }
+
+        // "all"は名前順に展開する. "all[fee<=3000,dirt=◎]"は属性の索引で条件を満たす馬だけに絞ってから展開する.
+        auto expand = [](
+            std::string_view name, const std::unordered_map<std::string, size_t>& map,
+            const AttributeIndex& index, std::vector<size_t>& ids
+        ) {
+            if (name == "all") {
+                name = "all[]";
+            }
+            if (name.size() < 5 || name.substr(0, 4) != "all[" || name.back() != ']') {
+                return false;
+            }
+            Bitmap selected = index.select(name.substr(4, name.size() - 5));
+            std::vector<std::pair<std::string_view, size_t> > entries;
+            for (auto it = map.begin(); it != map.end(); ++it) {
+                if (selected.test((*it).second)) {
+                    entries.push_back(*it);
+                }
+            }
+            std::sort(entries.begin(), entries.end());
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                ids.push_back((*it).second);
+            }
+            if (ids.empty()) {
+                throw std::runtime_error("PedigreeTool::resolve: no horse satisfies \"" + std::string(name) + "\".");
+            }
+            return true;
+        };
+
+        std::vector<std::vector<size_t> > candidates(query.getGeneration() + 1);
+        for (unsigned int i = 0; i < query.getGeneration(); i++) {
+            std::string_view name = query.getStallion(i);
+            if (!expand(name, defaultStallionMap_, defaultStallionIndex_, candidates[i])) {
+                auto it = defaultStallionMap_.find(std::string(name));
+                if (it == defaultStallionMap_.end()) {
+                    throw std::runtime_error(
+                        "PedigreeTool::resolve: The stallion \"" + std::string(name) + "\" is unknown."
+                    );
+                }
+                candidates[i].push_back((*it).second);
+            }
+        }
+
+        std::string_view name = query.getBroodmare();
+        if (!expand(name, defaultBroodmareMap_, defaultBroodmareIndex_, candidates.back())) {
+            auto it = defaultBroodmareMap_.find(std::string(name));
+            if (it == defaultBroodmareMap_.end()) {
+                throw std::runtime_error(
+                    "PedigreeTool::resolve: The broodmare \"" + std::string(name) + "\" is unknown."
+                );
+            }
+            candidates.back().push_back((*it).second);
+        }
+
+        return SearchSpace(std::move(candidates));
+    }
+
+    SearchRange PedigreeTool::search(const SearchQuery& query) const {
+        return SearchRange(*this, resolve(query), query.getFilter());
+    }
+
+    base::DefaultBroodmare PedigreeTool::deriveBroodmare(
+        const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare
+    ) const {
+        PEDSEARCH_PROFILE_STAGE(DERIVE);
+        size_t ancestors[16];
+        unsigned int indices[4];
+
+        ancestors[0] = ignoreStallionIndex_;
+        ancestors[1] = stallion.getAncestorIndex(0);
+        ancestors[2] = stallion.getAncestorIndex(1);
+        ancestors[3] = stallion.getAncestorIndex(2);
+        ancestors[4] = stallion.getAncestorIndex(3);
+        ancestors[5] = stallion.getAncestorIndex(6);
+        ancestors[6] = stallion.getAncestorIndex(9);
+        ancestors[7] = stallion.getAncestorIndex(10);
+        ancestors[8] = stallion.getAncestorIndex(13);
+        ancestors[9] = broodmare.getAncestorIndex(1);
+        ancestors[10] = broodmare.getAncestorIndex(2);
+        ancestors[11] = broodmare.getAncestorIndex(3);
+        ancestors[12] = broodmare.getAncestorIndex(6);
+        ancestors[13] = broodmare.getAncestorIndex(9);
+        ancestors[14] = broodmare.getAncestorIndex(10);
+        ancestors[15] = broodmare.getAncestorIndex(13);
+
+        std::array<unsigned int, 4> sIndex = stallion.getInterestingIndices();
+        std::array<unsigned int, 4> bIndex = broodmare.getInterestingIndices();
+        indices[0] = sIndex[0];
+        indices[1] = sIndex[2];
+        indices[2] = bIndex[0];
+        indices[3] = bIndex[2];
+
+        return base::DefaultBroodmare(ancestors, indices);
+    }
+
     base::DefaultBroodmare PedigreeTool::makeDefaultBroodmare(
         std::string_view stallion, std::string_view broodmare
     ) const {
@@ -445,36 +778,7 @@ namespace search {
             );
         }
 
-        size_t sId = (*itS).second;
-        size_t bId = (*itB).second;
-        size_t ancestors[16];
-        unsigned int indices[4];
-
-        ancestors[0] = ignoreStallionIndex_;
-        ancestors[1] = defaultStallions_[sId].getAncestorIndex(0);
-        ancestors[2] = defaultStallions_[sId].getAncestorIndex(1);
-        ancestors[3] = defaultStallions_[sId].getAncestorIndex(2);
-        ancestors[4] = defaultStallions_[sId].getAncestorIndex(3);
-        ancestors[5] = defaultStallions_[sId].getAncestorIndex(6);
-        ancestors[6] = defaultStallions_[sId].getAncestorIndex(9);
-        ancestors[7] = defaultStallions_[sId].getAncestorIndex(10);
-        ancestors[8] = defaultStallions_[sId].getAncestorIndex(13);
-        ancestors[9] = defaultBroodmares_[bId].getAncestorIndex(1);
-        ancestors[10] = defaultBroodmares_[bId].getAncestorIndex(2);
-        ancestors[11] = defaultBroodmares_[bId].getAncestorIndex(3);
-        ancestors[12] = defaultBroodmares_[bId].getAncestorIndex(6);
-        ancestors[13] = defaultBroodmares_[bId].getAncestorIndex(9);
-        ancestors[14] = defaultBroodmares_[bId].getAncestorIndex(10);
-        ancestors[15] = defaultBroodmares_[bId].getAncestorIndex(13);
-
-        std::vector<unsigned int> sIndex = defaultStallions_[sId].getInterestingIndices();
-        std::vector<unsigned int> bIndex = defaultBroodmares_[bId].getInterestingIndices();
-        indices[0] = sIndex[0];
-        indices[1] = sIndex[2];
-        indices[2] = bIndex[0];
-        indices[3] = bIndex[2];
-
-        return base::DefaultBroodmare(ancestors, indices);
+        return deriveBroodmare(defaultStallions_[(*itS).second], defaultBroodmares_[(*itB).second]);
     }
 
     base::DefaultBroodmare PedigreeTool::makeDefaultBroodmare(
@@ -487,35 +791,19 @@ namespace search {
             );
         }
 
-        size_t sId = (*itS).second;
-        size_t ancestors[16];
-        unsigned int indices[4];
-
-        ancestors[0] = ignoreStallionIndex_;
-        ancestors[1] = defaultStallions_[sId].getAncestorIndex(0);
-        ancestors[2] = defaultStallions_[sId].getAncestorIndex(1);
-        ancestors[3] = defaultStallions_[sId].getAncestorIndex(2);
-        ancestors[4] = defaultStallions_[sId].getAncestorIndex(3);
-        ancestors[5] = defaultStallions_[sId].getAncestorIndex(6);
-        ancestors[6] = defaultStallions_[sId].getAncestorIndex(9);
-        ancestors[7] = defaultStallions_[sId].getAncestorIndex(10);
-        ancestors[8] = defaultStallions_[sId].getAncestorIndex(13);
-        ancestors[9] = broodmare.getAncestorIndex(1);
-        ancestors[10] = broodmare.getAncestorIndex(2);
-        ancestors[11] = broodmare.getAncestorIndex(3);
-        ancestors[12] = broodmare.getAncestorIndex(6);
-        ancestors[13] = broodmare.getAncestorIndex(9);
-        ancestors[14] = broodmare.getAncestorIndex(10);
-        ancestors[15] = broodmare.getAncestorIndex(13);
+        return deriveBroodmare(defaultStallions_[(*itS).second], broodmare);
+    }
 
-        std::vector<unsigned int> sIndex = defaultStallions_[sId].getInterestingIndices();
-        std::vector<unsigned int> bIndex = broodmare.getInterestingIndices();
-        indices[0] = sIndex[0];
-        indices[1] = sIndex[2];
-        indices[2] = bIndex[0];
-        indices[3] = bIndex[2];
+    base::DefaultBroodmare PedigreeTool::makeDefaultBroodmare(
+        size_t stallion, const base::DefaultBroodmare& broodmare
+    ) const {
+        if (stallion >= defaultStallions_.size()) {
+            throw std::runtime_error(
+                "PedigreeTool::makeDefaultBroodmare: invalid stallion id " + std::to_string(stallion) + "."
+            );
+        }
 
-        return base::DefaultBroodmare(ancestors, indices);
+        return deriveBroodmare(defaultStallions_[stallion], broodmare);
     }
 
 }
@@ -1,10 +1,13 @@
 #ifndef SEARCH_PEDIGREETOOL_H
 #define SEARCH_PEDIGREETOOL_H
 
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 #include "base/Debug.h"
 #include "base/Broodmare.h"
 #include "base/DefaultStallion.h"
@@ -14,22 +17,52 @@
 #include "base/Thoroughbred.h"
 #include "base/ThoroughbredMap.h"
 #include "extra/json.hpp"
+#include "search/AttributeIndex.h"
 #include "search/PedigreeAnalyzer.h"
+#include "search/SearchQuery.h"
 
 namespace pedsearch {
 namespace search {
 
+class SearchRange;
+
 class PedigreeTool {
 private:
+    friend class SearchEngine;
     using json = nlohmann::json;
     std::unordered_map<std::string, size_t> defaultBroodmareMap_;
     std::vector<base::DefaultBroodmare> defaultBroodmares_;
+    std::vector<std::string> defaultBroodmareNames_;
     std::unordered_map<std::string, size_t> defaultStallionMap_;
     std::vector<base::DefaultStallion> defaultStallions_;
+    std::vector<std::string> defaultStallionNames_;
     std::unordered_map<std::string, size_t> stallionMap_;
     std::vector<base::Stallion> stallions_;
     base::ElaboratedPairs elaboratedPairs_;
+    std::vector<std::pair<size_t, size_t> > elaboratedList_;
+    std::vector<uint64_t> defaultStallionHashes_;
+    std::vector<uint64_t> defaultBroodmareHashes_;
     size_t ignoreStallionIndex_ = 0;
+    AttributeIndex defaultStallionIndex_;
+    AttributeIndex defaultBroodmareIndex_;
+    AncestorIndex defaultStallionAncestors_;
+    // ロスターを読む前の各表の大きさ. ロスターの馬はこの後ろに追加する.
+    size_t numBaseStallions_ = 0;
+    size_t numBaseDefaultStallions_ = 0;
+    size_t numBaseDefaultBroodmares_ = 0;
+
+    size_t findStallionIndex(std::string_view name, std::string_view context) const;
+
+    // 父, 母父, 母母父, 母母母父の名前から血統表の位置1..15のstallions_のidを求める
+    void resolveAncestors(const json& names, size_t* ancestors, std::string_view context) const;
+
+    void addStallion(const json& stallion, std::string_view context);
+
+    void addDefaultStallion(const json& stallion, std::string_view context);
+
+    void addDefaultBroodmare(const json& broodmare, std::string_view context);
+
+    void unloadRoster();
 
     void readDefaultBroodmares(std::string_view path);
 
@@ -39,12 +72,21 @@ private:
 
     void readElaborated(std::string_view path);
 
+    void buildAttributeIndices();
+
+    void buildContentHashes();
+
+    base::DefaultBroodmare deriveBroodmare(
+        const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare
+    ) const;
+
 public:
     PedigreeTool(
         std::string_view path, std::string_view defaultStallions, std::string_view defaultBroodmares,
         std::string_view stallions, std::string_view elaborated
     );
 
+    // 分析は配合する馬を参照するので, 渡した馬は分析より長く生存させること
     PedigreeAnalysis analyze(
         std::string_view stallion, std::string_view broodmare,
         bool interesting=true, bool wonderful=true, bool elaborated=true,
@@ -52,23 +94,97 @@ public:
     ) const;
 
     PedigreeAnalysis analyze(
-        std::string_view stallion, base::DefaultBroodmare broodmare,
+        std::string_view stallion, const base::DefaultBroodmare& broodmare,
         bool interesting=true, bool wonderful=true, bool elaborated=true,
         bool cross=true, bool nitro=true
     ) const;
 
     PedigreeAnalysis analyze(
-        base::DefaultStallion stallion, base::DefaultBroodmare broodmare,
+        const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare,
         bool interesting=true, bool wonderful=true, bool elaborated=true,
         bool cross=true, bool nitro=true
     ) const noexcept;
 
+    // 一時的な馬を渡すと分析が解放済みの馬を参照するので, 渡せないようにする
+    PedigreeAnalysis analyze(
+        std::string_view stallion, base::DefaultBroodmare&& broodmare,
+        bool interesting=true, bool wonderful=true, bool elaborated=true,
+        bool cross=true, bool nitro=true
+    ) const = delete;
+
+    PedigreeAnalysis analyze(
+        base::DefaultStallion&& stallion, const base::DefaultBroodmare& broodmare,
+        bool interesting=true, bool wonderful=true, bool elaborated=true,
+        bool cross=true, bool nitro=true
+    ) const = delete;
+
+    PedigreeAnalysis analyze(
+        const base::DefaultStallion& stallion, base::DefaultBroodmare&& broodmare,
+        bool interesting=true, bool wonderful=true, bool elaborated=true,
+        bool cross=true, bool nitro=true
+    ) const = delete;
+
+    PedigreeAnalysis analyze(
+        base::DefaultStallion&& stallion, base::DefaultBroodmare&& broodmare,
+        bool interesting=true, bool wonderful=true, bool elaborated=true,
+        bool cross=true, bool nitro=true
+    ) const = delete;
+
     void getDefaultStallionsSet(std::set<std::string_view>& stallionsSet) const noexcept;
 
     void getDefaultBroodmaresSet(std::set<std::string_view>& broodmaresSet) const noexcept;
 
     void getEffects(size_t id, std::vector<unsigned int>& effects) const;
 
+    size_t getNumDefaultStallions() const noexcept;
+
+    size_t getNumDefaultBroodmares() const noexcept;
+
+    const base::DefaultStallion& getDefaultStallion(size_t id) const;
+
+    const base::DefaultBroodmare& getDefaultBroodmare(size_t id) const;
+
+    const base::ElaboratedPairs& getElaboratedPairs() const noexcept;
+
+    const std::vector<base::Stallion>& getStallions() const noexcept;
+
+    size_t getIgnoreStallionIndex() const noexcept;
+
+    std::string_view getDefaultStallionName(size_t id) const;
+
+    std::string_view getDefaultBroodmareName(size_t id) const;
+
+    bool findDefaultStallion(std::string_view name, size_t& id) const noexcept;
+
+    // 種牡馬の属性(fee, min, max, distance, growth, dirt, health, temper, achievement, spirit, stable)の索引
+    const AttributeIndex& getDefaultStallionIndex() const noexcept;
+
+    // 繁殖牝馬の属性(fee, speed, stamina, power, dirt)の索引
+    const AttributeIndex& getDefaultBroodmareIndex() const noexcept;
+
+    bool findDefaultBroodmare(std::string_view name, size_t& id) const noexcept;
+
+    // 血統表の位置0..15ごとの, 祖先(getStallions()のid)からデフォルト種牡馬のidの集合への索引
+    const AncestorIndex& getDefaultStallionAncestorIndex() const noexcept;
+
+    // stallions.jsonの馬のid
+    bool findStallion(std::string_view name, size_t& id) const noexcept;
+
+    // 分析結果を決める内容(血統表の各祖先の名前・系統・因子・凝った配合の相手, 面白/見事の位置)のハッシュ.
+    // 名前で求めるので, jsonの並びが変わってidがずれても内容が同じなら同じ値になる.
+    uint64_t getDefaultStallionHash(size_t id) const;
+
+    uint64_t getDefaultBroodmareHash(size_t id) const;
+
+    // 自分の馬の一覧(ロスター)を読み, デフォルトの種牡馬/繁殖牝馬の表の後ろに追加する.
+    // 前に読んだロスターは置き換え, stallions.jsonなどは読み直さない. 失敗した場合はロスターの馬が無い状態になる.
+    // 探索中に呼んではいけない. 以前に得た名前のstring_viewは無効になる.
+    void loadRoster(std::string_view path);
+
+    SearchSpace resolve(const SearchQuery& query) const;
+
+    SearchRange search(const SearchQuery& query) const;
+
     base::DefaultBroodmare makeDefaultBroodmare(
         std::string_view stallion, std::string_view broodmare
     ) const;
@@ -76,6 +192,8 @@ public:
     base::DefaultBroodmare makeDefaultBroodmare(
         std::string_view stallion, base::DefaultBroodmare broodmare
     ) const;
+
+    base::DefaultBroodmare makeDefaultBroodmare(size_t stallion, const base::DefaultBroodmare& broodmare) const;
 };
 
 }
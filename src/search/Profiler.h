@@ -0,0 +1,142 @@
+#ifndef SEARCH_PROFILER_H
+#define SEARCH_PROFILER_H
+
+// PEDSEARCH_PROFILEを定義してビルドしたときだけ各段階の回数と時間を数え, 終了時に標準エラー出力へ表示する.
+// 定義しない場合PEDSEARCH_PROFILE_STAGEは何もしない.
+
+#ifdef PEDSEARCH_PROFILE
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace pedsearch {
+namespace search {
+
+enum class Stage {
+    DERIVE, INTERESTING, WONDERFUL, ELABORATED, CROSS, NITRO, SUMMARIZE, OUTPUT, NUM_STAGES
+};
+
+class Profiler {
+private:
+    static constexpr size_t NUM_STAGES = (size_t)Stage::NUM_STAGES;
+
+    struct Counters {
+        uint64_t calls[NUM_STAGES] = {};
+        uint64_t ticks[NUM_STAGES] = {};
+    };
+
+    // スレッドごとの計数. スレッド終了時に全体へ足し込む.
+    class LocalCounters {
+    public:
+        Counters counters;
+
+        ~LocalCounters() {
+            Profiler::instance().merge(counters);
+        }
+    };
+
+    std::mutex mutex_;
+    Counters total_;
+
+    Profiler() {}
+
+    void merge(const Counters& counters) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < NUM_STAGES; i++) {
+            total_.calls[i] += counters.calls[i];
+            total_.ticks[i] += counters.ticks[i];
+        }
+    }
+
+    static const char* getStageName(size_t stage) {
+        static const char* names[NUM_STAGES] = {
+            "derive", "interesting", "wonderful", "elaborated", "cross", "nitro", "summarize", "output"
+        };
+        return names[stage];
+    }
+
+public:
+    ~Profiler() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < NUM_STAGES; i++) {
+            sum += total_.ticks[i];
+        }
+        fprintf(stderr, "%-12s %14s %18s %12s %8s\n", "stage", "calls", TICK_UNIT, "per call", "share");
+        for (size_t i = 0; i < NUM_STAGES; i++) {
+            fprintf(
+                stderr, "%-12s %14llu %18llu %12.1f %7.1f%%\n", getStageName(i),
+                (unsigned long long)total_.calls[i], (unsigned long long)total_.ticks[i],
+                total_.calls[i] == 0 ? 0.0 : (double)total_.ticks[i] / total_.calls[i],
+                sum == 0 ? 0.0 : 100.0 * total_.ticks[i] / sum
+            );
+        }
+    }
+
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static Counters& local() {
+        // 先にinstance()を作っておくとLocalCountersより後に破棄される
+        instance();
+        thread_local LocalCounters counters;
+        return counters.counters;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    static constexpr const char* TICK_UNIT = "cycles";
+
+    static inline uint64_t now() {
+        return __rdtsc();
+    }
+#else
+    static constexpr const char* TICK_UNIT = "ns";
+
+    static inline uint64_t now() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+#endif
+
+    static inline void add(Stage stage, uint64_t ticks) {
+        Counters& counters = local();
+        counters.calls[(size_t)stage]++;
+        counters.ticks[(size_t)stage] += ticks;
+    }
+};
+
+class ScopedStage {
+private:
+    const Stage stage_;
+    const uint64_t start_;
+
+public:
+    ScopedStage(Stage stage) : stage_(stage), start_(Profiler::now()) {}
+
+    ~ScopedStage() {
+        Profiler::add(stage_, Profiler::now() - start_);
+    }
+};
+
+}
+}
+
+#define PEDSEARCH_PROFILE_CONCAT_(x, y) x##y
+#define PEDSEARCH_PROFILE_CONCAT(x, y) PEDSEARCH_PROFILE_CONCAT_(x, y)
+#define PEDSEARCH_PROFILE_STAGE(stage) \
+    pedsearch::search::ScopedStage PEDSEARCH_PROFILE_CONCAT(profileStage, __LINE__)(pedsearch::search::Stage::stage)
+
+#else
+
+#define PEDSEARCH_PROFILE_STAGE(stage) ((void)0)
+
+#endif // PEDSEARCH_PROFILE
+
+#endif // SEARCH_PROFILER_H
@@ -0,0 +1,139 @@
+#ifndef SEARCH_PROGRESS_H
+#define SEARCH_PROGRESS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace pedsearch {
+namespace search {
+
+// 評価し終えた組の数. スレッドごとにキャッシュラインを分けた計数を持ち, 探索側はバッチごとに1回足すだけにする.
+class Progress {
+private:
+    struct alignas(64) Counter {
+        std::atomic<uint64_t> pairs{0};
+    };
+
+    std::vector<Counter> counters_;
+    const uint64_t total_;
+
+public:
+    Progress(uint64_t total, unsigned int threads=1) :
+        counters_(std::max(1u, threads)), total_(total) {}
+
+    void add(unsigned int thread, uint64_t pairs) {
+        counters_[thread % counters_.size()].pairs.fetch_add(pairs, std::memory_order_relaxed);
+    }
+
+    uint64_t getCompleted() const {
+        uint64_t completed = 0;
+        for (const Counter& counter: counters_) {
+            completed += counter.pairs.load(std::memory_order_relaxed);
+        }
+        return completed;
+    }
+
+    uint64_t getTotal() const {
+        return total_;
+    }
+};
+
+// 別スレッドで一定間隔ごとにProgressを読み, 速度・進捗率・残り時間を標準エラー出力かファイルに書く.
+// 破棄するときに最後の状態を書いて止まる.
+class ProgressReporter {
+private:
+    const Progress& progress_;
+    const bool print_;
+    const std::string statusPath_;
+    const std::chrono::milliseconds interval_;
+    const std::chrono::steady_clock::time_point start_;
+    const uint64_t initial_; // 再開した場合など, 計測前に終わっていた組の数
+
+    std::mutex mutex_;
+    std::condition_variable stopped_;
+    bool stop_;
+    std::thread thread_;
+
+    static std::string formatDuration(double seconds) {
+        unsigned long long s = (unsigned long long)seconds;
+        char text[32];
+        snprintf(text, sizeof(text), "%llu:%02llu:%02llu", s / 3600, s / 60 % 60, s % 60);
+        return text;
+    }
+
+    void report(bool last) {
+        uint64_t completed = progress_.getCompleted();
+        uint64_t total = progress_.getTotal();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        double rate = elapsed > 0 ? (completed - initial_) / elapsed : 0;
+        double percent = total == 0 ? 100.0 : 100.0 * completed / total;
+        double eta = rate > 0 ? (total - std::min(completed, total)) / rate : 0;
+
+        if (print_) {
+            // 端末なら同じ行を書き換え, そうでなければ1行ずつ出力する
+            static const bool terminal = isatty(fileno(stderr));
+            fprintf(
+                stderr, "%s%6.2f%% %llu/%llu pairs, %.0f pairs/s, elapsed %s, ETA %s%s",
+                terminal ? "\r" : "", percent, (unsigned long long)completed, (unsigned long long)total,
+                rate, formatDuration(elapsed).data(), formatDuration(eta).data(),
+                (terminal && !last) ? "" : "\n"
+            );
+            fflush(stderr);
+        }
+        if (!statusPath_.empty()) {
+            // 読み手が書きかけのファイルを見ないよう置き換える
+            std::string temporary = statusPath_ + ".tmp";
+            std::ofstream file(temporary, std::ios::trunc);
+            file << "{\"completed\":" << completed << ",\"total\":" << total
+                << ",\"percent\":" << percent << ",\"pairs_per_second\":" << rate
+                << ",\"elapsed_seconds\":" << elapsed << ",\"eta_seconds\":" << eta
+                << ",\"running\":" << (last ? "false" : "true") << "}" << std::endl;
+            file.close();
+            std::rename(temporary.c_str(), statusPath_.c_str());
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopped_.wait_for(lock, interval_, [this]() { return stop_; })) {
+            report(false);
+        }
+    }
+
+public:
+    ProgressReporter(
+        const Progress& progress, bool print, std::string statusPath,
+        std::chrono::milliseconds interval=std::chrono::milliseconds(1000)
+    ) : progress_(progress), print_(print), statusPath_(std::move(statusPath)), interval_(interval),
+        start_(std::chrono::steady_clock::now()), initial_(progress.getCompleted()), stop_(false) {
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+    ~ProgressReporter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        stopped_.notify_one();
+        thread_.join();
+        report(true);
+    }
+};
+
+}
+}
+
+#endif // SEARCH_PROGRESS_H
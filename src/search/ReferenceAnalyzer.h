@@ -0,0 +1,378 @@
+#ifndef SEARCH_REFERENCEANALYZER_H
+#define SEARCH_REFERENCEANALYZER_H
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "base/Debug.h"
+#include "base/DefaultStallion.h"
+#include "base/ElaboratedPairs.h"
+#include "base/Stallion.h"
+
+namespace pedsearch {
+namespace search {
+
+// 高速化する前のPedigreeAnalyzer::analyzeをそのまま残した実装.
+// 差分テスト(test/differential.cpp)の基準として使うので変更しないこと.
+class ReferenceAnalysis {
+private:
+    friend class ReferenceAnalyzer;
+    bool isInteresting_;
+    bool isWonderful_;
+    bool isElaborated_;
+    std::unordered_map<size_t, std::vector<unsigned int> > crosses_;
+    unsigned int sprint_;
+    unsigned int speed_;
+    unsigned int stamina_;
+    unsigned int spirit_;
+    unsigned int power_;
+
+    ReferenceAnalysis() :
+        isInteresting_(false), isWonderful_(false), isElaborated_(false),
+        sprint_(0), speed_(0), stamina_(0), spirit_(0), power_(0) {}
+
+    void appendCross(size_t id, unsigned int generation) {
+        if (crosses_.find(id) == crosses_.end()) {
+            crosses_.emplace(id, std::vector<unsigned int>(1, generation));
+        } else {
+            crosses_[id].push_back(generation);
+        }
+    }
+
+    bool hasCross(size_t id) {
+        if (crosses_.find(id) == crosses_.end()) {
+            return false;
+        } else {
+            return true;
+        }
+    }
+
+public:
+    bool isInteresting() const { return isInteresting_; }
+    bool isWonderful() const { return isWonderful_; }
+    bool isElaborated() const { return isElaborated_; }
+    int getSpeedNitro() const { return 2 * sprint_ + speed_; }
+    int getStaminaNitro() const { return stamina_ + spirit_ - sprint_; }
+    int getPowerNitro() const { return power_; }
+
+    // 血量50%以上のクロスがあるか
+    bool isDanger() const {
+        for (auto it = crosses_.begin(); it != crosses_.end(); ++it) {
+            double sum = 0;
+            for (auto it2 = (*it).second.begin(); it2 != (*it).second.end(); ++it2) {
+                sum += 50.0 / (*it2);
+            }
+            if (sum >= 50.0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // クロスした種牡馬の因子数: 短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワー
+    std::vector<unsigned int> getEffects(const std::vector<base::Stallion>& stallionVector) const {
+        std::vector<unsigned int> effects(11, 0);
+        for (auto it = crosses_.begin(); it != crosses_.end(); ++it) {
+            const base::Stallion& s = stallionVector[(*it).first];
+            effects[0] += s.isSprint() ? 1 : 0;
+            effects[1] += s.isSpeed() ? 1 : 0;
+            effects[2] += s.isStamina() ? 1 : 0;
+            effects[3] += s.isSpirit() ? 1 : 0;
+            effects[4] += s.isStable() ? 1 : 0;
+            effects[5] += s.isTemper() ? 1 : 0;
+            effects[6] += s.isPrecocious() ? 1 : 0;
+            effects[7] += s.isAltrical() ? 1 : 0;
+            effects[8] += s.isTough() ? 1 : 0;
+            effects[9] += s.isDirt() ? 1 : 0;
+            effects[10] += s.isPower() ? 1 : 0;
+        }
+        return effects;
+    }
+
+    unsigned int getNumCrosses() const {
+        return (unsigned int)crosses_.size();
+    }
+};
+
+class ReferenceAnalyzer {
+private:
+    static inline unsigned int indexToGeneration(base::Index index) {
+        switch (index) {
+            case 0:
+                return 1;
+            case 1:
+                return 2;
+            case 2:
+            case 9:
+                return 3;
+            case 3:
+            case 6:
+            case 10:
+            case 13:
+                return 4;
+            case 4:
+            case 5:
+            case 7:
+            case 8:
+            case 11:
+            case 12:
+            case 14:
+            case 15:
+                return 5;
+        }
+        return 0;
+    }
+
+    static inline base::Index indexSkipForCrossSearch(base::Index index) {
+        switch (index) {
+            case 0:
+                return 15;
+            case 1:
+                return 8;
+            case 2:
+                return 5;
+            case 3:
+            case 4:
+                return 4;
+            case 5:
+                return 5;
+            case 6:
+            case 7:
+                return 7;
+            case 8:
+                return 8;
+            case 9:
+                return 12;
+            case 10:
+            case 11:
+                return 11;
+            case 12:
+                return 12;
+            case 13:
+            case 14:
+                return 14;
+            case 15:
+                return 15;
+        }
+        return base::Index(0);
+    }
+
+    static inline void appendInvalidIndexPairs(
+        base::Index index1, base::Index index2,
+        std::set<std::pair<base::Index, base::Index> >& pairs
+    ) {
+        PEDSEARCH_ASSERT(
+            index2 >= base::Index(1),
+            "ReferenceAnalyzer::appendInvalidIndexPairs: index2 must be larger than 1 but got " + std::to_string((unsigned int)index2)
+        );
+        
+        unsigned int gen = indexToGeneration(index1);
+        std::vector<unsigned int> indices1;
+        if (gen == 1) {
+            indices1 = {1,2,3,9,4,7,10,13,4,5,7,8,11,12,14,15};
+        } else if (gen == 2) {
+            indices1 = {2,3,6,4,5,7,8};
+        } else if (gen == 3) {
+            indices1 = {1+index1, 2+index1, 3+index1};
+        } else if (gen == 4) {
+            indices1 = {1+index1};
+        }
+
+        gen = indexToGeneration(index2);
+        std::vector<unsigned int> indices2;
+        if (gen == 2) {
+            indices2 = {2,3,6,4,5,7,8};
+        } else if (gen == 3) {
+            indices2 = {1+index2, 2+index2, 3+index2};
+        } else if (gen == 4) {
+            indices2 = {1+index2};
+        }
+
+        for (int i = 0; i < (int)std::min(indices1.size(), indices2.size()); i++) {
+            pairs.insert(std::make_pair(indices1[i], indices2[i]));
+        }
+    }
+
+public:
+    static inline ReferenceAnalysis analyze(
+        const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare,
+        const std::vector<base::Stallion>& stallionVector, const base::ElaboratedPairs& pairs,
+        size_t ignoreIndex, bool interesting=true, bool wonderful=true, bool elaborated=true,
+        bool cross=true, bool nitro=true
+    ) {
+        ReferenceAnalysis result;
+
+        // 面白い配合の判定
+        if (interesting) {
+            std::set<unsigned int> indices;
+            stallion.appendInterestingIndices(indices);
+            broodmare.appendInterestingIndices(indices);
+            if (indices.size() >= 7) {
+                result.isInteresting_ = true;
+            }
+        }
+
+        // 見事な配合の判定
+        if (wonderful) {
+            std::set<unsigned int> sireIndices;
+            std::set<unsigned int> broodmareIndices;
+            stallion.appendWonderfulIndices(sireIndices);
+            broodmare.appendInterestingIndices(broodmareIndices);
+            if (sireIndices == broodmareIndices) {
+                result.isWonderful_ = true;
+            }
+        }
+
+        // 凝った配合の判定
+        if (elaborated) {
+            std::set<std::string_view> stallionAncestors;
+            std::set<std::string_view> broodmareAncestors;
+            std::vector<base::Index> indices = {1,2,3,6,9,10,13};
+
+            bool finished = false;
+            for (base::Index index1: indices) {
+                for (base::Index index2: indices) {
+                    if (pairs.hasPair(stallion.getAncestorIndex(index1), broodmare.getAncestorIndex(index2))) {
+                        result.isElaborated_ = true;
+                        finished = true;
+                        break;
+                    }
+                }
+                if (finished) {
+                    break;
+                }
+            }
+        }
+
+        // クロスの判定とニトロの数え上げ
+        if (!cross && nitro) {
+            std::set<size_t> stallionsSet;
+            size_t id;
+            for (unsigned int i = 1; i <= 15; i++) {
+                id = stallion.getAncestorIndex(i);
+                if (id != ignoreIndex && stallionsSet.find(id) == stallionsSet.end()) {
+                    if (stallionVector[id].isSprint()) {
+                        result.sprint_++;
+                    }
+                    if (stallionVector[id].isSpeed()) {
+                        result.speed_++;
+                    }
+                    if (stallionVector[id].isStamina()) {
+                        result.stamina_++;
+                    }
+                    if (stallionVector[id].isSpirit()) {
+                        result.spirit_++;
+                    }
+                    if (stallionVector[id].isPower()) {
+                        result.power_++;
+                    }
+                }
+                if (id != ignoreIndex) {
+                    stallionsSet.insert(id);
+                }
+            }
+
+            for (unsigned int i = 1; i <= 15; i++) {
+                id = broodmare.getAncestorIndex(i);
+                if (id != ignoreIndex && stallionsSet.find(id) == stallionsSet.end()) {
+                    if (stallionVector[id].isSprint()) {
+                        result.sprint_++;
+                    }
+                    if (stallionVector[id].isSpeed()) {
+                        result.speed_++;
+                    }
+                    if (stallionVector[id].isStamina()) {
+                        result.stamina_++;
+                    }
+                    if (stallionVector[id].isSpirit()) {
+                        result.spirit_++;
+                    }
+                    if (stallionVector[id].isPower()) {
+                        result.power_++;
+                    }
+                }
+                if (id != ignoreIndex) {
+                    stallionsSet.insert(id);
+                }
+            }
+        } else if (cross) {
+            std::set<size_t> stallionsSet;
+            size_t id1, id2;
+            std::vector<unsigned int> generation;
+            std::set<std::pair<base::Index, base::Index> > invalidPairs;
+            for (unsigned int i = 0; i <= 15; i++) {
+                id1 = stallion.getAncestorIndex(i);
+                bool hasCross = false;
+
+                if (id1 != ignoreIndex && nitro && i != 0 && stallionsSet.find(id1) == stallionsSet.end()) {
+                    stallionsSet.insert(id1);
+                    if (stallionVector[id1].isSprint()) {
+                        result.sprint_++;
+                    }
+                    if (stallionVector[id1].isSpeed()) {
+                        result.speed_++;
+                    }
+                    if (stallionVector[id1].isStamina()) {
+                        result.stamina_++;
+                    }
+                    if (stallionVector[id1].isSpirit()) {
+                        result.spirit_++;
+                    }
+                    if (stallionVector[id1].isPower()) {
+                        result.power_++;
+                    }
+                }
+
+                if (result.hasCross(id1)) {
+                    result.appendCross(id1, indexToGeneration(i));
+                } else {
+                    for (unsigned int j = 1; j <= 15; j++) {
+                        id2 = broodmare.getAncestorIndex(j);
+                        if (id2 != ignoreIndex && nitro && i == 0 && stallionsSet.find(id2) == stallionsSet.end()) {
+                            stallionsSet.insert(id2);
+                            if (stallionVector[id2].isSprint()) {
+                                result.sprint_++;
+                            }
+                            if (stallionVector[id2].isSpeed()) {
+                                result.speed_++;
+                            }
+                            if (stallionVector[id2].isStamina()) {
+                                result.stamina_++;
+                            }
+                            if (stallionVector[id2].isSpirit()) {
+                                result.spirit_++;
+                            }
+                            if (stallionVector[id2].isPower()) {
+                                result.power_++;
+                            }
+                        }
+
+                        if (id1 != ignoreIndex && id1 == id2 && invalidPairs.find(std::make_pair(i,j)) == invalidPairs.end()) {
+                            hasCross = true;
+                            result.appendCross(id1, indexToGeneration(j));
+                            appendInvalidIndexPairs(i, j, invalidPairs);
+                            if (i != 0 || !nitro) {
+                                // ニトロを数え上げる場合はi==0のときスキップできない
+                                j = indexSkipForCrossSearch(j);
+                            }
+                        }
+                    }
+
+                    if (hasCross) {
+                        result.appendCross(id1, indexToGeneration(i));
+                    }
+                }
+            }
+        }
+
+        return result;
+    }
+};
+
+}
+}
+
+#endif // SEARCH_REFERENCEANALYZER_H
@@ -0,0 +1,286 @@
+#ifndef SEARCH_RESULTCACHE_H
+#define SEARCH_RESULTCACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "base/DefaultStallion.h"
+
+namespace pedsearch {
+namespace search {
+
+// 配合の内容の指紋. 名前や鎖ではなく, 分析の入力(父の祖先と面白/見事の位置, 作られた繁殖牝馬の祖先と面白の位置)
+// から作るので, 別の鎖から同じ血統表の母ができれば同じ指紋になる. 2つの独立な64bitハッシュで衝突を無視できるようにする.
+struct PedigreeKey {
+    uint64_t hashes[2];
+
+    bool operator==(const PedigreeKey& key) const {
+        return hashes[0] == key.hashes[0] && hashes[1] == key.hashes[1];
+    }
+
+    static PedigreeKey of(const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare) {
+        PedigreeKey key{{0x243f6a8885a308d3ull, 0x13198a2e03707344ull}};
+        for (unsigned int i = 0; i < 16; i++) {
+            key.add(stallion.getAncestorIndex(base::Index(i)));
+        }
+        for (unsigned int index: stallion.getInterestingIndices()) {
+            key.add(index);
+        }
+        for (unsigned int index: stallion.getWonderfulIndices()) {
+            key.add(index);
+        }
+        for (unsigned int i = 1; i < 16; i++) {
+            key.add(broodmare.getAncestorIndex(base::Index(i)));
+        }
+        for (unsigned int index: broodmare.getInterestingIndices()) {
+            key.add(index);
+        }
+        return key;
+    }
+
+private:
+    static uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    void add(uint64_t value) {
+        hashes[0] = mix(hashes[0] ^ value) + 0x9e3779b97f4a7c15ull;
+        hashes[1] = mix(hashes[1] + value * 0xff51afd7ed558ccdull) ^ 0xc4ceb9fe1a85ec53ull;
+    }
+};
+
+// 鎖と行番号を除いた分析結果. SearchResultの評価結果の列と同じ値を16バイトで持つ.
+struct CompactResult {
+    uint8_t flags; // 凝った, 面白, 見事, 危険の順に下位ビットから
+    uint8_t numCrosses;
+    uint8_t effects[11];
+    int8_t nitros[3];
+
+    bool isElaborated() const { return flags & 1; }
+    bool isInteresting() const { return (flags >> 1) & 1; }
+    bool isWonderful() const { return (flags >> 2) & 1; }
+    bool isDanger() const { return (flags >> 3) & 1; }
+    unsigned int getNumCrosses() const { return numCrosses; }
+    unsigned int getEffect(unsigned int effect) const { return effects[effect]; }
+    int getSpeedNitro() const { return nitros[0]; }
+    int getStaminaNitro() const { return nitros[1]; }
+    int getPowerNitro() const { return nitros[2]; }
+
+    // RowはSearchResultと同じ名前の取得関数を持つ型
+    template <class Row> static CompactResult of(const Row& row) {
+        CompactResult result;
+        result.flags = (uint8_t)((row.isElaborated() ? 1 : 0) | (row.isInteresting() ? 2 : 0)
+            | (row.isWonderful() ? 4 : 0) | (row.isDanger() ? 8 : 0));
+        result.numCrosses = (uint8_t)row.getNumCrosses();
+        for (unsigned int i = 0; i < 11; i++) {
+            result.effects[i] = (uint8_t)row.getEffect(i);
+        }
+        result.nitros[0] = (int8_t)row.getSpeedNitro();
+        result.nitros[1] = (int8_t)row.getStaminaNitro();
+        result.nitros[2] = (int8_t)row.getPowerNitro();
+        return result;
+    }
+};
+
+struct ResultCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+    uint64_t entries;
+    uint64_t capacity;
+    uint64_t bytes; // 確保した表の大きさ
+    uint64_t version;
+};
+
+// 配合の指紋から分析結果を引く, 大きさに上限のあるキャッシュ. 複数のスレッドから使える.
+// 指紋で分けたSHARDS個の断片ごとに排他し, 断片の中は固定長の要素の配列とそれを指す線形探査の表で持つ.
+// 一杯になったらCLOCK(参照された要素は1周見逃す)で追い出す要素を選ぶ. 確保は構築時だけ.
+// 結果はデータベースの版ごとに異なるので, 新しい版が来たら全体を捨て, 古い版の問い合わせは読み書きしない.
+class ResultCache {
+private:
+    struct Slot {
+        PedigreeKey key;
+        CompactResult value;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Slot> slots;
+        std::vector<uint8_t> referenced;
+        std::vector<uint32_t> table; // slotsの番号. EMPTYは空き.
+        size_t size = 0;
+        size_t hand = 0;
+    };
+
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    std::unique_ptr<Shard[]> shards_;
+    size_t capacity_; // 断片ごとの要素の数
+    size_t mask_; // 表の大きさ-1
+    std::atomic<uint64_t> version_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> insertions_;
+    std::atomic<uint64_t> evictions_;
+
+    Shard& getShard(const PedigreeKey& key) const {
+        return shards_[key.hashes[0] % SHARDS];
+    }
+
+    size_t getHome(const PedigreeKey& key) const {
+        return key.hashes[1] & mask_;
+    }
+
+    // keyの表の位置. 無ければ最初の空きの位置.
+    size_t find(const Shard& shard, const PedigreeKey& key) const {
+        size_t i = getHome(key);
+        while (shard.table[i] != EMPTY && !(shard.slots[shard.table[i]].key == key)) {
+            i = (i + 1) & mask_;
+        }
+        return i;
+    }
+
+    // 表の位置iを空け, 後ろに続く要素を探査の列が途切れないように詰める
+    void erase(Shard& shard, size_t i) const {
+        size_t next = (i + 1) & mask_;
+        while (shard.table[next] != EMPTY) {
+            size_t home = getHome(shard.slots[shard.table[next]].key);
+            if (((next - home) & mask_) >= ((next - i) & mask_)) {
+                shard.table[i] = shard.table[next];
+                i = next;
+            }
+            next = (next + 1) & mask_;
+        }
+        shard.table[i] = EMPTY;
+    }
+
+    // 追い出す要素を選んで表から外し, その番号を返す
+    uint32_t evict(Shard& shard) {
+        while (shard.referenced[shard.hand]) {
+            shard.referenced[shard.hand] = 0;
+            shard.hand = (shard.hand + 1) % capacity_;
+        }
+        uint32_t victim = (uint32_t)shard.hand;
+        shard.hand = (shard.hand + 1) % capacity_;
+        erase(shard, find(shard, shard.slots[victim].key));
+        evictions_++;
+        return victim;
+    }
+
+public:
+    static constexpr size_t SHARDS = 16;
+
+    // entriesは全体の要素の数の上限
+    explicit ResultCache(size_t entries) : shards_(new Shard[SHARDS]), version_(0), hits_(0), misses_(0),
+        insertions_(0), evictions_(0) {
+        capacity_ = std::max<size_t>(1, (entries + SHARDS - 1) / SHARDS);
+        size_t tableSize = 1;
+        while (tableSize < capacity_ * 2) {
+            tableSize *= 2;
+        }
+        mask_ = tableSize - 1;
+        for (size_t s = 0; s < SHARDS; s++) {
+            shards_[s].slots.resize(capacity_);
+            shards_[s].referenced.resize(capacity_, 0);
+            shards_[s].table.resize(tableSize, EMPTY);
+        }
+    }
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // 版versionに切り替える. 新しい版なら今の要素をすべて捨て, 古い版なら何もしない.
+    // 切り替え後の版がversionならtrueを返す. falseなら古い版の問い合わせなのでキャッシュを使わないこと.
+    bool setVersion(uint64_t version) {
+        uint64_t current = version_.load();
+        while (current < version && !version_.compare_exchange_weak(current, version)) {
+        }
+        if (current >= version) {
+            return current == version;
+        }
+        for (size_t s = 0; s < SHARDS; s++) {
+            Shard& shard = shards_[s];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            std::fill(shard.table.begin(), shard.table.end(), EMPTY);
+            std::fill(shard.referenced.begin(), shard.referenced.end(), 0);
+            shard.size = 0;
+            shard.hand = 0;
+        }
+        return true;
+    }
+
+    // 古い版の問い合わせは数えないので, ヒット率は今の版の問い合わせだけから求まる
+    bool load(uint64_t version, const PedigreeKey& key, CompactResult& value) {
+        Shard& shard = getShard(key);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (version != version_.load()) {
+                return false;
+            }
+            uint32_t slot = shard.table[find(shard, key)];
+            if (slot != EMPTY) {
+                shard.referenced[slot] = 1;
+                value = shard.slots[slot].value;
+                hits_++;
+                return true;
+            }
+        }
+        misses_++;
+        return false;
+    }
+
+    void store(uint64_t version, const PedigreeKey& key, const CompactResult& value) {
+        Shard& shard = getShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (version != version_.load()) {
+            return;
+        }
+        size_t i = find(shard, key);
+        if (shard.table[i] != EMPTY) {
+            shard.slots[shard.table[i]].value = value;
+            return;
+        }
+        uint32_t slot = 0;
+        if (shard.size < capacity_) {
+            slot = (uint32_t)shard.size++;
+        } else {
+            slot = evict(shard);
+            // 追い出しで表が詰められたので探し直す
+            i = find(shard, key);
+        }
+        shard.slots[slot].key = key;
+        shard.slots[slot].value = value;
+        shard.referenced[slot] = 0;
+        shard.table[i] = slot;
+        insertions_++;
+    }
+
+    ResultCacheStats getStats() const {
+        ResultCacheStats stats;
+        stats.hits = hits_.load();
+        stats.misses = misses_.load();
+        stats.insertions = insertions_.load();
+        stats.evictions = evictions_.load();
+        stats.entries = 0;
+        for (size_t s = 0; s < SHARDS; s++) {
+            std::lock_guard<std::mutex> lock(shards_[s].mutex);
+            stats.entries += shards_[s].size;
+        }
+        stats.capacity = capacity_ * SHARDS;
+        stats.bytes = SHARDS * (sizeof(Shard)
+            + capacity_ * (sizeof(Slot) + sizeof(uint8_t)) + (mask_ + 1) * sizeof(uint32_t));
+        stats.version = version_.load();
+        return stats;
+    }
+};
+
+}
+}
+
+#endif // SEARCH_RESULTCACHE_H
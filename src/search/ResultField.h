@@ -0,0 +1,89 @@
+#ifndef SEARCH_RESULTFIELD_H
+#define SEARCH_RESULTFIELD_H
+
+#include <string_view>
+
+namespace pedsearch {
+namespace search {
+
+// SearchResultの数値として扱える列. 並びはcsvの列と同じ.
+enum class ResultField {
+    ELABORATED, INTERESTING, WONDERFUL, DANGER,
+    SPRINT, SPEED, STAMINA, SPIRIT, STABLE, TEMPER, PRECOCIOUS, ALTRICAL, TOUGH, DIRT, POWER,
+    SPEED_NITRO, STAMINA_NITRO, POWER_NITRO,
+    CROSSES,
+    NUM_FIELDS
+};
+
+// 列の英語名とcsvの見出し. クロスの数はcsvに無い.
+inline const char* const* getResultFieldNames(ResultField field) {
+    static const char* names[(size_t)ResultField::NUM_FIELDS][2] = {
+        {"elaborated", "凝った"}, {"interesting", "面白"}, {"wonderful", "見事"}, {"danger", "危険"},
+        {"sprint", "短距離"}, {"speed", "速力"}, {"stamina", "長距離"}, {"spirit", "底力"},
+        {"stable", "安定"}, {"temper", "気性難"}, {"precocious", "早熟"}, {"altrical", "晩成"},
+        {"tough", "丈夫"}, {"dirt", "ダート"}, {"power", "パワー"},
+        {"sp", "SP"}, {"st", "ST"}, {"pw", "PW"},
+        {"crosses", "クロス"}
+    };
+    return names[(size_t)field];
+}
+
+// 英語名とcsvの見出しのどちらでも指定できる
+inline bool parseResultField(std::string_view name, ResultField& field) {
+    for (size_t i = 0; i < (size_t)ResultField::NUM_FIELDS; i++) {
+        const char* const* names = getResultFieldNames((ResultField)i);
+        if (name == names[0] || name == names[1]) {
+            field = (ResultField)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// RowはSearchResultと同じ名前の取得関数を持つ型
+template <class Row> int getResultField(const Row& result, ResultField field) {
+    switch (field) {
+    case ResultField::ELABORATED:
+        return result.isElaborated() ? 1 : 0;
+    case ResultField::INTERESTING:
+        return result.isInteresting() ? 1 : 0;
+    case ResultField::WONDERFUL:
+        return result.isWonderful() ? 1 : 0;
+    case ResultField::DANGER:
+        return result.isDanger() ? 1 : 0;
+    case ResultField::SPEED_NITRO:
+        return result.getSpeedNitro();
+    case ResultField::STAMINA_NITRO:
+        return result.getStaminaNitro();
+    case ResultField::POWER_NITRO:
+        return result.getPowerNitro();
+    case ResultField::CROSSES:
+        return (int)result.getNumCrosses();
+    default:
+        return (int)result.getEffect((unsigned int)field - (unsigned int)ResultField::SPRINT);
+    }
+}
+
+enum class Comparison { EQ, NE, LT, LE, GT, GE };
+
+inline bool compare(int x, Comparison comparison, int y) {
+    switch (comparison) {
+    case Comparison::EQ:
+        return x == y;
+    case Comparison::NE:
+        return x != y;
+    case Comparison::LT:
+        return x < y;
+    case Comparison::LE:
+        return x <= y;
+    case Comparison::GT:
+        return x > y;
+    default:
+        return x >= y;
+    }
+}
+
+}
+}
+
+#endif // SEARCH_RESULTFIELD_H
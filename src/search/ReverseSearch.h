@@ -0,0 +1,242 @@
+#ifndef SEARCH_REVERSESEARCH_H
+#define SEARCH_REVERSESEARCH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "base/DefaultStallion.h"
+#include "search/Arena.h"
+#include "search/AttributeIndex.h"
+#include "search/Filter.h"
+#include "search/PedigreeAnalyzer.h"
+#include "search/PedigreeSearch.h"
+#include "search/PedigreeTool.h"
+#include "search/SearchQuery.h"
+#include "search/SearchResult.h"
+
+namespace pedsearch {
+namespace search {
+
+// 種牡馬stallion(stallions.jsonのid)の父側sire代×母側dam代のクロス. 世代の0はどの世代でもよいことを表す.
+struct CrossPattern {
+    size_t stallion;
+    unsigned int sire;
+    unsigned int dam;
+};
+
+// 目的のクロスを作る父を探す. 探索空間の位置0が父の候補で, 残りの位置で母を作る.
+// 母(と母を作る種牡馬)の組ごとに, 母の血統表にクロスの相手が無ければ父を調べずに飛ばし,
+// 父の候補は位置ごとの祖先の索引で「指定の世代の位置にその種牡馬を持つ父」に絞ってから分析する.
+// クロスは, 父側と母側のその世代の位置にその種牡馬があり, 分析がその種牡馬のクロスとして両方の世代を数えたものとする.
+class ReverseSearch {
+private:
+    const PedigreeTool& tool_;
+    SearchEngine engine_;
+    const std::vector<CrossPattern> patterns_;
+    uint64_t evaluations_;
+
+    // 位置0..15のうち世代generationの位置. first=1なら繁殖牝馬の位置1..15.
+    static std::vector<unsigned int> getSlots(unsigned int generation, unsigned int first) {
+        std::vector<unsigned int> slots;
+        for (unsigned int slot = first; slot < 16; slot++) {
+            if (generation == 0 || PedigreeAnalyzer::indexToGeneration(slot) == generation) {
+                slots.push_back(slot);
+            }
+        }
+        return slots;
+    }
+
+    static bool hasAncestor(const base::DefaultStallion& stallion, const CrossPattern& pattern) {
+        for (unsigned int slot: getSlots(pattern.sire, 0)) {
+            if (stallion.getAncestorIndex(base::Index(slot)) == pattern.stallion) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool hasAncestor(const base::DefaultBroodmare& broodmare, const CrossPattern& pattern) {
+        for (unsigned int slot: getSlots(pattern.dam, 1)) {
+            if (broodmare.getAncestorIndex(base::Index(slot)) == pattern.stallion) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool hasCross(const Cross& cross, const CrossPattern& pattern) {
+        if (!cross.hasCross(pattern.stallion)) {
+            return false;
+        }
+        const std::pmr::vector<unsigned int>& generations = cross.getGenerations(pattern.stallion);
+        if (pattern.sire == 0 || pattern.dam == 0) {
+            unsigned int generation = std::max(pattern.sire, pattern.dam);
+            return generation == 0
+                || std::find(generations.begin(), generations.end(), generation) != generations.end();
+        }
+        size_t sire = std::count(generations.begin(), generations.end(), pattern.sire);
+        size_t dam = std::count(generations.begin(), generations.end(), pattern.dam);
+        return pattern.sire == pattern.dam ? sire >= 2 : (sire >= 1 && dam >= 1);
+    }
+
+    // crossがpatternsのクロスをすべて含むか. 祖先の位置は探索の絞り込みで確かめ済みとする.
+    static bool hasCrosses(const Cross& cross, const std::vector<CrossPattern>& patterns) {
+        for (const CrossPattern& pattern: patterns) {
+            if (!hasCross(cross, pattern)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    // stallion×broodmareの分析crossがpatternsのクロスをすべて作っているか.
+    // 探索の絞り込みを使わずに祖先の位置も調べるので, 全行を調べる検査に使える.
+    static bool matches(
+        const base::DefaultStallion& stallion, const base::DefaultBroodmare& broodmare, const Cross& cross,
+        const std::vector<CrossPattern>& patterns
+    ) {
+        for (const CrossPattern& pattern: patterns) {
+            if (!hasAncestor(stallion, pattern) || !hasAncestor(broodmare, pattern)) {
+                return false;
+            }
+        }
+        return hasCrosses(cross, patterns);
+    }
+
+    // "ﾉｰｻﾞﾝﾃｰｽﾄ:4x3,Mr. Prospector:5x*"のようにカンマで区切る. xは×でもよく, *はどの世代でもよい.
+    static std::vector<CrossPattern> parse(const PedigreeTool& tool, std::string_view expression) {
+        std::vector<CrossPattern> patterns;
+        std::string_view rest = expression;
+        while (!rest.empty()) {
+            size_t comma = rest.find(',');
+            std::string_view item = rest.substr(0, comma);
+            rest = (comma == std::string_view::npos) ? std::string_view() : rest.substr(comma + 1);
+
+            size_t colon = item.rfind(':');
+            if (colon == std::string_view::npos) {
+                throw std::runtime_error(
+                    "ReverseSearch::parse: \"" + std::string(item) + "\" is not NAME:SIRExDAM."
+                );
+            }
+            std::string_view generations = item.substr(colon + 1);
+            size_t times = generations.find("×");
+            size_t width = std::string_view("×").size();
+            if (times == std::string_view::npos) {
+                times = generations.find('x');
+                width = 1;
+            }
+            CrossPattern pattern;
+            unsigned int* values[2] = {&pattern.sire, &pattern.dam};
+            std::string_view parts[2] = {
+                generations.substr(0, times),
+                (times == std::string_view::npos) ? std::string_view() : generations.substr(times + width)
+            };
+            for (unsigned int i = 0; i < 2; i++) {
+                if (parts[i] == "*") {
+                    *values[i] = 0;
+                } else if (parts[i].size() == 1 && parts[i][0] >= '1' && parts[i][0] <= '5') {
+                    *values[i] = (unsigned int)(parts[i][0] - '0');
+                } else {
+                    throw std::runtime_error(
+                        "ReverseSearch::parse: invalid generations \"" + std::string(generations)
+                        + "\". Use 1..5 or * like 4x3."
+                    );
+                }
+            }
+            std::string_view name = item.substr(0, colon);
+            if (name.empty() || !tool.findStallion(name, pattern.stallion)) {
+                throw std::runtime_error(
+                    "ReverseSearch::parse: The stallion \"" + std::string(name) + "\" is not in stallions.json."
+                );
+            }
+            patterns.push_back(pattern);
+        }
+        if (patterns.empty()) {
+            throw std::runtime_error("ReverseSearch::parse: no cross is given.");
+        }
+        return patterns;
+    }
+
+    ReverseSearch(
+        const PedigreeTool& tool, SearchSpace space, std::vector<CrossPattern> patterns,
+        std::optional<Filter> filter=std::nullopt
+    ) : tool_(tool), engine_(tool, std::move(space), std::move(filter)), patterns_(std::move(patterns)),
+        evaluations_(0) {}
+
+    const SearchSpace& getSpace() const {
+        return engine_.getSpace();
+    }
+
+    // 条件を満たす行を行番号の順に返す
+    std::vector<SearchResult> run() {
+        const SearchSpace& space = engine_.getSpace();
+        const unsigned int generation = space.getGeneration();
+        const std::vector<size_t>& sires = space.getCandidates(0);
+        const AncestorIndex& index = tool_.getDefaultStallionAncestorIndex();
+
+        // 父の候補のうち, どのクロスも父側に持ちうるもの
+        Bitmap candidates(index.size());
+        for (size_t sire: sires) {
+            candidates.set(sire);
+        }
+        for (const CrossPattern& pattern: patterns_) {
+            candidates &= index.select(pattern.stallion, getSlots(pattern.sire, 0));
+        }
+
+        evaluations_ = 0;
+        std::vector<SearchResult> results;
+        SearchResult result;
+        const uint64_t dams = space.size() / sires.size();
+        size_t chain[SearchQuery::MAX_GENERATION + 1] = {};
+        for (uint64_t dam = 0; dam < dams; dam++) {
+            space.decode(dam, chain);
+            std::optional<base::DefaultBroodmare> broodmare(tool_.getDefaultBroodmare(chain[generation]));
+            for (unsigned int i = generation - 1; i >= 1; i--) {
+                broodmare.emplace(tool_.makeDefaultBroodmare(chain[i], *broodmare));
+            }
+            bool possible = true;
+            for (const CrossPattern& pattern: patterns_) {
+                possible = possible && hasAncestor(*broodmare, pattern);
+            }
+            if (!possible) {
+                continue;
+            }
+
+            ArenaScope scope;
+            for (size_t i = 0; i < sires.size(); i++) {
+                if (!candidates.test(sires[i])) {
+                    continue;
+                }
+                evaluations_++;
+                // 作った母をそのまま使い, クロスの判定に使った分析を条件と結果にも使う
+                const uint64_t row = i * dams + dam;
+                auto accept = [this](const PedigreeAnalysis& analysis) {
+                    return hasCrosses(analysis.getCross(), patterns_);
+                };
+                if (engine_.evaluate(row, *broodmare, result, accept)) {
+                    results.push_back(result);
+                }
+            }
+        }
+        std::sort(results.begin(), results.end(), [](const SearchResult& a, const SearchResult& b) {
+            return a.getRow() < b.getRow();
+        });
+        return results;
+    }
+
+    // 直前のrun()で分析した組の数
+    uint64_t getNumEvaluations() const {
+        return evaluations_;
+    }
+};
+
+}
+}
+
+#endif // SEARCH_REVERSESEARCH_H
@@ -0,0 +1,218 @@
+#ifndef SEARCH_SAMPLING_H
+#define SEARCH_SAMPLING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "search/Filter.h"
+#include "search/PedigreeSearch.h"
+#include "search/PedigreeTool.h"
+#include "search/Progress.h"
+#include "search/SearchQuery.h"
+#include "search/SearchResult.h"
+
+namespace pedsearch {
+namespace search {
+
+// 標本から推定した割合と95%信頼区間(Wilson)
+struct SampleEstimate {
+    std::string name;
+    uint64_t hits;
+    uint64_t samples;
+    double ratio;
+    double lower;
+    double upper;
+};
+
+// 探索空間から無作為に選んだ配合だけを評価し, 凝った/面白/見事/危険(と条件)の割合を推定する.
+// 標本はCHUNK_SIZE個ずつの塊に分け, 塊ごとにseedと塊の番号から作った乱数列を使うので, スレッド数によらず同じ結果になる.
+// stratifiedなら母(最後の位置)の候補ごとに同じ数ずつ選ぶ層化抽出を行う.
+class Sampler {
+private:
+    SearchEngine engine_;
+    const std::optional<Filter> filter_;
+    const uint64_t samples_;
+    const uint64_t seed_;
+    const bool stratified_;
+
+    static constexpr unsigned int NUM_FLAGS = 4;
+
+    unsigned int getNumColumns() const {
+        return NUM_FLAGS + (filter_ ? 1 : 0);
+    }
+
+    uint64_t getNumStrata() const {
+        const SearchSpace& space = engine_.getSpace();
+        return stratified_ ? space.getCandidates(space.getGeneration()).size() : 1;
+    }
+
+    static uint64_t splitmix64(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // [0, n)の整数. 剰余を使わず上位ビットで決める.
+    static uint64_t uniform(std::mt19937_64& rng, uint64_t n) {
+        return (uint64_t)(((unsigned __int128)rng() * n) >> 64);
+    }
+
+    // 標本iの層と行番号. 層化抽出では標本iは層i % 層の数から選ぶ.
+    uint64_t draw(uint64_t i, std::mt19937_64& rng, uint64_t& stratum) const {
+        const SearchSpace& space = engine_.getSpace();
+        if (!stratified_) {
+            stratum = 0;
+            return uniform(rng, space.size());
+        }
+        uint64_t strata = getNumStrata();
+        stratum = i % strata;
+        // 母は行番号の最下位の桁
+        return uniform(rng, space.size() / strata) * strata + stratum;
+    }
+
+    // hitsは層ごとに列の数だけ並べた該当数
+    void work(std::atomic<uint64_t>& next, std::vector<uint64_t>& hits, Progress* progress, unsigned int thread) const {
+        const unsigned int columns = getNumColumns();
+        const uint64_t chunks = (samples_ + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        SearchResult result;
+        while (true) {
+            uint64_t chunk = next.fetch_add(1);
+            if (chunk >= chunks) {
+                break;
+            }
+            std::mt19937_64 rng(splitmix64(seed_ ^ splitmix64(chunk)));
+            uint64_t end = std::min((chunk + 1) * CHUNK_SIZE, samples_);
+            for (uint64_t i = chunk * CHUNK_SIZE; i < end; i++) {
+                uint64_t stratum = 0;
+                engine_.evaluate(draw(i, rng, stratum), result);
+                uint64_t* h = &hits[stratum * columns];
+                h[0] += result.isElaborated() ? 1 : 0;
+                h[1] += result.isInteresting() ? 1 : 0;
+                h[2] += result.isWonderful() ? 1 : 0;
+                h[3] += result.isDanger() ? 1 : 0;
+                if (filter_) {
+                    h[NUM_FLAGS] += filter_->matches(result) ? 1 : 0;
+                }
+            }
+            if (progress != nullptr) {
+                progress->add(thread, end - chunk * CHUNK_SIZE);
+            }
+        }
+    }
+
+    // 割合ratioと分散varianceから95%信頼区間を求める. 有効標本数n = p(1-p)/分散でWilsonの区間を作る.
+    static void setInterval(SampleEstimate& estimate, double variance) {
+        const double z = 1.959963984540054;
+        double p = estimate.ratio;
+        double n = (variance > 0) ? p * (1 - p) / variance : (double)estimate.samples;
+        if (n <= 0) {
+            estimate.lower = 0;
+            estimate.upper = 1;
+            return;
+        }
+        double denominator = 1 + z * z / n;
+        double center = (p + z * z / (2 * n)) / denominator;
+        double half = z / denominator * std::sqrt(p * (1 - p) / n + z * z / (4 * n * n));
+        estimate.lower = std::max(0.0, center - half);
+        estimate.upper = std::min(1.0, center + half);
+    }
+
+public:
+    static constexpr uint64_t CHUNK_SIZE = 1024;
+
+    Sampler(
+        const PedigreeTool& tool, SearchSpace space, uint64_t samples, uint64_t seed,
+        bool stratified=false, std::optional<Filter> filter=std::nullopt
+    ) : engine_(tool, std::move(space)), filter_(std::move(filter)), samples_(samples), seed_(seed),
+        stratified_(stratified) {
+        if (stratified_ && samples_ < getNumStrata()) {
+            throw std::runtime_error(
+                "Sampler::Sampler: stratified sampling needs at least " + std::to_string(getNumStrata()) + " samples."
+            );
+        }
+    }
+
+    const SearchSpace& getSpace() const {
+        return engine_.getSpace();
+    }
+
+    uint64_t getNumSamples() const {
+        return samples_;
+    }
+
+    // threadsが0ならハードウェアのスレッド数を使う. 凝った,面白,見事,危険(,条件)の順に返す.
+    std::vector<SampleEstimate> run(unsigned int threads=0, Progress* progress=nullptr) const {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        const unsigned int columns = getNumColumns();
+        const uint64_t strata = getNumStrata();
+
+        std::atomic<uint64_t> next(0);
+        std::vector<std::vector<uint64_t> > hits(threads, std::vector<uint64_t>(strata * columns, 0));
+        std::vector<std::thread> workers;
+        for (unsigned int i = 1; i < threads; i++) {
+            workers.emplace_back([this, &next, &hits, progress, i]() { work(next, hits[i], progress, i); });
+        }
+        work(next, hits[0], progress, 0);
+        for (std::thread& worker: workers) {
+            worker.join();
+        }
+        for (unsigned int i = 1; i < threads; i++) {
+            for (size_t j = 0; j < hits[0].size(); j++) {
+                hits[0][j] += hits[i][j];
+            }
+        }
+
+        static const char* names[NUM_FLAGS + 1] = {"凝った", "面白", "見事", "危険", "条件"};
+        std::vector<SampleEstimate> estimates(columns);
+        for (unsigned int c = 0; c < columns; c++) {
+            SampleEstimate& estimate = estimates[c];
+            estimate.name = names[c];
+            estimate.samples = samples_;
+            estimate.hits = 0;
+            for (uint64_t h = 0; h < strata; h++) {
+                estimate.hits += hits[0][h * columns + c];
+            }
+            if (samples_ == 0) {
+                estimate.ratio = 0;
+                estimate.lower = 0;
+                estimate.upper = 1;
+                continue;
+            }
+            if (!stratified_) {
+                estimate.ratio = (double)estimate.hits / samples_;
+                setInterval(estimate, 0);
+                continue;
+            }
+            // 各層は探索空間の同じ割合を占めるので, 層ごとの割合の平均が全体の割合の推定になる
+            double ratio = 0;
+            double variance = 0;
+            for (uint64_t h = 0; h < strata; h++) {
+                uint64_t n = samples_ / strata + (h < samples_ % strata ? 1 : 0);
+                if (n == 0) {
+                    continue;
+                }
+                double p = (double)hits[0][h * columns + c] / n;
+                ratio += p / strata;
+                variance += p * (1 - p) / n / ((double)strata * strata);
+            }
+            estimate.ratio = ratio;
+            setInterval(estimate, variance);
+        }
+        return estimates;
+    }
+};
+
+}
+}
+
+#endif // SEARCH_SAMPLING_H
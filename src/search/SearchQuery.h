@@ -0,0 +1,120 @@
+#ifndef SEARCH_SEARCHQUERY_H
+#define SEARCH_SEARCHQUERY_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "base/Debug.h"
+#include "search/Filter.h"
+
+namespace pedsearch {
+namespace search {
+
+// 探索条件: 父, 母父, 母母父, ..., 母の順に名前を指定する. "all"は全探索を表す.
+class SearchQuery {
+private:
+    std::vector<std::string> stallions_;
+    std::string broodmare_;
+    std::optional<Filter> filter_;
+
+public:
+    static constexpr unsigned int MAX_GENERATION = 5;
+
+    SearchQuery() {}
+
+    SearchQuery(std::initializer_list<std::string_view> names) {
+        PEDSEARCH_ASSERT(
+            names.size() >= 2,
+            "SearchQuery::SearchQuery: at least 2 names are required but got " + std::to_string(names.size())
+        );
+        auto it = names.begin();
+        for (size_t i = 0; i + 1 < names.size(); i++, ++it) {
+            addStallion(*it);
+        }
+        setBroodmare(*it);
+    }
+
+    void addStallion(std::string_view name) {
+        PEDSEARCH_ASSERT(
+            stallions_.size() < MAX_GENERATION,
+            "SearchQuery::addStallion: generation must be lower than " + std::to_string(MAX_GENERATION + 1)
+        );
+        stallions_.push_back(std::string(name));
+    }
+
+    void setBroodmare(std::string_view name) {
+        broodmare_ = name;
+    }
+
+    unsigned int getGeneration() const {
+        return (unsigned int)stallions_.size();
+    }
+
+    std::string_view getStallion(unsigned int position) const {
+        PEDSEARCH_ASSERT(
+            position < stallions_.size(),
+            "SearchQuery::getStallion: position must be lower than " + std::to_string(stallions_.size())
+            + " but got " + std::to_string(position)
+        );
+        return stallions_[position];
+    }
+
+    std::string_view getBroodmare() const {
+        return broodmare_;
+    }
+
+    // 条件を満たす結果だけを返す. 書式はFilterを参照.
+    void setFilter(std::string_view expression) {
+        filter_.emplace(expression);
+    }
+
+    const std::optional<Filter>& getFilter() const {
+        return filter_;
+    }
+};
+
+// 名前を解決した探索空間. 各位置の候補の直積を行番号で表し, 末尾の位置(母)が最も速く変化する.
+class SearchSpace {
+private:
+    std::vector<std::vector<size_t> > candidates_;
+
+public:
+    SearchSpace(std::vector<std::vector<size_t> > candidates) : candidates_(std::move(candidates)) {
+        PEDSEARCH_ASSERT(
+            candidates_.size() >= 2 && candidates_.size() <= SearchQuery::MAX_GENERATION + 1,
+            "SearchSpace::SearchSpace: invalid chain length " + std::to_string(candidates_.size())
+        );
+    }
+
+    unsigned int getGeneration() const {
+        return (unsigned int)candidates_.size() - 1;
+    }
+
+    // 位置0..generation-1が種牡馬, 位置generationが繁殖牝馬
+    const std::vector<size_t>& getCandidates(unsigned int position) const {
+        return candidates_[position];
+    }
+
+    uint64_t size() const {
+        uint64_t n = 1;
+        for (auto it = candidates_.begin(); it != candidates_.end(); ++it) {
+            n *= (*it).size();
+        }
+        return n;
+    }
+
+    void decode(uint64_t row, size_t* chain) const {
+        for (size_t i = candidates_.size(); i-- > 0;) {
+            chain[i] = candidates_[i][row % candidates_[i].size()];
+            row /= candidates_[i].size();
+        }
+    }
+};
+
+}
+}
+
+#endif // SEARCH_SEARCHQUERY_H
@@ -0,0 +1,93 @@
+#ifndef SEARCH_SEARCHRESULT_H
+#define SEARCH_SEARCHRESULT_H
+
+#include <cstdint>
+#include <type_traits>
+#include "base/Debug.h"
+#include "search/SearchQuery.h"
+
+namespace pedsearch {
+namespace search {
+
+// 探索結果1行分の要約. クロスは危険フラグと因子の本数に集計済み.
+// 探索はまとまりごとに確保済みの配列へ書き込むので, 32バイトの固定長で写すだけの型にする.
+// クロスは母側の15の位置を超えないので, クロスの数と因子の本数は4bitに収まる.
+class SearchResult {
+private:
+    friend class SearchEngine;
+    friend class StoredResults;
+
+    enum Flag : uint8_t {
+        ELABORATED = 1, INTERESTING = 2, WONDERFUL = 4, DANGER = 8
+    };
+
+    uint64_t row_;
+    uint16_t chain_[SearchQuery::MAX_GENERATION + 1];
+    uint8_t flags_;
+    uint8_t numCrosses_;
+    uint8_t effects_[6]; // 短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワーの順に4bitずつ
+    int8_t speedNitro_;
+    int8_t staminaNitro_;
+    int8_t powerNitro_;
+
+    void setFlag(Flag flag, bool value) {
+        flags_ = value ? (uint8_t)(flags_ | flag) : (uint8_t)(flags_ & ~flag);
+    }
+
+    void setNumCrosses(unsigned int numCrosses) {
+        PEDSEARCH_ASSERT(
+            numCrosses < 16, "SearchResult::setNumCrosses: too many crosses " + std::to_string(numCrosses)
+        );
+        numCrosses_ = (uint8_t)numCrosses;
+    }
+
+    // 因子の本数をすべて書く. countsは11個.
+    template <class Count> void setEffects(const Count* counts) {
+        for (unsigned int i = 0; i < 6; i++) {
+            unsigned int low = (unsigned int)counts[2 * i];
+            unsigned int high = (2 * i + 1 < 11) ? (unsigned int)counts[2 * i + 1] : 0;
+            PEDSEARCH_ASSERT(
+                low < 16 && high < 16, "SearchResult::setEffects: too many effects in " + std::to_string(i)
+            );
+            effects_[i] = (uint8_t)(low | (high << 4));
+        }
+    }
+
+public:
+    SearchResult() : row_(0), chain_{}, flags_(0), numCrosses_(0), effects_{},
+        speedNitro_(0), staminaNitro_(0), powerNitro_(0) {}
+
+    uint64_t getRow() const { return row_; }
+
+    // 位置0..generation-1はデフォルト種牡馬のid, 位置generationはデフォルト繁殖牝馬のid
+    size_t getChain(unsigned int position) const {
+        PEDSEARCH_ASSERT(
+            position <= SearchQuery::MAX_GENERATION,
+            "SearchResult::getChain: invalid position " + std::to_string(position)
+        );
+        return chain_[position];
+    }
+
+    bool isElaborated() const { return (flags_ & ELABORATED) != 0; }
+    bool isInteresting() const { return (flags_ & INTERESTING) != 0; }
+    bool isWonderful() const { return (flags_ & WONDERFUL) != 0; }
+    bool isDanger() const { return (flags_ & DANGER) != 0; }
+    unsigned int getNumCrosses() const { return numCrosses_; }
+
+    unsigned int getEffect(unsigned int effect) const {
+        PEDSEARCH_ASSERT(effect < 11, "SearchResult::getEffect: invalid effect " + std::to_string(effect));
+        return (effects_[effect / 2] >> (4 * (effect % 2))) & 0xf;
+    }
+
+    int getSpeedNitro() const { return speedNitro_; }
+    int getStaminaNitro() const { return staminaNitro_; }
+    int getPowerNitro() const { return powerNitro_; }
+};
+
+static_assert(sizeof(SearchResult) <= 32, "SearchResult must fit in 32 bytes.");
+static_assert(std::is_trivially_copyable<SearchResult>::value, "SearchResult must be trivially copyable.");
+
+}
+}
+
+#endif // SEARCH_SEARCHRESULT_H
@@ -0,0 +1,86 @@
+#ifndef SEARCH_SHARD_H
+#define SEARCH_SHARD_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "search/SearchQuery.h"
+
+namespace pedsearch {
+namespace search {
+
+// 探索空間をcount個に分けたうちのindex番目(1から数える). 例: "2/4"
+// 先頭の位置(外側の父)から候補の組を単位として行番号の連続した範囲に分け, 単位の数が均等になるよう割り当てる.
+// 1行あたりの分析の時間は配合する馬によらずほぼ一定なので, 行数で均等に分ければ断片ごとの時間もそろう.
+// 各断片は行番号の連続した範囲なので, 断片の出力を順に連結すれば1プロセスで探索した出力と同じになる.
+class Shard {
+private:
+    unsigned int index_;
+    unsigned int count_;
+
+    // 1つの断片あたりの単位の数の下限. 少ないと均等に分けられない.
+    static constexpr uint64_t UNITS_PER_SHARD = 8;
+
+public:
+    Shard(unsigned int index=1, unsigned int count=1) : index_(index), count_(count) {
+        if (count_ == 0 || index_ == 0 || index_ > count_) {
+            throw std::runtime_error(
+                "Shard::Shard: invalid shard " + std::to_string(index_) + "/" + std::to_string(count_) + "."
+            );
+        }
+    }
+
+    static Shard parse(std::string_view text) {
+        size_t slash = text.find('/');
+        try {
+            if (slash != std::string_view::npos) {
+                size_t n = 0;
+                unsigned long index = std::stoul(std::string(text.substr(0, slash)), &n);
+                if (n == slash) {
+                    unsigned long count = std::stoul(std::string(text.substr(slash + 1)), &n);
+                    if (n == text.size() - slash - 1) {
+                        return Shard((unsigned int)index, (unsigned int)count);
+                    }
+                }
+            }
+        } catch (std::logic_error&) {
+        }
+        throw std::runtime_error("Shard::parse: invalid shard \"" + std::string(text) + "\".");
+    }
+
+    unsigned int getIndex() const {
+        return index_;
+    }
+
+    unsigned int getCount() const {
+        return count_;
+    }
+
+    std::string toString() const {
+        return std::to_string(index_) + "/" + std::to_string(count_);
+    }
+
+    // この断片が受け持つ行番号の範囲[begin, end). 同じ探索空間なら常に同じ範囲になる.
+    std::pair<uint64_t, uint64_t> getRange(const SearchSpace& space) const {
+        unsigned int generation = space.getGeneration();
+        unsigned int positions = 0;
+        uint64_t units = 1;
+        while (positions <= generation && units < UNITS_PER_SHARD * count_) {
+            units *= space.getCandidates(positions).size();
+            positions++;
+        }
+        const uint64_t rowsPerUnit = space.size() / units;
+
+        // 単位[units * (index - 1) / count, units * index / count)を受け持つ
+        uint64_t begin = (uint64_t)((unsigned __int128)units * (index_ - 1) / count_);
+        uint64_t end = (uint64_t)((unsigned __int128)units * index_ / count_);
+        return std::make_pair(begin * rowsPerUnit, end * rowsPerUnit);
+    }
+};
+
+}
+}
+
+#endif // SEARCH_SHARD_H
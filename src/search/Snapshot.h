@@ -0,0 +1,47 @@
+#ifndef SEARCH_SNAPSHOT_H
+#define SEARCH_SNAPSHOT_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include "search/PedigreeTool.h"
+
+namespace pedsearch {
+namespace search {
+
+// 読み込んだデータベースの1つの版. 作った後は変更しない.
+struct Snapshot {
+    PedigreeTool tool;
+    uint64_t version;
+};
+
+// 常駐するプロセスの現在の版. 問い合わせはget()で取った版を最後まで使うので,
+// 途中でpublish()しても古い版のまま終わり, 最後の参照が無くなった時に古い版が解放される.
+// 分析中は版を共有するだけで排他はしない.
+class SnapshotStore {
+private:
+    std::shared_ptr<const Snapshot> current_;
+    std::mutex publishing_; // 版の番号を振る側だけで使う
+
+public:
+    explicit SnapshotStore(PedigreeTool tool) :
+        current_(std::make_shared<const Snapshot>(Snapshot{std::move(tool), 1})) {}
+
+    std::shared_ptr<const Snapshot> get() const {
+        return std::atomic_load(&current_);
+    }
+
+    // 新しい版に差し替え, その番号を返す
+    uint64_t publish(PedigreeTool tool) {
+        std::lock_guard<std::mutex> lock(publishing_);
+        uint64_t version = get()->version + 1;
+        std::atomic_store(&current_, std::make_shared<const Snapshot>(Snapshot{std::move(tool), version}));
+        return version;
+    }
+};
+
+}
+}
+
+#endif // SEARCH_SNAPSHOT_H
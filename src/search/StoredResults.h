@@ -0,0 +1,40 @@
+#ifndef SEARCH_STOREDRESULTS_H
+#define SEARCH_STOREDRESULTS_H
+
+#include <cstdint>
+#include "search/SearchResult.h"
+
+namespace pedsearch {
+namespace search {
+
+// 以前に評価した結果. SearchEngineは値を持つ行を分析せずにここから取り出す.
+class StoredResults {
+protected:
+    // RowはSearchResultと同じ名前の取得関数を持つ型. 行番号と鎖は写さない.
+    template <class Row> static void copy(const Row& row, SearchResult& result) {
+        result.setFlag(SearchResult::ELABORATED, row.isElaborated());
+        result.setFlag(SearchResult::INTERESTING, row.isInteresting());
+        result.setFlag(SearchResult::WONDERFUL, row.isWonderful());
+        result.setFlag(SearchResult::DANGER, row.isDanger());
+        result.setNumCrosses(row.getNumCrosses());
+        unsigned int effects[11];
+        for (unsigned int i = 0; i < 11; i++) {
+            effects[i] = row.getEffect(i);
+        }
+        result.setEffects(effects);
+        result.speedNitro_ = (int8_t)row.getSpeedNitro();
+        result.staminaNitro_ = (int8_t)row.getStaminaNitro();
+        result.powerNitro_ = (int8_t)row.getPowerNitro();
+    }
+
+public:
+    virtual ~StoredResults() {}
+
+    // 行rowの結果を持っていればresultの評価結果の列を書いてtrueを返す. 複数のスレッドから呼ばれる.
+    virtual bool load(uint64_t row, SearchResult& result) const = 0;
+};
+
+}
+}
+
+#endif // SEARCH_STOREDRESULTS_H
@@ -0,0 +1,64 @@
+#ifndef SEARCH_TOPRESULTS_H
+#define SEARCH_TOPRESULTS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "search/ResultField.h"
+#include "search/SearchResult.h"
+
+namespace pedsearch {
+namespace search {
+
+// 列fieldの値が大きい順に上位k行を残す. 値が同じなら行番号の小さい方を残す.
+class TopResults {
+private:
+    const size_t k_;
+    const ResultField field_;
+    std::vector<SearchResult> heap_; // 先頭が残した中で最も悪い行
+
+    // aの方が上位か
+    bool isBetter(const SearchResult& a, const SearchResult& b) const {
+        int x = getResultField(a, field_);
+        int y = getResultField(b, field_);
+        return x != y ? x > y : a.getRow() < b.getRow();
+    }
+
+public:
+    TopResults(size_t k, ResultField field) : k_(k), field_(field) {
+        heap_.reserve(k_);
+    }
+
+    void add(const SearchResult& result) {
+        auto better = [this](const SearchResult& a, const SearchResult& b) { return isBetter(a, b); };
+        if (heap_.size() < k_) {
+            heap_.push_back(result);
+            std::push_heap(heap_.begin(), heap_.end(), better);
+        } else if (k_ > 0 && isBetter(result, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), better);
+            heap_.back() = result;
+            std::push_heap(heap_.begin(), heap_.end(), better);
+        }
+    }
+
+    void add(const std::vector<SearchResult>& batch) {
+        for (const SearchResult& result: batch) {
+            add(result);
+        }
+    }
+
+    // 上位から順に並べて返す
+    std::vector<SearchResult> take() {
+        std::vector<SearchResult> results;
+        results.swap(heap_);
+        std::sort(results.begin(), results.end(), [this](const SearchResult& a, const SearchResult& b) {
+            return isBetter(a, b);
+        });
+        return results;
+    }
+};
+
+}
+}
+
+#endif // SEARCH_TOPRESULTS_H
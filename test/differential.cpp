@@ -0,0 +1,367 @@
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "search/Filter.h"
+#include "search/PedigreeSearch.h"
+#include "search/PedigreeTool.h"
+#include "search/ReferenceAnalyzer.h"
+#include "search/ReverseSearch.h"
+
+// ReferenceAnalyzer(高速化前の実装)と探索エンジンの結果を突き合わせる差分テスト
+
+namespace {
+
+using pedsearch::search::PedigreeTool;
+using pedsearch::search::ReverseSearch;
+using pedsearch::search::SearchEngine;
+using pedsearch::search::SearchQuery;
+using pedsearch::search::SearchResult;
+using pedsearch::search::SearchSpace;
+
+// 凝った,面白,見事,危険,短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワー,SP,ST,PW
+using Columns = std::vector<int>;
+
+Columns referenceColumns(
+    const pedsearch::search::ReferenceAnalysis& analysis, const std::vector<pedsearch::base::Stallion>& stallions
+) {
+    Columns columns = {
+        analysis.isElaborated() ? 1 : 0,
+        analysis.isInteresting() ? 1 : 0,
+        analysis.isWonderful() ? 1 : 0,
+        analysis.isDanger() ? 1 : 0
+    };
+    std::vector<unsigned int> effects = analysis.getEffects(stallions);
+    columns.insert(columns.end(), effects.begin(), effects.end());
+    columns.push_back(analysis.getSpeedNitro());
+    columns.push_back(analysis.getStaminaNitro());
+    columns.push_back(analysis.getPowerNitro());
+    return columns;
+}
+
+Columns referenceColumns(const PedigreeTool& tool, const size_t* chain, unsigned int generation) {
+    // 繁殖牝馬は公開APIの名前による生成で作る
+    std::optional<pedsearch::base::DefaultBroodmare> broodmare(tool.getDefaultBroodmare(chain[generation]));
+    for (unsigned int i = generation - 1; i >= 1; i--) {
+        broodmare.emplace(tool.makeDefaultBroodmare(tool.getDefaultStallionName(chain[i]), *broodmare));
+    }
+
+    pedsearch::search::ReferenceAnalysis analysis = pedsearch::search::ReferenceAnalyzer::analyze(
+        tool.getDefaultStallion(chain[0]), *broodmare, tool.getStallions(), tool.getElaboratedPairs(),
+        tool.getIgnoreStallionIndex()
+    );
+    return referenceColumns(analysis, tool.getStallions());
+}
+
+// 出力(test/main.cpp)と同じ手順でPedigreeAnalysisを列に直す
+Columns analysisColumns(const pedsearch::search::PedigreeAnalysis& analysis, const PedigreeTool& tool) {
+    Columns columns = {
+        analysis.isElaborated() ? 1 : 0,
+        analysis.isInteresting() ? 1 : 0,
+        analysis.isWonderful() ? 1 : 0,
+        0
+    };
+    std::vector<unsigned int> effects(11, 0);
+    std::set<size_t> crosses;
+    analysis.getCross().getCrossIndices(crosses);
+    for (auto it = crosses.begin(); it != crosses.end(); ++it) {
+        if (analysis.getCross().getBloodVolume(*it) >= 50.0) {
+            columns[3] = 1;
+        }
+        std::vector<unsigned int> tmp;
+        tool.getEffects(*it, tmp);
+        for (size_t i = 0; i < 11; i++) {
+            effects[i] += tmp[i];
+        }
+    }
+    columns.insert(columns.end(), effects.begin(), effects.end());
+    columns.push_back(analysis.getNitro().getSpeedNitro());
+    columns.push_back(analysis.getNitro().getStaminaNitro());
+    columns.push_back(analysis.getNitro().getPowerNitro());
+    return columns;
+}
+
+Columns engineColumns(const SearchResult& result) {
+    Columns columns = {
+        result.isElaborated() ? 1 : 0,
+        result.isInteresting() ? 1 : 0,
+        result.isWonderful() ? 1 : 0,
+        result.isDanger() ? 1 : 0
+    };
+    for (unsigned int i = 0; i < 11; i++) {
+        columns.push_back((int)result.getEffect(i));
+    }
+    columns.push_back(result.getSpeedNitro());
+    columns.push_back(result.getStaminaNitro());
+    columns.push_back(result.getPowerNitro());
+    return columns;
+}
+
+void printColumns(std::string_view label, const Columns& columns) {
+    std::cerr << label;
+    for (size_t i = 0; i < columns.size(); i++) {
+        std::cerr << (i == 0 ? "" : ",") << columns[i];
+    }
+    std::cerr << std::endl;
+}
+
+class Harness {
+private:
+    const PedigreeTool& tool_;
+    uint64_t checked_;
+
+public:
+    Harness(const PedigreeTool& tool) : tool_(tool), checked_(0) {}
+
+    uint64_t getChecked() const {
+        return checked_;
+    }
+
+    // 一致しなければ血統を表示してfalseを返す
+    bool check(const SearchEngine& engine, uint64_t row) {
+        unsigned int generation = engine.getSpace().getGeneration();
+        size_t chain[SearchQuery::MAX_GENERATION + 1] = {};
+        engine.getSpace().decode(row, chain);
+
+        SearchResult result;
+        engine.evaluate(row, result);
+        Columns expected = referenceColumns(tool_, chain, generation);
+        Columns actual = engineColumns(result);
+        checked_++;
+        if (expected == actual) {
+            return true;
+        }
+
+        std::cerr << "mismatch at row " << row << ": ";
+        for (unsigned int i = 0; i < generation; i++) {
+            std::cerr << tool_.getDefaultStallionName(chain[i]) << " x ";
+        }
+        std::cerr << tool_.getDefaultBroodmareName(chain[generation]) << std::endl;
+        std::cerr << "columns:   凝った,面白,見事,危険,短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワー,SP,ST,PW" << std::endl;
+        printColumns("reference: ", expected);
+        printColumns("engine:    ", actual);
+        return false;
+    }
+
+    bool exhaustive(std::string_view name, const SearchSpace& space) {
+        SearchEngine engine(tool_, space);
+        for (uint64_t row = 0; row < engine.getSpace().size(); row++) {
+            if (!check(engine, row)) {
+                return false;
+            }
+        }
+        std::cout << name << ": " << engine.getSpace().size() << " pedigrees ok" << std::endl;
+        return true;
+    }
+
+    // PedigreeAnalyzer::analyzeを直接呼んだ結果とReferenceAnalyzerを比べる
+    bool masked(std::string_view name, uint64_t samples, uint64_t seed) {
+        std::mt19937_64 rng(seed);
+        std::uniform_int_distribution<size_t> stallionDist(0, tool_.getNumDefaultStallions() - 1);
+        std::uniform_int_distribution<size_t> broodmareDist(0, tool_.getNumDefaultBroodmares() - 1);
+        std::bernoulli_distribution maskDist(0.2);
+        size_t ignore = tool_.getIgnoreStallionIndex();
+
+        for (uint64_t n = 0; n < samples; n++) {
+            size_t stallionId = stallionDist(rng);
+            size_t broodmareId = broodmareDist(rng);
+            const pedsearch::base::DefaultStallion& s = tool_.getDefaultStallion(stallionId);
+            const pedsearch::base::DefaultBroodmare& b = tool_.getDefaultBroodmare(broodmareId);
+
+            size_t stallionAncestors[16];
+            size_t broodmareAncestors[16];
+            unsigned int stallionIndices[8];
+            unsigned int broodmareIndices[4];
+            std::array<unsigned int, 4> sIndex = s.getInterestingIndices();
+            std::array<unsigned int, 4> bIndex = b.getInterestingIndices();
+            // 見事な配合の判定は集合の比較なので, 偶数番目の因子の並びは元と違ってもよい
+            std::set<unsigned int> wonderful;
+            s.appendWonderfulIndices(wonderful);
+            std::vector<unsigned int> wIndex(wonderful.begin(), wonderful.end());
+            wIndex.resize(4, wIndex.back());
+            for (unsigned int i = 0; i < 16; i++) {
+                stallionAncestors[i] = (i != 0 && maskDist(rng)) ? ignore : s.getAncestorIndex(i);
+                broodmareAncestors[i] = (i == 0 || maskDist(rng)) ? ignore : b.getAncestorIndex(i);
+            }
+            for (unsigned int i = 0; i < 4; i++) {
+                stallionIndices[2 * i] = sIndex[i];
+                stallionIndices[2 * i + 1] = wIndex[i];
+                broodmareIndices[i] = bIndex[i];
+            }
+            pedsearch::base::DefaultStallion stallion(stallionAncestors, stallionIndices);
+            pedsearch::base::DefaultBroodmare broodmare(broodmareAncestors, broodmareIndices);
+
+            pedsearch::search::ReferenceAnalysis reference = pedsearch::search::ReferenceAnalyzer::analyze(
+                stallion, broodmare, tool_.getStallions(), tool_.getElaboratedPairs(), ignore
+            );
+            pedsearch::search::PedigreeAnalysis analysis = tool_.analyze(stallion, broodmare);
+            checked_++;
+
+            Columns expected = referenceColumns(reference, tool_.getStallions());
+            Columns actual = analysisColumns(analysis, tool_);
+            if (expected != actual) {
+                std::cerr << "mismatch: " << tool_.getDefaultStallionName(stallionId) << " x "
+                    << tool_.getDefaultBroodmareName(broodmareId) << " with masked ancestors" << std::endl;
+                std::cerr << "stallion:";
+                for (unsigned int i = 0; i < 16; i++) {
+                    std::cerr << " " << stallionAncestors[i];
+                }
+                std::cerr << std::endl << "broodmare:";
+                for (unsigned int i = 0; i < 16; i++) {
+                    std::cerr << " " << broodmareAncestors[i];
+                }
+                std::cerr << std::endl;
+                printColumns("reference: ", expected);
+                printColumns("analyzer:  ", actual);
+                return false;
+            }
+        }
+        std::cout << name << ": " << samples << " sampled pedigrees ok" << std::endl;
+        return true;
+    }
+
+    bool randomized(
+        std::string_view name, const SearchSpace& space, uint64_t samples, uint64_t seed,
+        std::optional<pedsearch::search::Filter> filter=std::nullopt
+    ) {
+        SearchEngine engine(tool_, space, std::move(filter));
+        std::mt19937_64 rng(seed);
+        std::uniform_int_distribution<uint64_t> rowDist(0, engine.getSpace().size() - 1);
+        for (uint64_t i = 0; i < samples; i++) {
+            if (!check(engine, rowDist(rng))) {
+                return false;
+            }
+        }
+        std::cout << name << ": " << samples << " sampled pedigrees ok" << std::endl;
+        return true;
+    }
+
+    // 逆引きの結果を, 全行を前から評価してクロスを調べた結果と比べる. 逆引きの絞り込みで行を落としていないかを確かめる.
+    bool reverse(
+        std::string_view name, const SearchSpace& space, std::string_view crosses,
+        std::optional<pedsearch::search::Filter> filter=std::nullopt
+    ) {
+        std::vector<pedsearch::search::CrossPattern> patterns = ReverseSearch::parse(tool_, crosses);
+        std::vector<SearchResult> actual = ReverseSearch(tool_, space, patterns, filter).run();
+
+        SearchEngine engine(tool_, space, std::move(filter));
+        unsigned int generation = engine.getSpace().getGeneration();
+        size_t chain[SearchQuery::MAX_GENERATION + 1] = {};
+        SearchResult result;
+        size_t found = 0;
+        for (uint64_t row = 0; row < engine.getSpace().size(); row++) {
+            if (!engine.evaluate(row, result)) {
+                continue;
+            }
+            engine.getSpace().decode(row, chain);
+            std::optional<pedsearch::base::DefaultBroodmare> broodmare(tool_.getDefaultBroodmare(chain[generation]));
+            for (unsigned int i = generation - 1; i >= 1; i--) {
+                broodmare.emplace(tool_.makeDefaultBroodmare(tool_.getDefaultStallionName(chain[i]), *broodmare));
+            }
+            const pedsearch::base::DefaultStallion& stallion = tool_.getDefaultStallion(chain[0]);
+            pedsearch::search::PedigreeAnalysis analysis = tool_.analyze(
+                stallion, *broodmare, false, false, false, true, false
+            );
+            if (!ReverseSearch::matches(stallion, *broodmare, analysis.getCross(), patterns)) {
+                continue;
+            }
+            if (found >= actual.size() || actual[found].getRow() != row
+                || engineColumns(actual[found]) != engineColumns(result)) {
+                std::cerr << name << ": reverse search differs from the full scan at row " << row << ": ";
+                for (unsigned int i = 0; i < generation; i++) {
+                    std::cerr << tool_.getDefaultStallionName(chain[i]) << " x ";
+                }
+                std::cerr << tool_.getDefaultBroodmareName(chain[generation]) << std::endl;
+                return false;
+            }
+            found++;
+        }
+        if (found != actual.size()) {
+            std::cerr << name << ": reverse search found " << actual.size() << " rows, the full scan " << found
+                << std::endl;
+            return false;
+        }
+        std::cout << name << ": " << found << " of " << engine.getSpace().size() << " pedigrees ok" << std::endl;
+        return true;
+    }
+};
+
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t samples = 20000;
+    uint64_t seed = 20230109;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            samples = std::stoull(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else {
+            std::cerr << "Usage: peddiff [--samples N] [--seed N]" << std::endl;
+            return 2;
+        }
+    }
+
+    try {
+        PedigreeTool tool(
+            argv[0],
+            "database/default_stallions.json",
+            "database/default_broodmares.json",
+            "database/stallions.json",
+            "database/elaborated.json"
+        );
+        Harness harness(tool);
+
+        if (!harness.exhaustive("gen1_exhaustive", tool.resolve(SearchQuery({"all", "all"})))) {
+            return 1;
+        }
+
+        SearchQuery query({"all", "all"});
+        for (unsigned int generation = 2; generation <= SearchQuery::MAX_GENERATION; generation++) {
+            query.addStallion("all");
+            if (!harness.randomized(
+                "gen" + std::to_string(generation) + "_random", tool.resolve(query), samples, seed + generation
+            )) {
+                return 1;
+            }
+        }
+
+        // 常に真になる条件で, 段階ごとに分けた分析(ニトロだけ先に求める場合を含む)を確かめる
+        query = SearchQuery({"all", "all", "all", "all"});
+        if (!harness.randomized(
+            "gen3_filtered_nitro", tool.resolve(query), samples, seed, pedsearch::search::Filter("sp >= -128 || danger")
+        ) || !harness.randomized(
+            "gen3_filtered_flags", tool.resolve(query), samples, seed, pedsearch::search::Filter("elaborated || !elaborated")
+        )) {
+            return 1;
+        }
+
+        // データベースの馬には祖先の空欄がほとんど無いので, 祖先の一部をignoreStallionIndex_に置き換えて確かめる
+        if (!harness.masked("masked_ancestors", samples, seed)) {
+            return 1;
+        }
+
+        // 逆引きは参照実装と比べず, 同じ条件で全行を調べた結果と比べる
+        query = SearchQuery({"all", "all"});
+        if (!harness.reverse("gen1_reverse", tool.resolve(query), "ｻﾝﾃﾞｰｻｲﾚﾝｽ:*x*")
+            || !harness.reverse(
+                "gen1_reverse_filtered", tool.resolve(query), "ｻﾝﾃﾞｰｻｲﾚﾝｽ:*x*", pedsearch::search::Filter("sp >= 6")
+            )) {
+            return 1;
+        }
+        query = SearchQuery({"all", "ﾃﾞｨｰﾌﾟｲﾝﾊﾟｸﾄ", "all"});
+        if (!harness.reverse("gen2_reverse", tool.resolve(query), "ﾉｰｻﾞﾝﾃｰｽﾄ:4x4")
+            || !harness.reverse("gen2_reverse_pair", tool.resolve(query), "ﾉｰｻﾞﾝﾃｰｽﾄ:*x*,ｻﾝﾃﾞｰｻｲﾚﾝｽ:*x3")) {
+            return 1;
+        }
+
+        std::cout << "all " << harness.getChecked() << " pedigrees match the reference" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+}
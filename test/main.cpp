@@ -1,234 +1,1202 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
-#include <initializer_list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "io/Checkpoint.h"
+#include "io/ColumnarFormat.h"
+#include "io/CsvWriter.h"
+#include "io/DatabaseWatcher.h"
+#include "io/QueryServer.h"
+#include "io/ResultReuse.h"
+#include "io/ResultWriter.h"
+#include "search/Aggregation.h"
+#include "search/BreedingPlan.h"
+#include "search/Filter.h"
+#include "search/Pareto.h"
+#include "search/PedigreeSearch.h"
 #include "search/PedigreeTool.h"
+#include "search/Progress.h"
+#include "search/ResultCache.h"
+#include "search/ResultField.h"
+#include "search/ReverseSearch.h"
+#include "search/Sampling.h"
+#include "search/Shard.h"
+#include "search/Snapshot.h"
+#include "search/TopResults.h"
 
-// 父,母,凝った,面白,見事,危険,短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワー
-void printPedigreeAnalysis(
-    const pedsearch::search::PedigreeAnalysis& result,
-    const std::initializer_list<std::string_view>& parents,
-    const pedsearch::search::PedigreeTool& tool
-) {
-    for (std::string_view name: parents) {
-        std::cout << name << ",";
+struct Options {
+    std::string format = "csv";
+    std::string output;
+    std::string groupBy;
+    std::string aggregates;
+    std::string threads = "0";
+    std::string filter;
+    std::string checkpoint;
+    std::string checkpointInterval = "60";
+    bool resume = false;
+    bool progress = false;
+    std::string statusFile;
+    std::string shard;
+    std::string top;
+    std::string sort;
+    std::string sample;
+    std::string seed = "0";
+    bool stratify = false;
+    bool pareto = false;
+    std::string roster;
+    std::string reuse;
+};
+
+void printUsage() {
+    std::cout << "Usage:" << std::endl;
+    std::cout << "pedtool [options] [stallion_name] [broodmare_name]" << std::endl;
+    std::cout << "pedtool [options] [stallion_name] [stallion_name] [broodmare_name]" << std::endl;
+    std::cout << "pedtool [options] [stallion_name] [stallion_name] [stallion_name] [broodmare_name]" << std::endl;
+    std::cout << "you can set \"all\" to stallion_name and broodmare_name." << std::endl;
+    std::cout << "with --sample, up to 5 stallion_names can be given." << std::endl;
+    std::cout << std::endl;
+    std::cout << "options:" << std::endl;
+    std::cout << "  --format=csv|binary  output format (default: csv)" << std::endl;
+    std::cout << "  --output=FILE        write results to FILE instead of stdout" << std::endl;
+    std::cout << "  --filter=EXPR        output only results satisfying EXPR (e.g. \"elaborated && !danger && sp >= 3\")" << std::endl;
+    std::cout << "  --group-by=POSITIONS aggregate rows grouped by comma separated positions (父,母父,...)" << std::endl;
+    std::cout << "  --agg=AGGREGATES     comma separated count, count(FIELD>=N), min(FIELD), max(FIELD), sum(FIELD)" << std::endl;
+    std::cout << "  --threads=N          number of threads for aggregation (default: all cores)" << std::endl;
+    std::cout << "  --checkpoint=FILE    save progress of the search to FILE (default with --resume: OUTPUT.checkpoint)" << std::endl;
+    std::cout << "  --checkpoint-interval=SECONDS" << std::endl;
+    std::cout << "                       interval between checkpoints (default: 60)" << std::endl;
+    std::cout << "  --resume             continue the search stopped at the checkpoint" << std::endl;
+    std::cout << "  --progress           print progress, pairs/s and ETA to stderr every second" << std::endl;
+    std::cout << "  --status-file=FILE   write progress to FILE as JSON every second" << std::endl;
+    std::cout << "  --shard=I/N          search only the I-th of N parts of the search space (1 <= I <= N)" << std::endl;
+    std::cout << "  --top=K --sort=FIELD output only K results with the largest FIELD" << std::endl;
+    std::cout << "  --pareto             output only results not dominated in SP, ST, PW, 凝った, 面白 and 見事" << std::endl;
+    std::cout << "  --sample=N           estimate ratios of flags (and --filter) from N random pedigrees" << std::endl;
+    std::cout << "  --seed=S             seed of --sample (default: 0)" << std::endl;
+    std::cout << "  --stratify           sample the same number of pedigrees for each broodmare" << std::endl;
+    std::cout << "  --roster=FILE        add your own stallions and broodmares in FILE (see README)" << std::endl;
+    std::cout << "  --reuse=FILE         copy rows not affected by database changes from a previous binary output" << std::endl;
+    std::cout << std::endl;
+    std::cout << "pedtool scan FILE [--with=FLAGS] [--without=FLAGS] [--filter=EXPR] [--count]" << std::endl;
+    std::cout << "  read a binary result file. FLAGS is a comma separated list of" << std::endl;
+    std::cout << "  elaborated, interesting, wonderful and danger." << std::endl;
+    std::cout << std::endl;
+    std::cout << "pedtool merge [--output=FILE] [--top=K --sort=FIELD | --pareto] FILE..." << std::endl;
+    std::cout << "  combine outputs of --shard=1/N .. N/N given in the order of the shards." << std::endl;
+    std::cout << std::endl;
+    std::cout << "pedtool plan [--seasons=K] [--objective=EXPR] [--output=FILE] [--roster=FILE] stallion_name broodmare_name" << std::endl;
+    std::cout << "  choose stallions for K seasons (default: 3), breeding each daughter in the next season," << std::endl;
+    std::cout << "  to maximize the sum of EXPR (default: \"sp+st+pw\", e.g. \"sp+st+pw+2*elaborated-danger\")." << std::endl;
+    std::cout << std::endl;
+    std::cout << "pedtool reverse --cross=PATTERNS [--filter=EXPR] [--output=FILE] [--roster=FILE] stallion_name... broodmare_name" << std::endl;
+    std::cout << "  find sires (the first stallion_name, e.g. \"all\") making the crosses in PATTERNS, a comma separated" << std::endl;
+    std::cout << "  list of NAME:SIRExDAM (e.g. \"ﾉｰｻﾞﾝﾃｰｽﾄ:4x3\", * for any generation), without analyzing the other sires." << std::endl;
+    std::cout << std::endl;
+    std::cout << "pedtool serve [--socket=PATH] [--roster=FILE] [--cache-entries=N]" << std::endl;
+    std::cout << "  answer one query per line from stdin (or each connection to PATH), reloading the database" << std::endl;
+    std::cout << "  when its files change. a query is names with --filter, --top and --sort, \"version\" or \"stats\"." << std::endl;
+    std::cout << "  results of up to N pedigrees (default: 1048576, 0 disables) are cached until the database changes." << std::endl;
+}
+
+// "--name=value"の形の引数ならvalueを取り出す
+bool getOption(std::string_view arg, std::string_view name, std::string& value) {
+    if (arg.size() > name.size() && arg.substr(0, name.size()) == name && arg[name.size()] == '=') {
+        value = arg.substr(name.size() + 1);
+        return true;
     }
+    return false;
+}
 
-    if (result.isElaborated()) {
-        std::cout << "1,";
-    } else {
-        std::cout << "0,";
+// データベースを読み, rosterが空でなければロスターの馬を加える
+pedsearch::search::PedigreeTool loadTool(std::string_view path, const std::string& roster) {
+    pedsearch::search::PedigreeTool tool(
+        path,
+        "database/default_stallions.json",
+        "database/default_broodmares.json",
+        "database/stallions.json",
+        "database/elaborated.json"
+    );
+    if (!roster.empty()) {
+        tool.loadRoster(roster);
     }
+    return tool;
+}
 
-    if (result.isInteresting()) {
-        std::cout << "1,";
-    } else {
-        std::cout << "0,";
+size_t parseTop(const std::string& top) {
+    try {
+        size_t n = 0;
+        unsigned long k = std::stoul(top, &n);
+        if (n == top.size()) {
+            return k;
+        }
+    } catch (std::logic_error&) {
     }
+    throw std::runtime_error("pedtool: invalid number of results \"" + top + "\".");
+}
 
-    if (result.isWonderful()) {
-        std::cout << "1,";
-    } else {
-        std::cout << "0,";
+std::chrono::seconds parseCheckpointInterval(const std::string& interval) {
+    try {
+        size_t n = 0;
+        unsigned long seconds = std::stoul(interval, &n);
+        if (n == interval.size() && interval[0] != '-') {
+            return std::chrono::seconds(seconds);
+        }
+    } catch (std::logic_error&) {
     }
+    throw std::runtime_error("pedtool: invalid checkpoint interval \"" + interval + "\".");
+}
 
-    std::set<size_t> crosses;
-    result.getCross().getCrossIndices(crosses);
-    if (crosses.size() == 0) {
-        std::cout << "0,0,0,0,0,0,0,0,0,0,0,0,";
-    } else {
-        bool isDanger = false;
-        std::vector<unsigned int> effects(11, 0);
-        for (auto it = crosses.begin(); it != crosses.end(); ++it) {
-            if (result.getCross().getBloodVolume(*it) >= 50.0) {
-                isDanger = true;
+pedsearch::search::ResultField parseSortField(const std::string& name) {
+    pedsearch::search::ResultField field;
+    if (name.empty()) {
+        throw std::runtime_error("pedtool: --top requires --sort.");
+    }
+    if (!pedsearch::search::parseResultField(name, field)) {
+        throw std::runtime_error("pedtool: unknown field \"" + name + "\".");
+    }
+    return field;
+}
+
+void search(
+    std::string_view path, const std::vector<std::string>& names,
+    const pedsearch::search::SearchQuery& query, const Options& options
+) {
+    try {
+        pedsearch::search::PedigreeTool tool = loadTool(path, options.roster);
+
+        pedsearch::search::SearchRange results = tool.search(query);
+        if (options.format != "csv" && options.format != "binary") {
+            throw std::runtime_error("pedtool: unknown format \"" + options.format + "\".");
+        }
+        uint64_t begin = 0;
+        if (!options.shard.empty()) {
+            std::pair<uint64_t, uint64_t> range =
+                pedsearch::search::Shard::parse(options.shard).getRange(results.getSpace());
+            begin = range.first;
+            results.setRange(range.first, range.second);
+        }
+        // 以前の出力をmmapしたまま同じファイルに書くと壊れる
+        std::optional<pedsearch::io::ResultReuse> reuse;
+        if (!options.reuse.empty()) {
+            std::error_code error;
+            if (!options.output.empty() && std::filesystem::equivalent(options.reuse, options.output, error)) {
+                throw std::runtime_error("pedtool: --reuse and --output must be different files.");
             }
+            reuse.emplace(options.reuse, tool, results.getSpace());
+            results.setStoredResults(&*reuse);
+        }
+        std::optional<pedsearch::search::TopResults> top;
+        if (!options.top.empty()) {
+            top.emplace(parseTop(options.top), parseSortField(options.sort));
+        }
 
-            std::vector<unsigned int> tmp;
-            tool.getEffects(*it, tmp);
+        // 途中経過は出力ファイルのバイト数とchecksumで表すので, ファイルに出力する場合だけ使える
+        std::string checkpointPath = options.checkpoint;
+        if (options.resume && checkpointPath.empty()) {
+            checkpointPath = options.output + ".checkpoint";
+        }
+        if (!checkpointPath.empty() && options.output.empty()) {
+            throw std::runtime_error("pedtool: --checkpoint and --resume require --output.");
+        }
+        if (!checkpointPath.empty() && top) {
+            throw std::runtime_error("pedtool: --checkpoint cannot be used with --top.");
+        }
+        // 出力を開く前に確かめる. 開いた後に失敗すると, --resumeで続けるための出力を消してしまう.
+        const std::chrono::seconds interval = parseCheckpointInterval(options.checkpointInterval);
+        pedsearch::io::Checkpoint checkpoint;
+        checkpoint.names = names;
+        checkpoint.filter = options.filter;
+        checkpoint.format = options.format;
+        checkpoint.shard = options.shard;
+        checkpoint.totalRows = results.size();
 
-            for (size_t i = 0; i < 11; i++) {
-                effects[i] += tmp[i];
+        std::ofstream file;
+        std::ostream* ostream = &std::cout;
+        if (options.resume) {
+            pedsearch::io::Checkpoint saved = pedsearch::io::Checkpoint::load(checkpointPath);
+            if (!saved.isSameSearch(checkpoint)) {
+                throw std::runtime_error("pedtool: " + checkpointPath + " is a checkpoint of another search.");
+            }
+            if (saved.finished) {
+                std::cerr << "pedtool: the search has already finished." << std::endl;
+                return;
             }
+            if (!saved.verify(options.output)) {
+                throw std::runtime_error("pedtool: " + options.output + " does not match " + checkpointPath + ".");
+            }
+            // 途中経過の後に書かれた分は捨てて, 終わった行の次から追記する
+            std::filesystem::resize_file(options.output, saved.outputBytes);
+            file.open(options.output, std::ios::binary | std::ios::app);
+            results.seek(saved.completedRows);
+            checkpoint = saved;
+        } else if (!options.output.empty()) {
+            file.open(options.output, std::ios::binary | std::ios::trunc);
+        }
+        if (!options.output.empty()) {
+            if (!file) {
+                throw std::runtime_error("pedtool: cannot open " + options.output + ".");
+            }
+            ostream = &file;
+        }
+
+        pedsearch::io::ChecksumBuffer buffer(ostream->rdbuf(), checkpoint.outputBytes, checkpoint.checksum);
+        std::ostream checked(&buffer);
+        if (!checkpointPath.empty()) {
+            ostream = &checked;
         }
 
-        if (isDanger) {
-            std::cout << "1,";
+        std::unique_ptr<pedsearch::io::ResultWriter> writer;
+        if (options.format == "csv") {
+            writer.reset(new pedsearch::io::CsvWriter(*ostream, tool, results.getSpace(), !options.resume));
         } else {
-            std::cout << "0,";
+            writer.reset(new pedsearch::io::ColumnarWriter(*ostream, tool, results.getSpace(), !options.resume));
+        }
+
+        // 次の結果を書く前なら, その行より前の行はすべて書き終えている
+        auto save = [&](uint64_t completedRows) {
+            writer->flush();
+            if (!*ostream) {
+                throw std::runtime_error("pedtool: cannot write " + options.output + ".");
+            }
+            checkpoint.completedRows = completedRows;
+            checkpoint.outputBytes = buffer.getBytes();
+            checkpoint.checksum = buffer.getChecksum();
+            checkpoint.save(checkpointPath);
+        };
+
+        if (!checkpointPath.empty() && !options.resume) {
+            save(0);
+        }
+
+        std::optional<pedsearch::search::Progress> progress;
+        std::optional<pedsearch::search::ProgressReporter> reporter;
+        if (options.progress || !options.statusFile.empty()) {
+            progress.emplace(results.getEnd() - begin);
+            progress->add(0, results.getCompletedRows() - begin);
+            results.setProgress(&*progress);
+            reporter.emplace(*progress, options.progress, options.statusFile);
+        }
+
+        std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+        while (true) {
+            const std::vector<pedsearch::search::SearchResult>& batch = results.nextBatch();
+            if (batch.empty()) {
+                break;
+            }
+            if (top) {
+                top->add(batch);
+                continue;
+            }
+            if (!checkpointPath.empty() && std::chrono::steady_clock::now() - last >= interval) {
+                save(batch.front().getRow());
+                last = std::chrono::steady_clock::now();
+            }
+            writer->writeBatch(batch);
+        }
+        if (top) {
+            writer->writeBatch(top->take());
+        }
+        writer->finish();
+        if (!checkpointPath.empty()) {
+            checkpoint.finished = true;
+            save(results.getEnd());
         }
-        for (size_t i = 0; i < 11; i++) {
-            std::cout << effects[i] << ",";
+        if (reuse) {
+            std::cerr << "pedtool: reused " << reuse->getNumReused() << " rows and recomputed "
+                << reuse->getNumRecomputed() << " rows." << std::endl;
         }
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
     }
+}
 
-    std::cout << result.getNitro().getSpeedNitro() << ",";
-    std::cout << result.getNitro().getStaminaNitro() << ",";
-    std::cout << result.getNitro().getPowerNitro() << std::endl;;
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        items.push_back(list.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return items;
 }
 
-void oneGeneration(std::string_view path, std::string stallion, std::string broodmare) {
+// SP, ST, PW, 凝った, 面白, 見事のどれかで他のすべての配合に劣らない配合だけを出力する
+void pareto(std::string_view path, const pedsearch::search::SearchQuery& query, const Options& options) {
     try {
-        pedsearch::search::PedigreeTool tool(
-            path,
-            "database/default_stallions.json",
-            "database/default_broodmares.json",
-            "database/stallions.json",
-            "database/elaborated.json"
-        );
+        pedsearch::search::PedigreeTool tool = loadTool(path, options.roster);
 
-        std::set<std::string_view> stallions;
-        std::set<std::string_view> broodmares;
-        if (stallion == "all") {
-            tool.getDefaultStallionsSet(stallions);
-        } else {
-            stallions.insert(stallion);
+        if (!options.checkpoint.empty() || options.resume || !options.top.empty()) {
+            throw std::runtime_error("pedtool: --pareto cannot be used with --checkpoint, --resume or --top.");
+        }
+        pedsearch::search::ParetoSearch search(tool, tool.resolve(query), query.getFilter());
+        if (!options.shard.empty()) {
+            std::pair<uint64_t, uint64_t> range =
+                pedsearch::search::Shard::parse(options.shard).getRange(search.getSpace());
+            search.setRange(range.first, range.second);
+        }
+        unsigned int threads = (unsigned int)std::stoul(options.threads);
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        std::optional<pedsearch::search::Progress> progress;
+        std::vector<pedsearch::search::SearchResult> results;
+        {
+            std::optional<pedsearch::search::ProgressReporter> reporter;
+            if (options.progress || !options.statusFile.empty()) {
+                progress.emplace(search.getEnd() - search.getBegin(), threads);
+                reporter.emplace(*progress, options.progress, options.statusFile);
+            }
+            results = search.run(threads, progress ? &*progress : nullptr);
         }
 
-        if (broodmare == "all") {
-            tool.getDefaultBroodmaresSet(broodmares);
+        std::ofstream file;
+        std::ostream* ostream = &std::cout;
+        if (!options.output.empty()) {
+            file.open(options.output, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                throw std::runtime_error("pedtool: cannot open " + options.output + ".");
+            }
+            ostream = &file;
+        }
+        std::unique_ptr<pedsearch::io::ResultWriter> writer;
+        if (options.format == "csv") {
+            writer.reset(new pedsearch::io::CsvWriter(*ostream, tool, search.getSpace()));
+        } else if (options.format == "binary") {
+            writer.reset(new pedsearch::io::ColumnarWriter(*ostream, tool, search.getSpace()));
         } else {
-            broodmares.insert(broodmare);
+            throw std::runtime_error("pedtool: unknown format \"" + options.format + "\".");
+        }
+        writer->writeBatch(results);
+        writer->finish();
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+    } catch (std::invalid_argument&) {
+        std::cerr << "pedtool: invalid number of threads \"" << options.threads << "\"." << std::endl;
+    }
+}
+
+// 行を出力せずにグループごとの集計値だけをcsvで出力する
+void aggregate(std::string_view path, const pedsearch::search::SearchQuery& query, const Options& options) {
+    try {
+        pedsearch::search::PedigreeTool tool = loadTool(path, options.roster);
+
+        unsigned int generation = query.getGeneration();
+        pedsearch::search::AggregateQuery aggregateQuery;
+        if (!options.groupBy.empty()) {
+            for (const std::string& name: split(options.groupBy)) {
+                unsigned int position = 0;
+                while (position <= generation && pedsearch::io::getPositionName(generation, position) != name) {
+                    position++;
+                }
+                if (position > generation) {
+                    throw std::runtime_error("pedtool: unknown position \"" + name + "\".");
+                }
+                aggregateQuery.addGroupKey(position);
+            }
+        }
+        for (const std::string& expression: split(options.aggregates.empty() ? "count" : options.aggregates)) {
+            aggregateQuery.addAggregate(expression);
         }
 
-        std::cout << "父,母,凝った,面白,見事,危険,短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワー,SP,ST,PW" << std::endl;
-        for (auto itS = stallions.begin(); itS != stallions.end(); ++itS) {
-            for (auto itB = broodmares.begin(); itB != broodmares.end(); ++itB) {
-                pedsearch::search::PedigreeAnalysis result = tool.analyze(
-                    *itS, *itB, true, true, true, true, true
-                );
-                printPedigreeAnalysis(result, {*itS, *itB}, tool);
+        unsigned int threads = (unsigned int)std::stoul(options.threads);
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        pedsearch::search::Aggregator aggregator(tool, tool.resolve(query), aggregateQuery, query.getFilter());
+        if (!options.shard.empty()) {
+            std::pair<uint64_t, uint64_t> range =
+                pedsearch::search::Shard::parse(options.shard).getRange(aggregator.getSpace());
+            aggregator.setRange(range.first, range.second);
+        }
+        std::optional<pedsearch::search::Progress> progress;
+        std::vector<pedsearch::search::AggregateRow> rows;
+        {
+            std::optional<pedsearch::search::ProgressReporter> reporter;
+            if (options.progress || !options.statusFile.empty()) {
+                progress.emplace(aggregator.getEnd() - aggregator.getBegin(), threads);
+                reporter.emplace(*progress, options.progress, options.statusFile);
             }
+            rows = aggregator.run(threads, progress ? &*progress : nullptr);
         }
-    } catch (std::runtime_error e) {
+
+        std::ofstream file;
+        std::ostream* ostream = &std::cout;
+        if (!options.output.empty()) {
+            file.open(options.output, std::ios::trunc);
+            if (!file) {
+                throw std::runtime_error("pedtool: cannot open " + options.output + ".");
+            }
+            ostream = &file;
+        }
+
+        const std::vector<unsigned int>& positions = aggregateQuery.getGroupKeys();
+        const std::vector<pedsearch::search::Aggregate>& aggregates = aggregateQuery.getAggregates();
+        for (unsigned int position: positions) {
+            *ostream << pedsearch::io::getPositionName(generation, position) << ",";
+        }
+        for (size_t i = 0; i < aggregates.size(); i++) {
+            *ostream << aggregates[i].getExpression() << (i + 1 < aggregates.size() ? "," : "\n");
+        }
+        for (const pedsearch::search::AggregateRow& row: rows) {
+            for (size_t i = 0; i < positions.size(); i++) {
+                *ostream << (positions[i] < generation ?
+                    tool.getDefaultStallionName(row.keys[i]) : tool.getDefaultBroodmareName(row.keys[i])) << ",";
+            }
+            for (size_t i = 0; i < row.values.size(); i++) {
+                *ostream << row.values[i] << (i + 1 < row.values.size() ? "," : "\n");
+            }
+        }
+        ostream->flush();
+    } catch (const std::runtime_error& e) {
         std::cerr << e.what() << std::endl;
+    } catch (std::invalid_argument&) {
+        std::cerr << "pedtool: invalid number of threads \"" << options.threads << "\"." << std::endl;
     }
 }
 
-void twoGeneration(
-    std::string_view path, std::string secondStallion, std::string firstStallion, std::string broodmare
-) {
+// 無作為に選んだ配合だけを評価し, フラグ(と条件)の割合と95%信頼区間, 全体での推定件数をcsvで出力する
+void sample(std::string_view path, const pedsearch::search::SearchQuery& query, const Options& options) {
     try {
-        pedsearch::search::PedigreeTool tool(
-            path,
-            "database/default_stallions.json",
-            "database/default_broodmares.json",
-            "database/stallions.json",
-            "database/elaborated.json"
+        pedsearch::search::PedigreeTool tool = loadTool(path, options.roster);
+
+        uint64_t samples = 0;
+        uint64_t seed = 0;
+        try {
+            samples = std::stoull(options.sample);
+            seed = std::stoull(options.seed);
+        } catch (std::logic_error&) {
+            throw std::runtime_error("pedtool: invalid --sample or --seed.");
+        }
+        unsigned int threads = (unsigned int)std::stoul(options.threads);
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        pedsearch::search::Sampler sampler(
+            tool, tool.resolve(query), samples, seed, options.stratify, query.getFilter()
         );
+        std::optional<pedsearch::search::Progress> progress;
+        std::vector<pedsearch::search::SampleEstimate> estimates;
+        {
+            std::optional<pedsearch::search::ProgressReporter> reporter;
+            if (options.progress || !options.statusFile.empty()) {
+                progress.emplace(samples, threads);
+                reporter.emplace(*progress, options.progress, options.statusFile);
+            }
+            estimates = sampler.run(threads, progress ? &*progress : nullptr);
+        }
 
-        std::set<std::string_view> firstStallions;
-        std::set<std::string_view> secondStallions;
-        std::set<std::string_view> broodmares;
-        if (firstStallion == "all") {
-            tool.getDefaultStallionsSet(firstStallions);
-        } else {
-            firstStallions.insert(firstStallion);
+        std::ofstream file;
+        std::ostream* ostream = &std::cout;
+        if (!options.output.empty()) {
+            file.open(options.output, std::ios::trunc);
+            if (!file) {
+                throw std::runtime_error("pedtool: cannot open " + options.output + ".");
+            }
+            ostream = &file;
+        }
+        double size = (double)sampler.getSpace().size();
+        *ostream << "列,該当,標本,割合,下限,上限,推定件数\n";
+        for (const pedsearch::search::SampleEstimate& estimate: estimates) {
+            *ostream << estimate.name << "," << estimate.hits << "," << estimate.samples << ","
+                << estimate.ratio << "," << estimate.lower << "," << estimate.upper << ","
+                << (uint64_t)std::llround(estimate.ratio * size) << "\n";
         }
+        ostream->flush();
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+    } catch (std::invalid_argument&) {
+        std::cerr << "pedtool: invalid number of threads \"" << options.threads << "\"." << std::endl;
+    }
+}
 
-        if (secondStallion == "all") {
-            tool.getDefaultStallionsSet(secondStallions);
+unsigned int parseFlags(const std::string& list) {
+    unsigned int flags = 0;
+    for (const std::string& name: split(list)) {
+        if (name == "elaborated") {
+            flags |= 1 << pedsearch::io::ColumnarFormat::ELABORATED;
+        } else if (name == "interesting") {
+            flags |= 1 << pedsearch::io::ColumnarFormat::INTERESTING;
+        } else if (name == "wonderful") {
+            flags |= 1 << pedsearch::io::ColumnarFormat::WONDERFUL;
+        } else if (name == "danger") {
+            flags |= 1 << pedsearch::io::ColumnarFormat::DANGER;
         } else {
-            secondStallions.insert(secondStallion);
+            throw std::runtime_error("pedtool scan: unknown flag \"" + name + "\".");
         }
+    }
+    return flags;
+}
+
+// バイナリ形式の結果を読み, フラグで絞り込んでCSVで出力するか件数を数える
+int scan(int argc, char* argv[]) {
+    try {
+        std::string path;
+        std::string value;
+        unsigned int with = 0;
+        unsigned int without = 0;
+        bool count = false;
+        std::optional<pedsearch::search::Filter> filter;
+        for (int i = 2; i < argc; i++) {
+            std::string_view arg = argv[i];
+            if (getOption(arg, "--with", value)) {
+                with |= parseFlags(value);
+            } else if (getOption(arg, "--without", value)) {
+                without |= parseFlags(value);
+            } else if (getOption(arg, "--filter", value)) {
+                filter.emplace(value);
+            } else if (arg == "--count") {
+                count = true;
+            } else if (path.empty() && arg.substr(0, 2) != "--") {
+                path = arg;
+            } else {
+                throw std::runtime_error("pedtool scan: invalid argument \"" + std::string(arg) + "\".");
+            }
+        }
+        if (path.empty()) {
+            throw std::runtime_error("pedtool scan: no file is specified.");
+        }
+
+        pedsearch::io::ColumnarReader reader(path);
+        unsigned int generation = reader.getGeneration();
+        if (!count) {
+            pedsearch::io::writeCsvHeader(std::cout, generation);
+        }
+
+        // 統計から条件を満たす行が無いと分かる行グループは読まない
+        auto skip = [&](const pedsearch::io::RowGroup& group) {
+            for (unsigned int f = 0; f < pedsearch::io::ColumnarFormat::NUM_FLAGS; f++) {
+                if (((with >> f) & 1) && group.getMax(f) == 0) {
+                    return true;
+                }
+                if (((without >> f) & 1) && group.getMin(f) == 1) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        uint64_t matched = 0;
+        pedsearch::io::RowGroup group;
+        while (reader.next(group, skip)) {
+            size_t words = group.getNumWords();
+            for (size_t w = 0; w < words; w++) {
+                uint64_t mask = ~(uint64_t)0;
+                if (w == words - 1 && group.getNumRows() % 64 != 0) {
+                    mask = ((uint64_t)1 << (group.getNumRows() % 64)) - 1;
+                }
+                for (unsigned int f = 0; f < pedsearch::io::ColumnarFormat::NUM_FLAGS; f++) {
+                    if ((with >> f) & 1) {
+                        mask &= group.getFlags(f)[w];
+                    }
+                    if ((without >> f) & 1) {
+                        mask &= ~group.getFlags(f)[w];
+                    }
+                }
+
+                if (count && !filter) {
+                    matched += __builtin_popcountll(mask);
+                    continue;
+                }
+                while (mask != 0) {
+                    size_t row = w * 64 + __builtin_ctzll(mask);
+                    mask &= mask - 1;
+                    pedsearch::io::ColumnarRow r(group, row);
+                    if (filter && !filter->matches(r)) {
+                        continue;
+                    }
+                    if (count) {
+                        matched++;
+                        continue;
+                    }
+                    for (unsigned int i = 0; i <= generation; i++) {
+                        std::cout << reader.getDictionary(i)[r.getChain(i)] << ",";
+                    }
+                    pedsearch::io::writeCsvColumns(std::cout, r);
+                }
+            }
+        }
+        if (count) {
+            std::cout << matched << std::endl;
+        }
+        std::cout.flush();
+        return 0;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// 断片の出力をcsvの行として読む. 1行目は見出し.
+std::vector<std::string> readLines(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("pedtool merge: cannot open " + path + ".");
+    }
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+    if (lines.empty()) {
+        throw std::runtime_error("pedtool merge: " + path + " has no header.");
+    }
+    return lines;
+}
 
-        if (broodmare == "all") {
-            tool.getDefaultBroodmaresSet(broodmares);
+// 断片の出力の見出し(1行目)だけを読む
+std::string readHeader(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("pedtool merge: cannot open " + path + ".");
+    }
+    std::string header;
+    if (!std::getline(file, header)) {
+        throw std::runtime_error("pedtool merge: " + path + " has no header.");
+    }
+    return header;
+}
+
+// 探索結果の行をつなげる. 断片は大きくなりうるので保持せずに1行ずつ写し, 2つ目以降の見出しは飛ばす.
+void concatenateRows(const std::vector<std::string>& paths, std::ostream& ostream) {
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::ifstream file(paths[i], std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("pedtool merge: cannot open " + paths[i] + ".");
+        }
+        std::string line;
+        if (i != 0) {
+            std::getline(file, line);
+        }
+        while (std::getline(file, line)) {
+            ostream << line << "\n";
+        }
+    }
+}
+
+// バイナリ形式: 最初のファイルの見出しと辞書に, 各ファイルの行グループを順に続ける
+void mergeBinary(const std::vector<std::string>& paths, std::ostream& ostream) {
+    std::optional<pedsearch::io::ColumnarReader> first;
+    for (const std::string& path: paths) {
+        pedsearch::io::ColumnarReader reader(path);
+        size_t offset = 0;
+        if (!first) {
+            first.emplace(path);
         } else {
-            broodmares.insert(broodmare);
-        }
-
-        std::cout << "父,母父,母母,凝った,面白,見事,危険,短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワー,SP,ST,PW" << std::endl;
-        for (auto itS2 = secondStallions.begin(); itS2 != secondStallions.end(); ++itS2) {
-            for (auto itS1 = firstStallions.begin(); itS1 != firstStallions.end(); ++itS1) {
-                for (auto itB = broodmares.begin(); itB != broodmares.end(); ++itB) {
-                    pedsearch::base::DefaultBroodmare tmp = tool.makeDefaultBroodmare(*itS1, *itB);
-                    pedsearch::search::PedigreeAnalysis result = tool.analyze(
-                        *itS2, tmp, true, true, true, true, true
-                    );
-                    printPedigreeAnalysis(result, {*itS2, *itS1, *itB}, tool);
+            bool same = reader.getGeneration() == first->getGeneration();
+            for (unsigned int i = 0; same && i <= reader.getGeneration(); i++) {
+                same = reader.getDictionary(i) == first->getDictionary(i)
+                    && reader.getContentHashes(i) == first->getContentHashes(i);
+            }
+            if (!same) {
+                throw std::runtime_error("pedtool merge: " + path + " is an output of another search.");
+            }
+            offset = reader.getFirstRowGroupOffset();
+        }
+        std::ifstream file(path, std::ios::binary);
+        file.seekg((std::streamoff)offset);
+        ostream << file.rdbuf();
+    }
+}
+
+// 集計: キーが同じグループの値を集計関数ごとに併合する. キーは名前の順で, 1プロセスで集計した順と同じになる.
+void mergeAggregates(
+    const std::string& header, const std::vector<std::vector<std::string> >& files, std::ostream& ostream
+) {
+    std::vector<std::string> columns = split(header);
+    size_t numKeys = 0;
+    std::vector<pedsearch::search::Aggregate> aggregates;
+    for (const std::string& column: columns) {
+        try {
+            aggregates.push_back(pedsearch::search::Aggregate(column));
+        } catch (std::runtime_error&) {
+            if (!aggregates.empty()) {
+                throw;
+            }
+            numKeys++;
+        }
+    }
+
+    std::map<std::vector<std::string>, std::vector<int64_t> > groups;
+    for (const std::vector<std::string>& lines: files) {
+        for (size_t i = 1; i < lines.size(); i++) {
+            std::vector<std::string> values = split(lines[i]);
+            if (values.size() != columns.size()) {
+                throw std::runtime_error("pedtool merge: invalid row \"" + lines[i] + "\".");
+            }
+            std::vector<std::string> keys(values.begin(), values.begin() + numKeys);
+            auto it = groups.find(keys);
+            if (it == groups.end()) {
+                std::vector<int64_t> initial;
+                for (const pedsearch::search::Aggregate& aggregate: aggregates) {
+                    initial.push_back(aggregate.getInitialValue());
                 }
+                it = groups.emplace(keys, initial).first;
+            }
+            for (size_t j = 0; j < aggregates.size(); j++) {
+                aggregates[j].merge(it->second[j], std::stoll(values[numKeys + j]));
             }
         }
+    }
 
-    } catch (std::runtime_error e) {
-        std::cerr << e.what() << std::endl;
+    ostream << header << "\n";
+    for (auto it = groups.begin(); it != groups.end(); ++it) {
+        for (const std::string& key: it->first) {
+            ostream << key << ",";
+        }
+        for (size_t j = 0; j < it->second.size(); j++) {
+            ostream << it->second[j] << (j + 1 < it->second.size() ? "," : "\n");
+        }
     }
 }
 
-void threeGeneration(
-    std::string_view path, std::string thirdStallion, std::string secondStallion,
-    std::string firstStallion, std::string broodmare
+// 上位k行: 断片ごとの上位k行を値の大きい順に安定に並べ替える. 断片は行番号の順なので同じ値は行番号の順に残る.
+void mergeTop(
+    const std::string& header, const std::vector<std::vector<std::string> >& files,
+    size_t k, pedsearch::search::ResultField field, std::ostream& ostream
 ) {
+    std::vector<std::string> columns = split(header);
+    const char* name = pedsearch::search::getResultFieldNames(field)[1];
+    size_t column = std::find(columns.begin(), columns.end(), name) - columns.begin();
+    if (column == columns.size()) {
+        throw std::runtime_error("pedtool merge: the field \"" + std::string(name) + "\" is not in csv.");
+    }
+
+    std::vector<std::pair<int, const std::string*> > rows;
+    for (const std::vector<std::string>& lines: files) {
+        for (size_t i = 1; i < lines.size(); i++) {
+            std::vector<std::string> values = split(lines[i]);
+            if (values.size() != columns.size()) {
+                throw std::runtime_error("pedtool merge: invalid row \"" + lines[i] + "\".");
+            }
+            rows.push_back(std::make_pair(std::stoi(values[column]), &lines[i]));
+        }
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    ostream << header << "\n";
+    for (size_t i = 0; i < rows.size() && i < k; i++) {
+        ostream << *rows[i].second << "\n";
+    }
+}
+
+// パレートフロント: すべての断片の行から, SP, ST, PW, 凝った, 面白, 見事で支配されない行を元の順に残す
+void mergePareto(
+    const std::string& header, const std::vector<std::vector<std::string> >& files, std::ostream& ostream
+) {
+    std::vector<std::string> columns = split(header);
+    static const char* names[pedsearch::search::Objectives::SIZE] = {"SP", "ST", "PW", "凝った", "面白", "見事"};
+    size_t indices[pedsearch::search::Objectives::SIZE];
+    for (unsigned int i = 0; i < pedsearch::search::Objectives::SIZE; i++) {
+        indices[i] = std::find(columns.begin(), columns.end(), names[i]) - columns.begin();
+        if (indices[i] == columns.size()) {
+            throw std::runtime_error("pedtool merge: --pareto is only for results.");
+        }
+    }
+
+    pedsearch::search::ParetoFront front;
+    std::vector<const std::string*> lines;
+    for (const std::vector<std::string>& file: files) {
+        for (size_t i = 1; i < file.size(); i++) {
+            std::vector<std::string> values = split(file[i]);
+            if (values.size() != columns.size()) {
+                throw std::runtime_error("pedtool merge: invalid row \"" + file[i] + "\".");
+            }
+            pedsearch::search::Objectives objectives;
+            for (unsigned int j = 0; j < pedsearch::search::Objectives::SIZE; j++) {
+                objectives.values[j] = std::stoi(values[indices[j]]);
+            }
+            front.add(lines.size(), objectives);
+            lines.push_back(&file[i]);
+        }
+    }
+
+    std::vector<uint64_t> rows;
+    for (const pedsearch::search::ParetoFront::Entry& entry: front.getEntries()) {
+        rows.push_back(entry.row);
+    }
+    std::sort(rows.begin(), rows.end());
+    ostream << header << "\n";
+    for (uint64_t row: rows) {
+        ostream << *lines[row] << "\n";
+    }
+}
+
+// --shardで分けて探索した出力を1プロセスで探索した場合と同じ出力にまとめる
+int merge(int argc, char* argv[]) {
     try {
-        pedsearch::search::PedigreeTool tool(
-            path,
-            "database/default_stallions.json",
-            "database/default_broodmares.json",
-            "database/stallions.json",
-            "database/elaborated.json"
-        );
+        std::string output;
+        std::string top;
+        std::string sort;
+        bool pareto = false;
+        std::vector<std::string> paths;
+        for (int i = 2; i < argc; i++) {
+            std::string_view arg = argv[i];
+            if (getOption(arg, "--output", output) || getOption(arg, "--top", top) || getOption(arg, "--sort", sort)) {
+                continue;
+            } else if (arg == "--pareto") {
+                pareto = true;
+                continue;
+            } else if (arg.substr(0, 2) == "--") {
+                throw std::runtime_error("pedtool merge: invalid argument \"" + std::string(arg) + "\".");
+            }
+            paths.push_back(std::string(arg));
+        }
+        if (paths.empty()) {
+            throw std::runtime_error("pedtool merge: no file is specified.");
+        }
 
-        std::set<std::string_view> firstStallions;
-        std::set<std::string_view> secondStallions;
-        std::set<std::string_view> thirdStallions;
-        std::set<std::string_view> broodmares;
-        if (firstStallion == "all") {
-            tool.getDefaultStallionsSet(firstStallions);
-        } else {
-            firstStallions.insert(firstStallion);
+        std::ofstream file;
+        std::ostream* ostream = &std::cout;
+        if (!output.empty()) {
+            file.open(output, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                throw std::runtime_error("pedtool merge: cannot open " + output + ".");
+            }
+            ostream = &file;
         }
 
-        if (secondStallion == "all") {
-            tool.getDefaultStallionsSet(secondStallions);
-        } else {
-            secondStallions.insert(secondStallion);
+        char magic[sizeof(pedsearch::io::ColumnarFormat::MAGIC)] = {};
+        std::ifstream(paths[0], std::ios::binary).read(magic, sizeof(magic));
+        if (std::memcmp(magic, pedsearch::io::ColumnarFormat::MAGIC, sizeof(magic)) == 0) {
+            if (!top.empty() || pareto) {
+                throw std::runtime_error("pedtool merge: --top and --pareto are only for csv.");
+            }
+            mergeBinary(paths, *ostream);
+            ostream->flush();
+            return 0;
         }
 
-        if (thirdStallion == "all") {
-            tool.getDefaultStallionsSet(thirdStallions);
-        } else {
-            thirdStallions.insert(thirdStallion);
+        const std::string header = readHeader(paths[0]);
+        for (const std::string& path: paths) {
+            if (readHeader(path) != header) {
+                throw std::runtime_error("pedtool merge: " + path + " has a different header.");
+            }
+        }
+        bool rows = header.size() >= 3 && header.compare(header.size() - 3, 3, ",PW") == 0;
+        if (!top.empty() && !rows) {
+            throw std::runtime_error("pedtool merge: --top is only for results.");
+        }
+        if (rows && top.empty() && !pareto) {
+            concatenateRows(paths, *ostream);
+            ostream->flush();
+            return 0;
         }
 
-        if (broodmare == "all") {
-            tool.getDefaultBroodmaresSet(broodmares);
+        // 上位k件, パレート解と集計は全行から決まるので読み込んでおく
+        std::vector<std::vector<std::string> > files;
+        for (const std::string& path: paths) {
+            files.push_back(readLines(path));
+        }
+        if (!top.empty()) {
+            mergeTop(header, files, parseTop(top), parseSortField(sort), *ostream);
+        } else if (pareto) {
+            mergePareto(header, files, *ostream);
         } else {
-            broodmares.insert(broodmare);
-        }
-
-        std::cout << "父,母父,母母父,母母母,凝った,面白,見事,危険,短距離,速力,長距離,底力,安定,気性難,早熟,晩成,丈夫,ダート,パワー,SP,ST,PW" << std::endl;
-        for (auto itS3 = thirdStallions.begin(); itS3 != thirdStallions.end(); ++itS3) {
-            for (auto itS2 = secondStallions.begin(); itS2 != secondStallions.end(); ++itS2) {
-                for (auto itS1 = firstStallions.begin(); itS1 != firstStallions.end(); ++itS1) {
-                    for (auto itB = broodmares.begin(); itB != broodmares.end(); ++itB) {
-                        pedsearch::base::DefaultBroodmare tmp1 = tool.makeDefaultBroodmare(*itS1, *itB);
-                        pedsearch::base::DefaultBroodmare tmp2 = tool.makeDefaultBroodmare(*itS2, tmp1);
-                        pedsearch::search::PedigreeAnalysis result = tool.analyze(
-                            *itS3, tmp2, true, true, true, true, true
-                        );
-                        printPedigreeAnalysis(result, {*itS3, *itS2, *itS1, *itB}, tool);
-                    }
-                }
+            mergeAggregates(header, files, *ostream);
+        }
+        ostream->flush();
+        return 0;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (std::invalid_argument&) {
+        std::cerr << "pedtool merge: invalid number in csv." << std::endl;
+        return 1;
+    }
+}
+
+// 基礎の母から数年分の配合の計画を立てる
+int plan(int argc, char* argv[]) {
+    try {
+        std::string seasons = "3";
+        std::string objective = "sp+st+pw";
+        std::string output;
+        std::string roster;
+        std::vector<std::string> names;
+        for (int i = 2; i < argc; i++) {
+            std::string_view arg = argv[i];
+            if (getOption(arg, "--seasons", seasons) || getOption(arg, "--objective", objective)
+                || getOption(arg, "--output", output) || getOption(arg, "--roster", roster)) {
+                continue;
+            } else if (arg.substr(0, 2) == "--") {
+                throw std::runtime_error("pedtool plan: invalid argument \"" + std::string(arg) + "\".");
+            }
+            names.push_back(std::string(arg));
+        }
+        if (names.size() != 2) {
+            throw std::runtime_error("pedtool plan: give one stallion_name and one broodmare_name.");
+        }
+        unsigned long k = 0;
+        try {
+            size_t n = 0;
+            k = std::stoul(seasons, &n);
+            if (n != seasons.size()) {
+                throw std::invalid_argument("");
+            }
+        } catch (std::logic_error&) {
+            throw std::runtime_error("pedtool plan: invalid number of seasons \"" + seasons + "\".");
+        }
+
+        pedsearch::search::PedigreeTool tool = loadTool(argv[0], roster);
+        pedsearch::search::SearchQuery query;
+        query.addStallion(names[0]);
+        query.setBroodmare(names[1]);
+        pedsearch::search::BreedingPlanner planner(
+            tool, tool.resolve(query), (unsigned int)k, pedsearch::search::PlanObjective(objective)
+        );
+        std::vector<pedsearch::search::PlanStep> steps = planner.plan();
+
+        std::ofstream file;
+        std::ostream* ostream = &std::cout;
+        if (!output.empty()) {
+            file.open(output, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                throw std::runtime_error("pedtool plan: cannot open " + output + ".");
+            }
+            ostream = &file;
+        }
+        *ostream << "年,父,母";
+        for (size_t f = 0; f < (size_t)pedsearch::search::ResultField::CROSSES; f++) {
+            *ostream << "," << pedsearch::search::getResultFieldNames((pedsearch::search::ResultField)f)[1];
+        }
+        *ostream << ",評価値,累計\n";
+        for (const pedsearch::search::PlanStep& step: steps) {
+            *ostream << step.year << "," << tool.getDefaultStallionName(step.stallion) << ",";
+            if (step.year == 1) {
+                *ostream << tool.getDefaultBroodmareName(planner.getFoundation());
+            } else {
+                *ostream << (step.year - 1) << "年目の娘";
+            }
+            for (size_t f = 0; f < (size_t)pedsearch::search::ResultField::CROSSES; f++) {
+                *ostream << "," << pedsearch::search::getResultField(step.result, (pedsearch::search::ResultField)f);
+            }
+            *ostream << "," << step.value << "," << step.total << "\n";
+        }
+        ostream->flush();
+        return 0;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// 目的のクロスを作る父を探す
+int reverse(int argc, char* argv[]) {
+    try {
+        std::string cross;
+        std::string filter;
+        std::string output;
+        std::string roster;
+        std::vector<std::string> names;
+        for (int i = 2; i < argc; i++) {
+            std::string_view arg = argv[i];
+            if (getOption(arg, "--cross", cross) || getOption(arg, "--filter", filter)
+                || getOption(arg, "--output", output) || getOption(arg, "--roster", roster)) {
+                continue;
+            } else if (arg.substr(0, 2) == "--") {
+                throw std::runtime_error("pedtool reverse: invalid argument \"" + std::string(arg) + "\".");
+            }
+            names.push_back(std::string(arg));
+        }
+        if (names.size() < 2 || names.size() > 4) {
+            throw std::runtime_error("pedtool reverse: give 1 to 3 stallion_names and a broodmare_name.");
+        }
+        if (cross.empty()) {
+            throw std::runtime_error("pedtool reverse: --cross is required.");
+        }
+
+        pedsearch::search::PedigreeTool tool = loadTool(argv[0], roster);
+        pedsearch::search::SearchQuery query;
+        for (size_t i = 0; i + 1 < names.size(); i++) {
+            query.addStallion(names[i]);
+        }
+        query.setBroodmare(names.back());
+        if (!filter.empty()) {
+            query.setFilter(filter);
+        }
+        pedsearch::search::ReverseSearch search(
+            tool, tool.resolve(query), pedsearch::search::ReverseSearch::parse(tool, cross), query.getFilter()
+        );
+        std::vector<pedsearch::search::SearchResult> results = search.run();
+
+        std::ofstream file;
+        std::ostream* ostream = &std::cout;
+        if (!output.empty()) {
+            file.open(output, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                throw std::runtime_error("pedtool reverse: cannot open " + output + ".");
+            }
+            ostream = &file;
+        }
+        pedsearch::io::CsvWriter writer(*ostream, tool, search.getSpace());
+        writer.writeBatch(results);
+        writer.finish();
+        std::cerr << "pedtool reverse: analyzed " << search.getNumEvaluations() << " of "
+            << search.getSpace().size() << " pedigrees." << std::endl;
+        return 0;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// 常駐して問い合わせに答え, データベースのファイルが変わったら読み直して差し替える
+int serve(int argc, char* argv[]) {
+    try {
+        std::string socket;
+        std::string roster;
+        std::string cacheEntries = "1048576";
+        for (int i = 2; i < argc; i++) {
+            std::string_view arg = argv[i];
+            if (getOption(arg, "--socket", socket) || getOption(arg, "--roster", roster)
+                || getOption(arg, "--cache-entries", cacheEntries)) {
+                continue;
             }
+            throw std::runtime_error("pedtool serve: invalid argument \"" + std::string(arg) + "\".");
+        }
+
+        pedsearch::search::SnapshotStore store(loadTool(argv[0], roster));
+        std::string program = argv[0];
+        std::string database = program.substr(0, program.rfind('/') + 1) + "database/";
+        std::vector<std::string> paths = {
+            database + "default_stallions.json", database + "default_broodmares.json",
+            database + "stallions.json", database + "elaborated.json"
+        };
+        if (!roster.empty()) {
+            paths.push_back(roster);
+        }
+        // 読み直しは監視のスレッドで行い, 失敗したら今の版を使い続ける
+        pedsearch::io::DatabaseWatcher watcher(paths, [&store, &argv, &roster]() {
+            try {
+                uint64_t version = store.publish(loadTool(argv[0], roster));
+                std::cerr << "pedtool serve: reloaded the database as version " << version << "." << std::endl;
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                std::cerr << "pedtool serve: keeping version " << store.get()->version << "." << std::endl;
+            }
+        });
+
+        std::optional<pedsearch::search::ResultCache> cache;
+        unsigned long entries = 0;
+        try {
+            size_t n = 0;
+            entries = std::stoul(cacheEntries, &n);
+            if (n != cacheEntries.size()) {
+                throw std::invalid_argument("");
+            }
+        } catch (std::logic_error&) {
+            throw std::runtime_error("pedtool serve: invalid number of cache entries \"" + cacheEntries + "\".");
+        }
+        if (entries > 0) {
+            cache.emplace(entries);
+        }
+        pedsearch::io::QueryServer server(store, cache ? &*cache : nullptr);
+        if (socket.empty()) {
+            server.serve(std::cin, std::cout);
+        } else {
+            server.listen(socket);
         }
-    } catch (std::runtime_error e) {
+        return 0;
+    } catch (const std::runtime_error& e) {
         std::cerr << e.what() << std::endl;
+        return 1;
     }
 }
 
 int main(int argc, char* argv[]) {
     if (argc == 1) {
-        std::cout << "Usage:" << std::endl;
-        std::cout << "pedtool [stallion_name] [broodmare_name]" << std::endl;
-        std::cout << "pedtool [stallion_name] [stallion_name] [broodmare_name]" << std::endl;
-        std::cout << "pedtool [stallion_name] [stallion_name] [stallion_name] [broodmare_name]" << std::endl;
-        std::cout << "you can set \"all\" to stallion_name and broodmare_name." << std::endl;
-    } else if (argc == 3) {
-        oneGeneration(argv[0], argv[1], argv[2]);
-    } else if (argc == 4) {
-        twoGeneration(argv[0], argv[1], argv[2], argv[3]);
-    } else if (argc == 5) {
-        threeGeneration(argv[0], argv[1], argv[2], argv[3], argv[4]);
+        printUsage();
+        return 0;
+    }
+    if (std::string_view(argv[1]) == "scan") {
+        return scan(argc, argv);
+    }
+    if (std::string_view(argv[1]) == "merge") {
+        return merge(argc, argv);
+    }
+    if (std::string_view(argv[1]) == "plan") {
+        return plan(argc, argv);
+    }
+    if (std::string_view(argv[1]) == "reverse") {
+        return reverse(argc, argv);
+    }
+    if (std::string_view(argv[1]) == "serve") {
+        return serve(argc, argv);
+    }
+
+    Options options;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (getOption(arg, "--format", options.format) || getOption(arg, "--output", options.output)
+            || getOption(arg, "--group-by", options.groupBy) || getOption(arg, "--agg", options.aggregates)
+            || getOption(arg, "--threads", options.threads) || getOption(arg, "--filter", options.filter)
+            || getOption(arg, "--checkpoint", options.checkpoint)
+            || getOption(arg, "--checkpoint-interval", options.checkpointInterval)
+            || getOption(arg, "--status-file", options.statusFile) || getOption(arg, "--shard", options.shard)
+            || getOption(arg, "--top", options.top) || getOption(arg, "--sort", options.sort)
+            || getOption(arg, "--sample", options.sample) || getOption(arg, "--seed", options.seed)
+            || getOption(arg, "--roster", options.roster) || getOption(arg, "--reuse", options.reuse)) {
+            continue;
+        } else if (arg == "--stratify") {
+            options.stratify = true;
+            continue;
+        } else if (arg == "--pareto") {
+            options.pareto = true;
+            continue;
+        } else if (arg == "--progress") {
+            options.progress = true;
+            continue;
+        } else if (arg == "--resume") {
+            options.resume = true;
+            continue;
+        } else if (arg.substr(0, 2) == "--") {
+            std::cerr << "Invalid arguments." << std::endl;
+            return 1;
+        }
+        names.push_back(std::string(arg));
+    }
+
+    // 4代以上は全探索できないので無作為抽出の場合だけ受け付ける
+    size_t maxNames = options.sample.empty() ? 4 : pedsearch::search::SearchQuery::MAX_GENERATION + 1;
+    if (names.size() >= 2 && names.size() <= maxNames) {
+        pedsearch::search::SearchQuery query;
+        for (size_t i = 0; i + 1 < names.size(); i++) {
+            query.addStallion(names[i]);
+        }
+        query.setBroodmare(names.back());
+        if (!options.filter.empty()) {
+            try {
+                query.setFilter(options.filter);
+            } catch (const std::runtime_error& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        }
+        if (!options.sample.empty()) {
+            sample(argv[0], query, options);
+        } else if (options.pareto) {
+            pareto(argv[0], query, options);
+        } else if (options.groupBy.empty() && options.aggregates.empty()) {
+            search(argv[0], names, query, options);
+        } else {
+            aggregate(argv[0], query, options);
+        }
     } else {
         std::cerr << "Invalid arguments." << std::endl;
+        return 1;
     }
 }